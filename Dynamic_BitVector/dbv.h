@@ -5,12 +5,6 @@
 
 #include "dbv_memory.h"
 
-#ifdef __cplusplus
-#define static_ static
-#else
-#define static_
-#endif
-
 typedef struct {
   DBVMemPtr root_;
   DBVMemObj mem_;
@@ -23,28 +17,28 @@ typedef struct {
 
 #define DBV_ENABLE_RED_BLACK_BALANCING
 
-/* global dbv_stack */
+/* stack used for tree traversal (local to each update operation) */
 typedef struct dbv_stack_32b {
   int32_t stack_[DBV_MAX_STACK_SIZE];
   int32_t current_;
 } dbv_stack_32b;
 
-#define DBV_STACK_GET_PARENT() \
-  ((dbv_stack.current_ >= 1) ? dbv_stack.stack_[dbv_stack.current_ - 1] : -1)
-#define DBV_STACK_GET_GRANDPARENT() \
-  ((dbv_stack.current_ >= 2) ? dbv_stack.stack_[dbv_stack.current_ - 2] : -1)
-#define DBV_STACK_GET_GRANDGRANDPARENT() \
-  ((dbv_stack.current_ >= 3) ? dbv_stack.stack_[dbv_stack.current_ - 3] : -1)
-#define DBV_STACK_PUSH(arg)  {                      \
-  if (dbv_stack.current_ + 1 >= DBV_MAX_STACK_SIZE) \
-    FATAL("Stack overflow");                        \
-  dbv_stack.stack_[++dbv_stack.current_] = arg;     \
+#define DBV_STACK_GET_PARENT(stack__) \
+  (((stack__).current_ >= 1) ? (stack__).stack_[(stack__).current_ - 1] : -1)
+#define DBV_STACK_GET_GRANDPARENT(stack__) \
+  (((stack__).current_ >= 2) ? (stack__).stack_[(stack__).current_ - 2] : -1)
+#define DBV_STACK_GET_GRANDGRANDPARENT(stack__) \
+  (((stack__).current_ >= 3) ? (stack__).stack_[(stack__).current_ - 3] : -1)
+#define DBV_STACK_PUSH(stack__, arg)  {                  \
+  if ((stack__).current_ + 1 >= DBV_MAX_STACK_SIZE)      \
+    FATAL("Stack overflow");                             \
+  (stack__).stack_[++(stack__).current_] = arg;          \
 }
-#define DBV_STACK_POP() ((dbv_stack.current_ == -1) ? -1 : dbv_stack.stack_[dbv_stack.current_--])
-#define DBV_STACK_TOP() ((dbv_stack.current_ == -1) ? -1 : dbv_stack.stack_[dbv_stack.current_])
-#define DBV_STACK_CLEAN() dbv_stack.current_ = -1;
-
-static_ dbv_stack_32b dbv_stack;
+#define DBV_STACK_POP(stack__) \
+  (((stack__).current_ == -1) ? -1 : (stack__).stack_[(stack__).current_--])
+#define DBV_STACK_TOP(stack__) \
+  (((stack__).current_ == -1) ? -1 : (stack__).stack_[(stack__).current_])
+#define DBV_STACK_CLEAN(stack__) (stack__).current_ = -1;
 
 /*
  * Initialize DBV_Struct object.
@@ -4,11 +4,12 @@
 void DBV_Delete(DBVStructRef DBV__, uint32_t pos__) {
   uint32_t temp, mask, vector;
   int32_t val;
+  dbv_stack_32b stack;
 
   if (pos__ >= DBV_MEMORY_GET_ANY(DBV__->mem_, DBV__->root_)->p_)
     FATAL("Index out of range");
 
-  DBV_STACK_CLEAN();
+  DBV_STACK_CLEAN(stack);
 
   /* traverse the tree and enter correct leaf */
   DBVMemObj mem = DBV__->mem_;
@@ -18,7 +19,7 @@ void DBV_Delete(DBVStructRef DBV__, uint32_t pos__) {
   DBVLeafRef leaf_ref;
 
   while (!DBV_IS_LEAF(current)) {
-    DBV_STACK_PUSH(current);
+    DBV_STACK_PUSH(stack, current);
 
     /* update p counter as we are traversing the structure */
     node_ref = DBV_MEMORY_GET_NODE(mem, current);
@@ -56,7 +57,7 @@ void DBV_Delete(DBVStructRef DBV__, uint32_t pos__) {
       node_ref = DBV_MEMORY_GET_ANY(mem, current);
       node_ref->r_ -= 1;
 
-      current = DBV_STACK_POP();
+      current = DBV_STACK_POP(stack);
     } while (current != -1);
   }
 }
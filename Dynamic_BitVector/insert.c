@@ -31,15 +31,17 @@
   r1->r_ = r2->r_ op r3->r_;
 
 void DBV_Insert(DBVStructRef DBV__, uint32_t pos__, bool val__) {
+  dbv_stack_32b stack;
+
   if (pos__ > DBV_MEMORY_GET_ANY(DBV__->mem_, DBV__->root_)->p_)
     FATAL("Index out of range");
 
-  DBV_STACK_CLEAN();
+  DBV_STACK_CLEAN(stack);
 
   /* traverse the tree and enter correct leaf */
   DBVMemObj mem = DBV__->mem_;
   DBVMemPtr current = DBV__->root_;
-  DBV_STACK_PUSH(current);
+  DBV_STACK_PUSH(stack, current);
 
   while (!DBV_IS_LEAF(current)) {
     /* update p and r counters as we are traversing the structure */
@@ -55,7 +57,7 @@ void DBV_Insert(DBVStructRef DBV__, uint32_t pos__, bool val__) {
       current = node->right_;
     }
 
-    DBV_STACK_PUSH(current);
+    DBV_STACK_PUSH(stack, current);
   }
 
   DBVLeafRef current_ref = DBV_MEMORY_GET_LEAF(mem, current);
@@ -94,10 +96,10 @@ void DBV_Insert(DBVStructRef DBV__, uint32_t pos__, bool val__) {
     }
 
     /* finally exchange pointers to new node */
-    if (DBV_STACK_GET_PARENT() == -1) {
+    if (DBV_STACK_GET_PARENT(stack) == -1) {
       DBV__->root_ = node;
     } else {
-      DBVNodeRef parent = DBV_MEMORY_GET_NODE(mem, DBV_STACK_GET_PARENT());
+      DBVNodeRef parent = DBV_MEMORY_GET_NODE(mem, DBV_STACK_GET_PARENT(stack));
       if (parent->left_ == current)
         parent->left_ = node;
       else
@@ -112,25 +114,25 @@ void DBV_Insert(DBVStructRef DBV__, uint32_t pos__, bool val__) {
 
     do {
       /* current node is the root - change it to black and end */
-      if (DBV_STACK_GET_PARENT() == -1) {
+      if (DBV_STACK_GET_PARENT(stack) == -1) {
         node_ref->rb_flag_ = false;
         return;
       }
 
-      DBVMemPtr parent_idx = DBV_STACK_GET_PARENT();
+      DBVMemPtr parent_idx = DBV_STACK_GET_PARENT(stack);
       DBVNodeRef parent = DBV_MEMORY_GET_NODE(mem, parent_idx);
       /* parent node is a black node - do nothing */
       if (parent->rb_flag_ == false) {
         return;
       }
 
-      DBVMemPtr grandparent_idx = DBV_STACK_GET_GRANDPARENT();
+      DBVMemPtr grandparent_idx = DBV_STACK_GET_GRANDPARENT(stack);
       DBVNodeRef grandparent = DBV_MEMORY_GET_NODE(mem, grandparent_idx);
 
       /* get uncle */
       DBVMemPtr uncle_idx = grandparent->left_;
       grandparent_left = false;
-      if (grandparent->left_ == DBV_STACK_GET_PARENT()) {
+      if (grandparent->left_ == DBV_STACK_GET_PARENT(stack)) {
         uncle_idx = grandparent->right_;
         grandparent_left = true;
       }
@@ -145,8 +147,8 @@ void DBV_Insert(DBVStructRef DBV__, uint32_t pos__, bool val__) {
 
         node = grandparent_idx;
         node_ref = grandparent;
-        DBV_STACK_POP();
-        DBV_STACK_POP();
+        DBV_STACK_POP(stack);
+        DBV_STACK_POP(stack);
         continue;
       }
 
@@ -216,10 +218,10 @@ void DBV_Insert(DBVStructRef DBV__, uint32_t pos__, bool val__) {
       }
 
       /* finally exchange pointers to new node */
-      if (DBV_STACK_GET_GRANDGRANDPARENT() == -1) {
+      if (DBV_STACK_GET_GRANDGRANDPARENT(stack) == -1) {
         DBV__->root_ = newroot;
       } else {
-        DBVNodeRef grandgrandparent = DBV_MEMORY_GET_NODE(mem, DBV_STACK_GET_GRANDGRANDPARENT());
+        DBVNodeRef grandgrandparent = DBV_MEMORY_GET_NODE(mem, DBV_STACK_GET_GRANDGRANDPARENT(stack));
         if (grandgrandparent->left_ == grandparent_idx)
           grandgrandparent->left_ = newroot;
         else
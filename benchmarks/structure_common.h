@@ -22,6 +22,7 @@ struct {
   double rand_rank;
   double rand_select;
   double rand_access;
+  double seq_iterate;
 } res;
 
 clock_t start_time;
@@ -49,9 +50,11 @@ void show_results() {
   printf("Random rank:\t\t%lf\n", res.rand_rank);
   printf("Random select:\t\t%lf\n", res.rand_select);
   printf("Random access:\t\t%lf\n", res.rand_access);
+  printf("Sequential iterate:\t%lf\n", res.seq_iterate);
   printf("---------------------------------------\n");
-  printf("%lf:%lf:%lf:%lf:%lf:%lf:%lf:%lf\n", res.seq_insertion, res.rand_insertion, res.seq_rank,
-         res.seq_select, res.seq_access, res.rand_rank, res.rand_select, res.rand_access);
+  printf("%lf:%lf:%lf:%lf:%lf:%lf:%lf:%lf:%lf\n", res.seq_insertion, res.rand_insertion, res.seq_rank,
+         res.seq_select, res.seq_access, res.rand_rank, res.rand_select, res.rand_access,
+         res.seq_iterate);
 }
 
 #endif
@@ -6,7 +6,7 @@
 void benchmark_sequential_insertion() {
   Graph_Struct Graph;
   Graph_Line line;
-  Graph_Init(&Graph);
+  Graph_Init(&Graph, 0);
 
   uint8_t* input_string = int_sequence_generate_random(sample_size, 8);
 
@@ -24,7 +24,7 @@ void benchmark_sequential_insertion() {
 void benchmark_random_insertion() {
   Graph_Struct Graph;
   Graph_Line line;
-  Graph_Init(&Graph);
+  Graph_Init(&Graph, 0);
 
   uint8_t* input_string = int_sequence_generate_random(sample_size, 8);
 
@@ -42,14 +42,16 @@ void benchmark_random_insertion() {
 void benchmark_operations() {
   Graph_Struct Graph;
   Graph_Line line;
-  Graph_Init(&Graph);
+  Graph_Iterator iter;
 
   uint8_t* input_string = int_sequence_generate_random(sample_size, 8);
+  Graph_Line* lines = (Graph_Line*) malloc(sample_size * sizeof(Graph_Line));
   for (int32_t i = 0; i < sample_size; i++) {
-    GLine_Fill(&line, VAR_IGNORE, input_string[i], VAR_IGNORE);
-    GLine_Insert(&Graph, i, &line);
+    GLine_Fill(&(lines[i]), VAR_IGNORE, input_string[i], VAR_IGNORE);
   }
+  Graph_Build(&Graph, lines, NULL, sample_size);
   free(input_string);
+  free(lines);
 
   START_BENCHMARK;
   for (int32_t i = 0; i < sample_size; i++) {
@@ -69,6 +71,13 @@ void benchmark_operations() {
   }
   END_BENCHMARK(seq_access);
 
+  START_BENCHMARK;
+  Graph_Iterator_Init(&iter, &Graph, 0);
+  do {
+    Graph_Iterator_Get(&iter, &line);
+  } while (Graph_Iterator_Next(&iter));
+  END_BENCHMARK(seq_iterate);
+
   START_BENCHMARK;
   for (int32_t i = 0; i < secondary_size; i++) {
     Graph_Rank(&Graph, rand() % sample_size, VECTOR_W, rand() % 4);
@@ -39,6 +39,7 @@ PROFILING_SRC_FILES = $(PROFILING_DIR)/memory_profiling.c $(PROFILING_DIR)/time_
 COMPRESSOR_SRC_FILES = \
 	$(COMPRESSOR_ROOT)/cache.c      \
 	$(COMPRESSOR_ROOT)/compressor.c \
+	$(COMPRESSOR_ROOT)/container.c  \
 	$(COMPRESSOR_ROOT)/deBruijn.c   \
 	$(COMPRESSOR_ROOT)/memory.c     \
 	$(COMPRESSOR_ROOT)/rank.c       \
@@ -48,6 +49,7 @@ COMPRESSOR_SRC_FILES = \
 COMPRESSOR_HEADER_FILES = \
 	$(COMPRESSOR_ROOT)/cache.h      \
 	$(COMPRESSOR_ROOT)/compressor.h \
+	$(COMPRESSOR_ROOT)/container.h  \
 	$(COMPRESSOR_ROOT)/deBruijn.h   \
 	$(COMPRESSOR_ROOT)/defines.h    \
 	$(COMPRESSOR_ROOT)/memory.h     \
@@ -126,26 +126,12 @@ static char rcsid[] = "$Id: arith.c,v 1.1 1996/08/07 01:34:11 langs Exp $";
 #if defined(VARY_NBITS)
   int B_bits = B_BITS; /* Default values */
   int F_bits = F_BITS;
-  static code_value Half;
-  static code_value Quarter;
-#else
-  #define Half ((code_value)1 << (B_bits - 1))
-  #define Quarter ((code_value)1 << (B_bits - 2))
-#endif
-
-/* Separate input and output */
-/* Input decoding state */
-static code_value in_R; /* code range */
-static code_value in_D; /* = V-L (V offset)*/
-static div_value in_r;  /* normalized range */
-#ifdef FRUGAL_BITS
-static code_value in_V; /* Bitstream window */
 #endif
 
-/* Output encoding state */
-static code_value out_L;                   /* lower bound */
-static code_value out_R;                   /* code range */
-static unsigned long out_bits_outstanding; /* follow bit count */
+/* Coding state is kept in arith_coder (see arith.h), so that several
+ * independent coders can be used at once */
+#define Half ((code_value)1 << (B_bits - 1))
+#define Quarter ((code_value)1 << (B_bits - 2))
 
 /*
  * BIT_PLUS_FOLLOW(b)
@@ -153,25 +139,23 @@ static unsigned long out_bits_outstanding; /* follow bit count */
  * bit equal to the value stored in bits_outstanding
  *
  */
-#define ORIG_BIT_PLUS_FOLLOW(b)        \
-  do {                                 \
-    OUTPUT_BIT((b));                   \
-    while (out_bits_outstanding > 0) { \
-      OUTPUT_BIT(!(b));                \
-      out_bits_outstanding--;          \
-    }                                  \
+#define ORIG_BIT_PLUS_FOLLOW(b)            \
+  do {                                     \
+    OUTPUT_BIT(&(ac->io), (b));            \
+    while (ac->out_bits_outstanding > 0) { \
+      OUTPUT_BIT(&(ac->io), !(b));         \
+      ac->out_bits_outstanding--;          \
+    }                                      \
   } while (0)
 
 #ifdef FRUGAL_BITS
 
-int _ignore_first_bit = 1;
-
-#define BIT_PLUS_FOLLOW(x)     \
-  do {                         \
-    if (_ignore_first_bit)     \
-      _ignore_first_bit = 0;   \
-    else                       \
-      ORIG_BIT_PLUS_FOLLOW(x); \
+#define BIT_PLUS_FOLLOW(x)      \
+  do {                          \
+    if (ac->ignore_first_bit)   \
+      ac->ignore_first_bit = 0; \
+    else                        \
+      ORIG_BIT_PLUS_FOLLOW(x);  \
   } while (0)
 
 #else
@@ -188,21 +172,21 @@ int _ignore_first_bit = 1;
  * (a redundant zero will otherwise be emitted every time the encoder is
  * started)
  */
-#define ENCODE_RENORMALISE                \
-  do {                                    \
-    while (out_R <= Quarter) {            \
-      if (out_L >= Half) {                \
-        BIT_PLUS_FOLLOW(1);               \
-        out_L -= Half;                    \
-      } else if (out_L + out_R <= Half) { \
-        BIT_PLUS_FOLLOW(0);               \
-      } else {                            \
-        out_bits_outstanding++;           \
-        out_L -= Quarter;                 \
-      }                                   \
-      out_L <<= 1;                        \
-      out_R <<= 1;                        \
-    }                                     \
+#define ENCODE_RENORMALISE                        \
+  do {                                            \
+    while (ac->out_R <= Quarter) {                \
+      if (ac->out_L >= Half) {                    \
+        BIT_PLUS_FOLLOW(1);                       \
+        ac->out_L -= Half;                        \
+      } else if (ac->out_L + ac->out_R <= Half) { \
+        BIT_PLUS_FOLLOW(0);                       \
+      } else {                                    \
+        ac->out_bits_outstanding++;               \
+        ac->out_L -= Quarter;                     \
+      }                                           \
+      ac->out_L <<= 1;                            \
+      ac->out_R <<= 1;                            \
+    }                                             \
   } while (0)
 
 /*
@@ -213,22 +197,22 @@ int _ignore_first_bit = 1;
  * exactly how many disambiguating bits the encoder put out (1,2 or 3).
  */
 #ifdef FRUGAL_BITS
-#define DECODE_RENORMALISE              \
-  do {                                  \
-    while (in_R <= Quarter) {           \
-      in_R <<= 1;                       \
-      in_V <<= 1;                       \
-      ADD_NEXT_INPUT_BIT(in_D, B_bits); \
-      if (in_D & 1) in_V++;             \
-    }                                   \
+#define DECODE_RENORMALISE                             \
+  do {                                                 \
+    while (ac->in_R <= Quarter) {                      \
+      ac->in_R <<= 1;                                  \
+      ac->in_V <<= 1;                                  \
+      ADD_NEXT_INPUT_BIT(&(ac->io), ac->in_D, B_bits); \
+      if (ac->in_D & 1) ac->in_V++;                    \
+    }                                                  \
   } while (0)
 #else
-#define DECODE_RENORMALISE         \
-  do {                             \
-    while (in_R <= Quarter) {      \
-      in_R <<= 1;                  \
-      ADD_NEXT_INPUT_BIT(in_D, 0); \
-    }                              \
+#define DECODE_RENORMALISE                        \
+  do {                                            \
+    while (ac->in_R <= Quarter) {                 \
+      ac->in_R <<= 1;                             \
+      ADD_NEXT_INPUT_BIT(&(ac->io), ac->in_D, 0); \
+    }                                             \
   } while (0)
 #endif
 
@@ -237,7 +221,7 @@ int _ignore_first_bit = 1;
  * encode a symbol given its low, high and total frequencies
  *
  */
-void arithmetic_encode(freq_value low, freq_value high, freq_value total) {
+void arithmetic_encode(arith_coder* ac, freq_value low, freq_value high, freq_value total) {
   /* The following pseudocode is a concise (but slow due to arithmetic
    * calculations) description of what is calculated in this function.
    * Note that the division is done before the multiplication.  This is
@@ -280,13 +264,13 @@ void arithmetic_encode(freq_value low, freq_value high, freq_value total) {
 #ifdef MULT_DIV
   {
     div_value out_r;
-    out_r = out_R / total; /* Calc range:freq ratio */
+    out_r = ac->out_R / total; /* Calc range:freq ratio */
     temp = out_r * low;    /* Calc low increment */
-    out_L += temp;         /* Increase L */
+    ac->out_L += temp;         /* Increase L */
     if (high < total)
-      out_R = out_r * (high - low); /* Restrict R */
+      ac->out_R = out_r * (high - low); /* Restrict R */
     else
-      out_R -= temp; /* If at end of freq range */
+      ac->out_R -= temp; /* If at end of freq range */
     /* Give symbol excess code range */
   }
 #else
@@ -299,7 +283,7 @@ void arithmetic_encode(freq_value low, freq_value high, freq_value total) {
      * using shifts and adds  (r need not be stored as it is implicit in the
      * loop)
      */
-    A = out_R;
+    A = ac->out_R;
     temp = 0;
     temp2 = 0;
 
@@ -342,17 +326,17 @@ void arithmetic_encode(freq_value low, freq_value high, freq_value total) {
 
 #endif /* Varying/nonvarying shifts */
 
-    out_L += temp;
+    ac->out_L += temp;
     if (high < total)
-      out_R = temp2 - temp;
+      ac->out_R = temp2 - temp;
     else
-      out_R -= temp;
+      ac->out_R -= temp;
   }
 #endif
 
   ENCODE_RENORMALISE;
 
-  if (out_bits_outstanding > MAX_BITS_OUTSTANDING) {
+  if (ac->out_bits_outstanding > MAX_BITS_OUTSTANDING) {
     /*
      * For MAX_BITS_OUTSTANDING to be exceeded is extremely improbable, but
      * it is possible.  For this to occur the COMPRESSED file would need to
@@ -399,19 +383,19 @@ void arithmetic_encode(freq_value low, freq_value high, freq_value total) {
  *				* range (total-1)			*
  *
  */
-freq_value arithmetic_decode_target(freq_value total) {
+freq_value arithmetic_decode_target(arith_coder* ac, freq_value total) {
   freq_value target;
 
 #ifdef MULT_DIV
-  in_r = in_R / total;
-  target = (in_D) / in_r;
+  ac->in_r = ac->in_R / total;
+  target = (ac->in_D) / ac->in_r;
 #else
   {
     code_value A, M; /* A = numerator, M = denominator */
 
     /* divide r = R/total using shifts and adds */
-    A = in_R;
-    in_r = 0;
+    A = ac->in_R;
+    ac->in_r = 0;
 #ifdef VARY_NBITS
     {
       int i, nShifts;
@@ -420,20 +404,20 @@ freq_value arithmetic_decode_target(freq_value total) {
       for (i = nShifts;; i--) {
         if (A >= M) {
           A -= M;
-          in_r++;
+          ac->in_r++;
         }
         if (i == 0) break;
         A <<= 1;
-        in_r <<= 1;
+        ac->in_r <<= 1;
       }
 
       /* divide D by r using shifts and adds */
-      if (in_r < (1 << (B_bits - F_bits - 1)))
+      if (ac->in_r < (1 << (B_bits - F_bits - 1)))
         nShifts = F_bits;
       else
         nShifts = F_bits - 1;
-      A = in_D;
-      M = in_r << nShifts;
+      A = ac->in_D;
+      M = ac->in_r << nShifts;
       target = 0;
       for (i = nShifts;; i--) {
         if (A >= M) {
@@ -449,23 +433,23 @@ freq_value arithmetic_decode_target(freq_value total) {
     M = total << (B_bits - F_bits - 1);
     if (A >= M) {
       A -= M;
-      in_r++;
+      ac->in_r++;
     }
 
 #define UNROLL_NUM B_bits - F_bits - 1
 #define UNROLL_CODE \
   A <<= 1;          \
-  in_r <<= 1;       \
+  ac->in_r <<= 1;   \
   if (A >= M) {     \
     A -= M;         \
-    in_r++;         \
+    ac->in_r++;     \
   }
 #include "unroll.i"
 
-    A = in_D;
+    A = ac->in_D;
     target = 0;
-    if (in_r < (1 << (B_bits - F_bits - 1))) {
-      M = in_r << F_bits;
+    if (ac->in_r < (1 << (B_bits - F_bits - 1))) {
+      M = ac->in_r << F_bits;
       if (A >= M) {
         A -= M;
         target++;
@@ -473,7 +457,7 @@ freq_value arithmetic_decode_target(freq_value total) {
       A <<= 1;
       target <<= 1;
     } else {
-      M = in_r << (F_bits - 1);
+      M = ac->in_r << (F_bits - 1);
     }
 
     if (A >= M) {
@@ -519,17 +503,17 @@ freq_value arithmetic_decode_target(freq_value total) {
  * DECODE_RENORMALISE;			* Expand code range and input bits *
  *
  */
-void arithmetic_decode(freq_value low, freq_value high, freq_value total) {
+void arithmetic_decode(arith_coder* ac, freq_value low, freq_value high, freq_value total) {
   code_value temp;
 
 #ifdef MULT_DIV
   /* assume r has been set by decode_target */
-  temp = in_r * low;
-  in_D -= temp;
+  temp = ac->in_r * low;
+  ac->in_D -= temp;
   if (high < total)
-    in_R = in_r * (high - low);
+    ac->in_R = ac->in_r * (high - low);
   else
-    in_R -= temp;
+    ac->in_R -= temp;
 #else
   {
     code_value temp2, M;
@@ -541,7 +525,7 @@ void arithmetic_decode(freq_value low, freq_value high, freq_value total) {
 #ifdef VARY_NBITS
     {
       int i, nShifts;
-      M = in_r << F_bits;
+      M = ac->in_r << F_bits;
       nShifts = B_bits - F_bits - 1;
       for (i = nShifts;; i--) {
         if (M & Half) {
@@ -555,7 +539,7 @@ void arithmetic_decode(freq_value low, freq_value high, freq_value total) {
       }
     }
 #else
-    M = in_r << F_bits;
+    M = ac->in_r << F_bits;
 
     if (M & Half) {
       temp += low;
@@ -575,11 +559,11 @@ void arithmetic_decode(freq_value low, freq_value high, freq_value total) {
 
 #endif /* Varying/not varying nshifts */
 
-    in_D -= temp;
+    ac->in_D -= temp;
     if (high < total)
-      in_R = temp2 - temp;
+      ac->in_R = temp2 - temp;
     else
-      in_R -= temp;
+      ac->in_R -= temp;
   }
 #endif /* Shifts vs multiply */
 
@@ -615,7 +599,7 @@ void arithmetic_decode(freq_value low, freq_value high, freq_value total) {
  *					* in arithmetic_encode() )	*
  *
  */
-void binary_arithmetic_encode(freq_value c0, freq_value c1, int bit) {
+void binary_arithmetic_encode(arith_coder* ac, freq_value c0, freq_value c1, int bit) {
   int LPS;
   freq_value cLPS, rLPS;
 
@@ -630,14 +614,14 @@ void binary_arithmetic_encode(freq_value c0, freq_value c1, int bit) {
 #ifdef MULT_DIV
   {
     div_value out_r;
-    out_r = out_R / (c0 + c1);
+    out_r = ac->out_R / (c0 + c1);
     rLPS = out_r * cLPS;
   }
 #else
   {
     code_value numerator, denominator;
 
-    numerator = out_R;
+    numerator = ac->out_R;
     rLPS = 0;
 
 #ifdef VARY_NBITS
@@ -677,16 +661,16 @@ void binary_arithmetic_encode(freq_value c0, freq_value c1, int bit) {
 #endif /* Mult or shift */
 
   if (bit == LPS) {
-    out_L += out_R - rLPS;
-    out_R = rLPS;
+    ac->out_L += ac->out_R - rLPS;
+    ac->out_R = rLPS;
   } else {
-    out_R -= rLPS;
+    ac->out_R -= rLPS;
   }
 
   /* renormalise, as for arith_encode */
   ENCODE_RENORMALISE;
 
-  if (out_bits_outstanding > MAX_BITS_OUTSTANDING) {
+  if (ac->out_bits_outstanding > MAX_BITS_OUTSTANDING) {
     fprintf(stderr, "Bits_outstanding limit reached - File too large\n");
     exit(1);
   }
@@ -721,7 +705,7 @@ void binary_arithmetic_encode(freq_value c0, freq_value c1, int bit) {
  * return bit;
  *
  */
-int binary_arithmetic_decode(freq_value c0, freq_value c1) {
+int binary_arithmetic_decode(arith_coder* ac, freq_value c0, freq_value c1) {
   int LPS;
   int bit;
   freq_value cLPS, rLPS;
@@ -734,14 +718,14 @@ int binary_arithmetic_decode(freq_value c0, freq_value c1) {
     cLPS = c1;
   }
 #ifdef MULT_DIV
-  in_r = in_R / (c0 + c1);
-  rLPS = in_r * cLPS;
+  ac->in_r = ac->in_R / (c0 + c1);
+  rLPS = ac->in_r * cLPS;
 #else
   {
     code_value numerator, denominator;
 
-    numerator = in_R;
-    in_r = 0;
+    numerator = ac->in_R;
+    ac->in_r = 0;
     rLPS = 0;
 
 #ifdef VARY_NBITS
@@ -777,13 +761,13 @@ int binary_arithmetic_decode(freq_value c0, freq_value c1) {
 #endif
   }
 #endif /* MULT_DIV / non MULT_DIV */
-  if ((in_D) >= (in_R - rLPS)) {
+  if ((ac->in_D) >= (ac->in_R - rLPS)) {
     bit = LPS;
-    in_D -= (in_R - rLPS);
-    in_R = rLPS;
+    ac->in_D -= (ac->in_R - rLPS);
+    ac->in_R = rLPS;
   } else {
     bit = (1 - LPS);
-    in_R -= rLPS;
+    ac->in_R -= rLPS;
   }
 
   /* renormalise, as for arith_decode */
@@ -800,19 +784,12 @@ int binary_arithmetic_decode(freq_value c0, freq_value c1) {
  * With FRUGAL_BITS, ensure first bit (always 0) not actually output.
  *
  */
-void start_encode(void) {
-#if defined(VARY_NBITS)
-  /* Assume B_bits and F_bits have been selected (in main.c) */
-  /* Set up Half, Quarter for this coding run	*/
-  Half = ((code_value)1 << (B_bits - 1));
-  Quarter = ((code_value)1 << (B_bits - 2));
-#endif
-
-  out_L = 0;    /* Set initial coding range to	*/
-  out_R = Half; /* [0,Half)			*/
-  out_bits_outstanding = 0;
+void start_encode(arith_coder* ac) {
+  ac->out_L = 0;    /* Set initial coding range to	*/
+  ac->out_R = Half; /* [0,Half)			*/
+  ac->out_bits_outstanding = 0;
 #ifdef FRUGAL_BITS
-  _ignore_first_bit = 1; /* Don't ouput the leading 0	*/
+  ac->ignore_first_bit = 1; /* Don't ouput the leading 0	*/
 #endif
 }
 
@@ -830,14 +807,14 @@ void start_encode(void) {
  * Loop, increasing "nbits" until both the above values fall within [L,L+R),
  * then output these "nbits" of L
  */
-void finish_encode(void) {
+void finish_encode(arith_coder* ac) {
   int nbits, i;
   code_value roundup, bits, value;
   for (nbits = 1; nbits <= B_bits; nbits++) {
     roundup = (1 << (B_bits - nbits)) - 1;
-    bits = (out_L + roundup) >> (B_bits - nbits);
+    bits = (ac->out_L + roundup) >> (B_bits - nbits);
     value = bits << (B_bits - nbits);
-    if (out_L <= value && value + roundup <= (out_L + (out_R - 1))) break;
+    if (ac->out_L <= value && value + roundup <= (ac->out_L + (ac->out_R - 1))) break;
   }
   for (i = 1; i <= nbits; i++) /* output the nbits integer bits */
     BIT_PLUS_FOLLOW(((bits >> (nbits - i)) & 1));
@@ -851,12 +828,12 @@ void finish_encode(void) {
  * have been valid input.
  *
  */
-void finish_encode(void) {
+void finish_encode(arith_coder* ac) {
   int nbits, i;
   code_value bits;
 
   nbits = B_bits;
-  bits = out_L;
+  bits = ac->out_L;
   for (i = 1; i <= nbits; i++) /* output the nbits integer bits */
     BIT_PLUS_FOLLOW(((bits >> (nbits - i)) & 1));
 }
@@ -876,37 +853,30 @@ void finish_encode(void) {
  * retrieve_excess_input_bits() is used and the last bit must be placed back
  * into the input stream.
  */
-void start_decode(void) {
+void start_decode(arith_coder* ac) {
   int i;
-#if defined(VARY_NBITS)
-  /* B_bits will have been selected */
-  Half = ((code_value)1 << (B_bits - 1));
-  Quarter = ((code_value)1 << (B_bits - 2));
-#endif
-
-  in_D = 0;    /* Initial offset in range is 0 */
-  in_R = Half; /* Range = Half */
+  ac->in_D = 0;    /* Initial offset in range is 0 */
+  ac->in_R = Half; /* Range = Half */
 
 #ifdef FRUGAL_BITS
   {
-    static int firstmessage = 1;
-    if (firstmessage) {
-      for (i = 0; i < B_bits - 1; i++) ADD_NEXT_INPUT_BIT(in_D, B_bits);
+    if (ac->io.in_first_message) {
+      for (i = 0; i < B_bits - 1; i++) ADD_NEXT_INPUT_BIT(&(ac->io), ac->in_D, B_bits);
     } else {
-      in_D = retrieve_excess_input_bits();
-      unget_bit(in_D & 1);
-      in_D >>= 1;
+      ac->in_D = retrieve_excess_input_bits(ac);
+      unget_bit(&(ac->io), ac->in_D & 1);
+      ac->in_D >>= 1;
     }
 
-    firstmessage = 0;
-    in_V = in_D;
+    ac->io.in_first_message = 0;
+    ac->in_V = ac->in_D;
   }
 #else
   for (i = 0; i < B_bits; i++) /* Fill D */
-    ADD_NEXT_INPUT_BIT(in_D, 0);
+    ADD_NEXT_INPUT_BIT(&(ac->io), ac->in_D, 0);
 #endif
 
-  if (in_D >= Half) {
+  if (ac->in_D >= Half) {
     fprintf(stderr, "Corrupt input file (start_decode())\n");
     exit(1);
   }
@@ -923,7 +893,7 @@ void start_decode(void) {
  * retrieve_excess_input_bits() )
  *
  */
-void finish_decode(void) {
+void finish_decode(arith_coder* ac) {
   int nbits, i;
   code_value roundup, bits, value;
   code_value in_L;
@@ -931,17 +901,17 @@ void finish_decode(void) {
   /* This gets us either the real L, or L + Half.  Either way, we can work
    * out the number of bit emitted by the encoder
    */
-  in_L = (in_V & (Half - 1)) + Half - in_D;
+  in_L = (ac->in_V & (Half - 1)) + Half - ac->in_D;
 
   for (nbits = 1; nbits <= B_bits; nbits++) {
     roundup = (1 << (B_bits - nbits)) - 1;
     bits = (in_L + roundup) >> (B_bits - nbits);
     value = bits << (B_bits - nbits);
-    if (in_L <= value && value + roundup <= (in_L + (in_R - 1))) break;
+    if (in_L <= value && value + roundup <= (in_L + (ac->in_R - 1))) break;
   }
 
   for (i = 1; i <= nbits; i++) {
-    ADD_NEXT_INPUT_BIT(in_V, B_bits);
+    ADD_NEXT_INPUT_BIT(&(ac->io), ac->in_V, B_bits);
   }
 }
 
@@ -949,8 +919,8 @@ void finish_decode(void) {
  *   With FRUGAL_BITS defined, B_bits beyond valid coding output are read.
  *   It is these excess bits that are returned by calling this function.
  */
-code_value retrieve_excess_input_bits(void) {
-  return (in_V & (Half + (Half - 1)));
+code_value retrieve_excess_input_bits(arith_coder* ac) {
+  return (ac->in_V & (Half + (Half - 1)));
 }
 
 #else
@@ -962,5 +932,5 @@ code_value retrieve_excess_input_bits(void) {
  * (encoder wrote these for us to consume.)
  * (They were mangled anyway as we only kept V-L, and cannot get back to V)
  */
-void finish_decode(void) { /* No action */ }
+void finish_decode(arith_coder* ac) { (void) ac; /* No action */ }
 #endif
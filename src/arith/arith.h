@@ -28,6 +28,7 @@ part of each and every copy made of these files.
 #define CODER_H
 
 #include "../defines.h"
+#include "bitio.h"
 
 /* ================= USER ADJUSTABLE PARAMETERS =================== */
 
@@ -124,20 +125,44 @@ extern int F_bits;
 
 extern char *coder_desc;
 
+/*
+ * State of one arithmetic coder.  Input and output state is separate, so the
+ * same coder can be used for both encoding and decoding.  Independent coders
+ * don't share anything and can be used at the same time.
+ */
+typedef struct {
+  bit_io io; /* bitstream coder reads from / writes to */
+
+  /* Input decoding state */
+  code_value in_R; /* code range */
+  code_value in_D; /* = V-L (V offset)*/
+  div_value in_r;  /* normalized range */
+#ifdef FRUGAL_BITS
+  code_value in_V; /* Bitstream window */
+#endif
+
+  /* Output encoding state */
+  code_value out_L;                   /* lower bound */
+  code_value out_R;                   /* code range */
+  unsigned long out_bits_outstanding; /* follow bit count */
+#ifdef FRUGAL_BITS
+  int ignore_first_bit;
+#endif
+} arith_coder;
+
 /* function prototypes */
-void arithmetic_encode(freq_value l, freq_value h, freq_value t);
-freq_value arithmetic_decode_target(freq_value t);
-void arithmetic_decode(freq_value l, freq_value h, freq_value t);
-void binary_arithmetic_encode(freq_value c0, freq_value c1, int bit);
-int binary_arithmetic_decode(freq_value c0, freq_value c1);
-void start_encode(void);
-void finish_encode(void);
-void start_decode(void);
-void finish_decode(void);
+void arithmetic_encode(arith_coder* ac, freq_value l, freq_value h, freq_value t);
+freq_value arithmetic_decode_target(arith_coder* ac, freq_value t);
+void arithmetic_decode(arith_coder* ac, freq_value l, freq_value h, freq_value t);
+void binary_arithmetic_encode(arith_coder* ac, freq_value c0, freq_value c1, int bit);
+int binary_arithmetic_decode(arith_coder* ac, freq_value c0, freq_value c1);
+void start_encode(arith_coder* ac);
+void finish_encode(arith_coder* ac);
+void start_decode(arith_coder* ac);
+void finish_decode(arith_coder* ac);
 
 #ifdef FRUGAL_BITS
-extern int _ignore_first_bit;
-code_value retrieve_excess_input_bits(void);
+code_value retrieve_excess_input_bits(arith_coder* ac);
 #endif
 
 #endif  /* ifndef CODER_H */
@@ -44,36 +44,16 @@ part of each and every copy made of these files.
 static char rcsid[] = "$Id: bitio.c,v 1.1 1996/08/07 01:34:11 langs Exp $";
 #endif
 
-/*
- * The following variables are supposedly local, but actually global so they
- * can be referenced by macro
- */
-
-unsigned int _bytes_input = 0;
-unsigned int _bytes_output = 0;
-
-int _in_buffer;                /* I/O buffer */
-unsigned char _in_bit_ptr = 0; /* bits left in buffer */
-int _in_garbage;               /* bytes read beyond eof */
-
-int   _out_buffer;     /* I/O buffer */
-int   _out_bits_to_go; /* bits to fill buffer */
-FILE* _ofp;
-FILE* _ifp;
-
-#ifndef FAST_BITIO
-int _bitio_tmp; /* Used by some of the */
-#endif          /* bitio.h macros */
-
 /*
  *
  * initialize the bit output function
  *
  */
-void startoutputtingbits(FILE* ofp) {
-  _out_buffer = 0;
-  _out_bits_to_go = BYTE_SIZE;
-  _ofp = ofp;
+void startoutputtingbits(bit_io* io, FILE* ofp) {
+  io->bytes_output = 0;
+  io->out_buffer = 0;
+  io->out_bits_to_go = BYTE_SIZE;
+  io->ofp = ofp;
 }
 
 /*
@@ -81,10 +61,12 @@ void startoutputtingbits(FILE* ofp) {
  * start the bit input function
  *
  */
-void startinputtingbits(FILE* ifp) {
-  _in_garbage = 0; /* Number of bytes read past end of file */
-  _in_bit_ptr = 0; /* No valid bits yet in input buffer */
-  _ifp = ifp;
+void startinputtingbits(bit_io* io, FILE* ifp) {
+  io->bytes_input = 0;
+  io->in_garbage = 0; /* Number of bytes read past end of file */
+  io->in_bit_ptr = 0; /* No valid bits yet in input buffer */
+  io->in_first_message = 1;
+  io->ifp = ifp;
 }
 
 /*
@@ -92,10 +74,10 @@ void startinputtingbits(FILE* ifp) {
  * complete outputting bits
  *
  */
-void doneoutputtingbits(void) {
-  if (_out_bits_to_go != BYTE_SIZE)
-    OUTPUT_BYTE(_out_buffer << _out_bits_to_go);
-  _out_bits_to_go = BYTE_SIZE;
+void doneoutputtingbits(bit_io* io) {
+  if (io->out_bits_to_go != BYTE_SIZE)
+    OUTPUT_BYTE(io, io->out_buffer << io->out_bits_to_go);
+  io->out_bits_to_go = BYTE_SIZE;
 }
 
 /*
@@ -103,32 +85,32 @@ void doneoutputtingbits(void) {
  * complete inputting bits
  *
  */
-void doneinputtingbits(void) {
-  _in_bit_ptr = 0; /* "Wipe" buffer (in case more input follows) */
+void doneinputtingbits(bit_io* io) {
+  io->in_bit_ptr = 0; /* "Wipe" buffer (in case more input follows) */
 }
 
 /*
  * Number of bytes read with bitio functions.
  */
-int bitio_bytes_in(void) { return _bytes_input; }
+int bitio_bytes_in(bit_io* io) { return io->bytes_input; }
 
 /*
  * Number of bytes written with bitio functions.
  */
-int bitio_bytes_out(void) { return _bytes_output; }
+int bitio_bytes_out(bit_io* io) { return io->bytes_output; }
 
 /*
  * Return bit to input stream.
  * Only guaranteed to be able to backup by 1 bit.
  */
-void unget_bit(int bit) {
-  _in_bit_ptr <<= 1;
+void unget_bit(bit_io* io, int bit) {
+  io->in_bit_ptr <<= 1;
 
-  if (_in_bit_ptr == 0)
-    _in_bit_ptr = 1;
+  if (io->in_bit_ptr == 0)
+    io->in_bit_ptr = 1;
 
   /* Only keep bits still to to be read. */
-  _in_buffer = _in_buffer & (_in_bit_ptr - 1);
+  io->in_buffer = io->in_buffer & (io->in_bit_ptr - 1);
   if (bit)
-    _in_buffer |= _in_bit_ptr; /* Replace bit */
+    io->in_buffer |= io->in_bit_ptr; /* Replace bit */
 }
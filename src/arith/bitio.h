@@ -39,46 +39,53 @@ Copyright 1995 John Carpinelli and Wayne Salamonsen, All Rights Reserved.
 
 #define BYTE_SIZE 8
 
-/* As declared in bitio.c */
-extern unsigned int _bytes_input, _bytes_output;
+/*
+ * State of one bit input/output stream.  Each coder keeps its own, so that
+ * several streams can be processed at the same time (even from different
+ * threads).
+ */
+typedef struct {
+  unsigned int bytes_input, bytes_output;
 
-extern int   _in_buffer;          /* Input buffer	*/
-extern unsigned char _in_bit_ptr; /* Input bit pointer */
-extern int   _in_garbage;         /* # of bytes read past EOF */
+  int   in_buffer;          /* Input buffer	*/
+  unsigned char in_bit_ptr; /* Input bit pointer */
+  int   in_garbage;         /* # of bytes read past EOF */
+  int   in_first_message;   /* No coding message was read yet */
 
-extern int   _out_buffer;     /* Output buffer */
-extern int   _out_bits_to_go; /* Output bits in buffer */
-extern FILE* _ofp;
-extern FILE* _ifp;
+  int   out_buffer;     /* Output buffer */
+  int   out_bits_to_go; /* Output bits in buffer */
+  FILE* ofp;
+  FILE* ifp;
 
 #ifndef FAST_BITIO
-extern int _bitio_tmp; /* Used by i/o macros to    */
-#endif                 /* keep function ret values */
+  int bitio_tmp; /* Used by i/o macros to    */
+#endif           /* keep function ret values */
+} bit_io;
 
 /*
- * OUTPUT_BIT(b)
+ * OUTPUT_BIT(io, b)
  *
- * Outputs bit 'b' to stdout.  (Builds up a buffer, writing a byte
+ * Outputs bit 'b' to the output stream of 'io'.  (Builds up a buffer, writing a byte
  * at a time.)
  *
  */
 
-#define OUTPUT_BIT(b)              \
-  do {                             \
-    _out_buffer <<= 1;             \
-    if (b) _out_buffer |= 1;       \
-    _out_bits_to_go--;             \
-    if (_out_bits_to_go == 0) {    \
-      OUTPUT_BYTE(_out_buffer);    \
-      _out_bits_to_go = BYTE_SIZE; \
-      _out_buffer = 0;             \
-    }                              \
+#define OUTPUT_BIT(io, b)                \
+  do {                                   \
+    (io)->out_buffer <<= 1;              \
+    if (b) (io)->out_buffer |= 1;        \
+    (io)->out_bits_to_go--;              \
+    if ((io)->out_bits_to_go == 0) {     \
+      OUTPUT_BYTE(io, (io)->out_buffer); \
+      (io)->out_bits_to_go = BYTE_SIZE;  \
+      (io)->out_buffer = 0;              \
+    }                                    \
   } while (0)
 
 /* 
- * ADD_NEXT_INPUT_BIT(v, garbage_bits)
+ * ADD_NEXT_INPUT_BIT(io, v, garbage_bits)
  * 
- * Returns a bit from stdin, by shifting 'v' left one bit, and adding
+ * Returns a bit from the input stream of 'io', by shifting 'v' left one bit, and adding
  * next bit as lsb (possibly reading upto garbage_bits extra bits beyond
  * valid input)
  * 
@@ -94,26 +101,26 @@ extern int _bitio_tmp; /* Used by i/o macros to    */
  * next byte is read, and it is reset to point to the msb.
  * 
  */
-#define ADD_NEXT_INPUT_BIT(v, garbage_bits)          \
-  do {                                               \
-    if (_in_bit_ptr == 0) {                          \
-      _in_buffer = getc(_ifp);                       \
-      if (_in_buffer == EOF) {                       \
-        _in_garbage++;                               \
-        if ((_in_garbage - 1) * 8 >= garbage_bits) { \
-          fprintf(stderr,                            \
-                  "Bad input file - attempted "      \
-                  "read past end of file.\n");       \
-          exit(1);                                   \
-        }                                            \
-      } else {                                       \
-        _bytes_input++;                              \
-      }                                              \
-      _in_bit_ptr = (1 << (BYTE_SIZE - 1));          \
-    }                                                \
-    v = (v << 1);                                    \
-    if (_in_buffer & _in_bit_ptr) v++;               \
-    _in_bit_ptr >>= 1;                               \
+#define ADD_NEXT_INPUT_BIT(io, v, garbage_bits)           \
+  do {                                                    \
+    if ((io)->in_bit_ptr == 0) {                          \
+      (io)->in_buffer = getc((io)->ifp);                  \
+      if ((io)->in_buffer == EOF) {                       \
+        (io)->in_garbage++;                               \
+        if (((io)->in_garbage - 1) * 8 >= garbage_bits) { \
+          fprintf(stderr,                                 \
+                  "Bad input file - attempted "           \
+                  "read past end of file.\n");            \
+          exit(1);                                        \
+        }                                                 \
+      } else {                                            \
+        (io)->bytes_input++;                              \
+      }                                                   \
+      (io)->in_bit_ptr = (1 << (BYTE_SIZE - 1));          \
+    }                                                     \
+    v = (v << 1);                                         \
+    if ((io)->in_buffer & (io)->in_bit_ptr) v++;          \
+    (io)->in_bit_ptr >>= 1;                               \
   } while (0)
 
 /*#define FAST_BITIO*/
@@ -123,34 +130,36 @@ extern int _bitio_tmp; /* Used by i/o macros to    */
  * speed slightly.
  */
 #ifdef FAST_BITIO
-#define OUTPUT_BYTE(x) putc(x, _ofp)
-#define INPUT_BYTE() getc(_ifp)
-#define BITIO_FREAD(ptr, size, nitems) fread(ptr, size, nitems, stdin)
-#define BITIO_FWRITE(ptr, size, nitems) fwrite(ptr, size, nitems, stdout)
+#define OUTPUT_BYTE(io, x) putc(x, (io)->ofp)
+#define INPUT_BYTE(io) getc((io)->ifp)
+#define BITIO_FREAD(io, ptr, size, nitems) fread(ptr, size, nitems, (io)->ifp)
+#define BITIO_FWRITE(io, ptr, size, nitems) fwrite(ptr, size, nitems, (io)->ofp)
 #else
-#define OUTPUT_BYTE(x) (_bytes_output++, putc(x, _ofp))
-
-#define INPUT_BYTE()                                                     \
-  (_bitio_tmp = getc(_ifp), _bytes_input += (_bitio_tmp == EOF) ? 0 : 1, \
-   _bitio_tmp)
-
-#define BITIO_FREAD(ptr, size, nitems)           \
-  (_bitio_tmp = fread(ptr, size, nitems, stdin), \
-   _bytes_input += _bitio_tmp * size, _bitio_tmp) /* Return result of fread */
-
-#define BITIO_FWRITE(ptr, size, nitems)            \
-  (_bitio_tmp = fwrite(ptr, size, nitems, stdout), \
-   _bytes_output += _bitio_tmp * size,             \
-   _bitio_tmp) /* Return result of fwrite */
+#define OUTPUT_BYTE(io, x) ((io)->bytes_output++, putc(x, (io)->ofp))
+
+#define INPUT_BYTE(io)                                           \
+  ((io)->bitio_tmp = getc((io)->ifp),                            \
+   (io)->bytes_input += ((io)->bitio_tmp == EOF) ? 0 : 1,        \
+   (io)->bitio_tmp)
+
+#define BITIO_FREAD(io, ptr, size, nitems)                       \
+  ((io)->bitio_tmp = fread(ptr, size, nitems, (io)->ifp),        \
+   (io)->bytes_input += (io)->bitio_tmp * size,                  \
+   (io)->bitio_tmp) /* Return result of fread */
+
+#define BITIO_FWRITE(io, ptr, size, nitems)                      \
+  ((io)->bitio_tmp = fwrite(ptr, size, nitems, (io)->ofp),       \
+   (io)->bytes_output += (io)->bitio_tmp * size,                 \
+   (io)->bitio_tmp) /* Return result of fwrite */
 #endif
 
-void startoutputtingbits(FILE* ofp);
-void startinputtingbits(FILE* ifp);
-void doneoutputtingbits(void);
-void doneinputtingbits(void);
-int bitio_bytes_in(void);
-int bitio_bytes_out(void);
+void startoutputtingbits(bit_io* io, FILE* ofp);
+void startinputtingbits(bit_io* io, FILE* ifp);
+void doneoutputtingbits(bit_io* io);
+void doneinputtingbits(bit_io* io);
+int bitio_bytes_in(bit_io* io);
+int bitio_bytes_out(bit_io* io);
 
-void unget_bit(int bit);
+void unget_bit(bit_io* io, int bit);
 
 #endif  /* ifndef BITIO_H */
@@ -1,50 +1,248 @@
+#include <inttypes.h>
+
 #include "cache.h"
+#include "structure.h"
 
 #ifdef ENABLE_LOOKUP_CACHE
 
 #ifdef ENABLE_CACHE_STATS
-void cache_stats_prep() {
-  cache_hits = 0;
-  cache_misses = 0;
+static const char* cache_operation_names[CACHE_OPERATIONS] = {
+  "Get", "Change_symbol", "Increase_frequency", "Symbol_frequency", "Find_Edge", "csl"
+};
+
+void cache_stats_prep(CacheRef cache__) {
+  memset(cache__->hits_, 0, sizeof(cache__->hits_));
+  memset(cache__->misses_, 0, sizeof(cache__->misses_));
+  memset(cache__->distance_, 0, sizeof(cache__->distance_));
 }
 
-void cache_stats_print() {
-  printf("Cache stats (%lf):\n", ((double) cache_hits / (cache_hits + cache_misses)));
-  printf("    hit rate: %ld\n", cache_hits);
-  printf("    miss rate: %ld\n", cache_misses);
+void cache_stats_print(CacheRef cache__) {
+  int32_t i;
+  int64_t hits = 0, misses = 0, total = 0;
+
+  for (i = 0; i < CACHE_OPERATIONS; i++) {
+    hits += cache__->hits_[i];
+    misses += cache__->misses_[i];
+  }
+
+  fprintf(stderr, "Cache stats (%lf):\n", ((double) hits / (hits + misses)));
+  fprintf(stderr, "    hit rate: %" PRId64 "\n", hits);
+  fprintf(stderr, "    miss rate: %" PRId64 "\n", misses);
+
+  for (i = 0; i < CACHE_OPERATIONS; i++) {
+    if (cache__->hits_[i] + cache__->misses_[i])
+      fprintf(stderr, "    cache %s: %" PRId64 " hits, %" PRId64 " misses\n", cache_operation_names[i],
+              cache__->hits_[i], cache__->misses_[i]);
+  }
+
+  /* number of tree levels descended from the finger */
+  for (i = 0; i < MAX_STACK_SIZE; i++)
+    total += i * cache__->distance_[i];
+  fprintf(stderr, "    cache search distance (%lf):\n", ((double) total / (hits + misses)));
+  for (i = 0; i < MAX_STACK_SIZE; i++) {
+    if (cache__->distance_[i])
+      fprintf(stderr, "        cache %2d levels: %" PRId64 "\n", i, cache__->distance_[i]);
+  }
 }
 #endif
 
-void reset_cache() {
-  cache_next = 0;
-  memset(cache, -1, CACHE_SIZE * sizeof(cache_line));
+void reset_cache(CacheRef cache__) {
+  int32_t i;
+
+  cache__->next_ = 0;
+  for (i = 0; i < CACHE_SIZE; i++)
+    cache__->fingers_[i].depth_ = 0;
 }
 
-void add_to_cache(uint32_t idx__, uint32_t inside_idx__, LeafRef leaf_ref__) {
-  cache[cache_next].idx_ = idx__;
-  cache[cache_next].inside_idx_ = inside_idx__;
-  cache[cache_next].leaf_ref_ = leaf_ref__;
+/*
+ * Get level of the lowest finger node containing given position.
+ *
+ * @param  finger__  Reference to the finger.
+ * @param  pos__  Query position.
+ *
+ * @return  Level of the node or -1 if there is no such node.
+ */
+static int32_t finger_find_level_(cache_finger* finger__, LinePos pos__) {
+  int32_t level = finger__->depth_ - 1;
 
-  cache_next = (cache_next + 1) % CACHE_SIZE;
+  while (level >= 0 && (pos__ < finger__->path_[level].start_ ||
+                        pos__ >= finger__->path_[level].start_ + finger__->path_[level].size_))
+    level--;
+  return level;
 }
 
-bool lookup_cache(uint32_t* idx__, LeafRef* leaf_ref) {
-  int32_t i;
+void finger_search(CacheRef cache__, StackRef stack__, MemObj mem__, MemPtr root__,
+                   LinePos* pos__, MemPtr* current__, bool with_stack__, cache_operation op__) {
+  int32_t i, level, best_level;
+  LinePos local;
+  cache_finger* finger = NULL;
+  finger_level* entry;
+  MemPtr current;
+  NodeRef node_ref;
+
+  UNUSED(mem__);
 
+  /* pick finger with the lowest node containing the position */
+  best_level = -1;
   for (i = 0; i < CACHE_SIZE; i++) {
-    if (cache[i].idx_ == *idx__) {
-      *idx__ = cache[i].inside_idx_;
-      *leaf_ref = cache[i].leaf_ref_;
-#ifdef ENABLE_CACHE_STATS
-      cache_hits++;
+    level = finger_find_level_(&(cache__->fingers_[i]), *pos__);
+    if (level > best_level) {
+      best_level = level;
+      finger = &(cache__->fingers_[i]);
+    }
+  }
+
+  /* no finger is usable, start a new one from the root */
+  if (best_level == -1) {
+    finger = &(cache__->fingers_[cache__->next_]);
+    cache__->next_ = (cache__->next_ + 1) % CACHE_SIZE;
+
+    finger->path_[0].node_ = root__;
+    finger->path_[0].start_ = 0;
+    finger->path_[0].size_ = MEMORY_GET_ANY(mem__, root__)->p_;
+    best_level = 0;
+  }
+  assert(*pos__ < finger->path_[best_level].size_ + finger->path_[best_level].start_);
+
+  /* the upper part of the path is the same */
+  if (with_stack__) {
+    STACK_CLEAN(stack__);
+    for (i = 0; i < best_level; i++) {
+      STACK_PUSH(stack__, finger->path_[i].node_);
+#if defined(ENABLE_BTREE_NODES)
+      STACK_SET_INDEX(stack__, finger->path_[i].index_);
 #endif
-      return true;
     }
   }
+
+  /* descend from the common node and remember the new path */
+  level = best_level;
+  entry = &(finger->path_[level]);
+  current = entry->node_;
+  local = *pos__ - entry->start_;
+
+  while (!IS_LEAF(current)) {
+    if (level + 1 >= MAX_STACK_SIZE)
+      FATAL("Finger path overflow");
+
+    node_ref = MEMORY_GET_NODE(mem__, current);
+    if (with_stack__) STACK_PUSH(stack__, current);
+
+#if defined(ENABLE_BTREE_NODES)
+    uint32_t idx;
+    BTREE_CHILD_BY_POS(node_ref, local, idx);
+    if (with_stack__) STACK_SET_INDEX(stack__, idx);
+
+    entry->index_ = idx;
+    entry[1].node_ = node_ref->children_[idx];
+    entry[1].start_ = entry->start_ + BTREE_PREFIX_P(node_ref, idx);
+    entry[1].size_ = node_ref->pre_p_[idx] - BTREE_PREFIX_P(node_ref, idx);
+#else
+    LinePos left_p = MEMORY_GET_ANY(mem__, node_ref->left_)->p_;
+    if (left_p > local) {
+      entry[1].node_ = node_ref->left_;
+      entry[1].start_ = entry->start_;
+      entry[1].size_ = left_p;
+    } else {
+      local -= left_p;
+      entry[1].node_ = node_ref->right_;
+      entry[1].start_ = entry->start_ + left_p;
+      entry[1].size_ = entry->size_ - left_p;
+    }
+#endif
+    current = entry[1].node_;
+    entry++;
+    level++;
+  }
+  finger->depth_ = level + 1;
+
 #ifdef ENABLE_CACHE_STATS
-  cache_misses++;
+  if (level == best_level)
+    cache__->hits_[op__]++;
+  else
+    cache__->misses_[op__]++;
+  cache__->distance_[level - best_level]++;
+#else
+  UNUSED(op__);
 #endif
-  return false;
+
+  *pos__ = local;
+  *current__ = current;
+}
+
+void finger_line_inserted(CacheRef cache__, StackRef stack__, LinePos pos__, MemPtr leaf__) {
+  int32_t i, level;
+  MemPtr path_node;
+  cache_finger* finger;
+
+  for (i = 0; i < CACHE_SIZE; i++) {
+    finger = &(cache__->fingers_[i]);
+
+    /* nodes shared with the insertion path got one more line */
+    for (level = 0; level < finger->depth_; level++) {
+      path_node = (level < STACK_DEPTH(stack__)) ? stack__->stack_[level] : leaf__;
+      if (level > STACK_DEPTH(stack__) || finger->path_[level].node_ != path_node)
+        break;
+      finger->path_[level].size_++;
+    }
+
+    /* subtrees behind the inserted line were moved by one */
+    for (; level < finger->depth_; level++) {
+      if (finger->path_[level].start_ >= pos__)
+        finger->path_[level].start_++;
+    }
+  }
+}
+
+void finger_line_deleted(CacheRef cache__, StackRef stack__, LinePos pos__, MemPtr leaf__) {
+  int32_t i, level;
+  MemPtr path_node;
+  cache_finger* finger;
+
+  for (i = 0; i < CACHE_SIZE; i++) {
+    finger = &(cache__->fingers_[i]);
+
+    /* nodes shared with the deletion path lost one line */
+    for (level = 0; level < finger->depth_; level++) {
+      path_node = (level < STACK_DEPTH(stack__)) ? stack__->stack_[level] : leaf__;
+      if (level > STACK_DEPTH(stack__) || finger->path_[level].node_ != path_node)
+        break;
+      finger->path_[level].size_--;
+    }
+
+    /* subtrees behind the deleted line were moved by one */
+    for (; level < finger->depth_; level++) {
+      if (finger->path_[level].start_ > pos__)
+        finger->path_[level].start_--;
+    }
+  }
+}
+
+void finger_node_changed(CacheRef cache__, int32_t level__, MemPtr node__) {
+  int32_t i;
+  cache_finger* finger;
+
+  for (i = 0; i < CACHE_SIZE; i++) {
+    finger = &(cache__->fingers_[i]);
+    if (finger->depth_ > level__ && finger->path_[level__].node_ == node__)
+      finger->depth_ = level__;
+  }
+}
+
+#if defined(ENABLE_BTREE_NODES)
+
+void finger_child_inserted(CacheRef cache__, int32_t level__, MemPtr node__, int32_t idx__) {
+  int32_t i;
+  cache_finger* finger;
+
+  for (i = 0; i < CACHE_SIZE; i++) {
+    finger = &(cache__->fingers_[i]);
+    if (finger->depth_ > level__ + 1 && finger->path_[level__].node_ == node__ &&
+        finger->path_[level__].index_ > idx__)
+      finger->path_[level__].index_++;
+  }
 }
 
+#endif
+
 #endif  /* ENABLE_LOOKUP_CACHE */
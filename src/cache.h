@@ -3,37 +3,133 @@
 
 #include "memory.h"
 #include "defines.h"
-#include "structure.h"
+#include "stack.h"
 
 #ifdef ENABLE_LOOKUP_CACHE
 
+/*
+ * Finger cache.
+ *
+ * Each finger remembers the last root to leaf path it was used for together
+ * with the range of lines covered by every node on it. A query for nearby
+ * position goes up the path only to the lowest node containing the position
+ * and descends from there, so that repeated and local queries skip most of
+ * the tree traversal.
+ */
 typedef struct {
-  uint32_t idx_;
-  uint32_t inside_idx_;
-  LeafRef leaf_ref_;
-} cache_line;
+  MemPtr node_;
+  LinePos start_; /* position of the first line in this subtree */
+  LinePos size_;  /* number of lines in this subtree */
+#if defined(ENABLE_BTREE_NODES)
+  int32_t index_;  /* index of child the path continues to */
+#endif
+} finger_level;
+
+typedef struct {
+  finger_level path_[MAX_STACK_SIZE];
+  int32_t depth_; /* number of valid levels (0 for empty finger) */
+} cache_finger;
 
+/* Operations using the cache (for statistics) */
+typedef enum {
+  CACHE_GET,
+  CACHE_CHANGE_SYMBOL,
+  CACHE_INCREASE_FREQUENCY,
+  CACHE_SYMBOL_FREQUENCY,
+  CACHE_FIND_EDGE,
+  CACHE_CSL,
+  CACHE_OPERATIONS
+} cache_operation;
+
+/* Lookup cache of one graph */
+typedef struct {
+  cache_finger fingers_[CACHE_SIZE];
+  int32_t next_; /* finger replaced when no other is usable */
 #ifdef ENABLE_CACHE_STATS
-int64_t cache_hits;
-int64_t cache_misses;
+  int64_t hits_[CACHE_OPERATIONS];
+  int64_t misses_[CACHE_OPERATIONS];
+  int64_t distance_[MAX_STACK_SIZE];
+#endif
+} lookup_cache;
 
-void cache_stats_prep();
-void cache_stats_print();
+#define CacheRef lookup_cache*
+
+#ifdef ENABLE_CACHE_STATS
+void cache_stats_prep(CacheRef cache__);
+void cache_stats_print(CacheRef cache__);
 #endif
 
-cache_line cache[CACHE_SIZE];
-int32_t cache_next;
+/*
+ * Drop all fingers (after the tree was rebuilt).
+ *
+ * @param  cache__  Reference to the cache.
+ */
+void reset_cache(CacheRef cache__);
+
+/*
+ * Find leaf containing given position using the closest finger.
+ *
+ * @param  cache__  Reference to the cache.
+ * @param  stack__  Stack of the graph.
+ * @param  mem__  Memory object of the graph.
+ * @param  root__  Root of the graph.
+ * @param  pos__  [In/Out] Query position -> position within the leaf.
+ * @param  current__  [Out] MemPtr set to correct leaf.
+ * @param  with_stack__  If stack should be filled with the whole path.
+ * @param  op__  Operation the search is done for [enum: cache_operation].
+ */
+void finger_search(CacheRef cache__, StackRef stack__, MemObj mem__, MemPtr root__,
+                   LinePos* pos__, MemPtr* current__, bool with_stack__, cache_operation op__);
 
-void reset_cache();
+/*
+ * Patch all fingers after a line was inserted. Path to the leaf the line was
+ * inserted into is expected to be in the stack.
+ *
+ * Any change of the tree shape caused by the insertion must be reported
+ * separately by the functions below.
+ *
+ * @param  cache__  Reference to the cache.
+ * @param  stack__  Stack of the graph.
+ * @param  pos__  Position of inserted line.
+ * @param  leaf__  Leaf the line was inserted into.
+ */
+void finger_line_inserted(CacheRef cache__, StackRef stack__, LinePos pos__, MemPtr leaf__);
 
-void add_to_cache(uint32_t idx__, uint32_t inside_idx__, LeafRef leaf_ref__);
+/*
+ * Patch all fingers after a line was deleted. Path to the leaf the line was
+ * deleted from is expected to be in the stack.
+ *
+ * @param  cache__  Reference to the cache.
+ * @param  stack__  Stack of the graph.
+ * @param  pos__  Position of deleted line.
+ * @param  leaf__  Leaf the line was deleted from.
+ */
+void finger_line_deleted(CacheRef cache__, StackRef stack__, LinePos pos__, MemPtr leaf__);
 
-bool lookup_cache(uint32_t* idx__, LeafRef* leaf_ref);
+/*
+ * Drop given node and everything below it from all fingers going through it.
+ * This must be called for each node which is split or rotated.
+ *
+ * @param  cache__  Reference to the cache.
+ * @param  level__  Level of the node (root is on level 0).
+ * @param  node__  Changed node.
+ */
+void finger_node_changed(CacheRef cache__, int32_t level__, MemPtr node__);
 
-#else
+#if defined(ENABLE_BTREE_NODES)
 
-#define add_to_cache(idx__, inside_idx__, leaf_ref__) (UNUSED(idx__))
-#define lookup_cache(idx__, leaf_ref) (false)
+/*
+ * Move child indexes of all fingers going through given B+ tree node after
+ * a new child was inserted into it.
+ *
+ * @param  cache__  Reference to the cache.
+ * @param  level__  Level of the node (root is on level 0).
+ * @param  node__  Node new child was inserted into.
+ * @param  idx__  Index of the child new one was inserted after.
+ */
+void finger_child_inserted(CacheRef cache__, int32_t level__, MemPtr node__, int32_t idx__);
+
+#endif
 
 #endif  /* ENABLE_LOOKUP_CACHE */
 
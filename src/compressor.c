@@ -1,28 +1,61 @@
 #include "compressor.h"
 
-void Process_Init(CompressorRef C__) {
-  deBruijn_Init(&(C__->dB_));
+void Process_Init(CompressorRef C__, LinePos symbols__) {
+  deBruijn_Init(&(C__->dB_), symbols__);
   C__->state_ = 4;
+  C__->budget_ = 0;
+  C__->restarts_ = 0;
+}
 
-#if defined(ENABLE_CACHE_STATS)
-  cache_stats_prep();
-#endif
+void Process_Set_budget(CompressorRef C__, size_t budget__) {
+  C__->budget_ = budget__;
 }
 
-void Process_Free(CompressorRef C__) {
+/*
+ * Restart the model if it outgrew the memory budget.
+ *
+ * This is called at the same position of the input by both compressor and
+ * decompressor, and so they restart together. Size of the model is estimated
+ * from the number of lines only, so that the restarts don't depend on the
+ * node and leaf layout of the build.
+ *
+ * @param  C__  Reference to compressor object.
+ */
+static void process_check_budget_(CompressorRef C__) {
+  size_t used;
+
+  if (!C__->budget_)
+    return;
+
+  used = (size_t) Graph_Size(&(C__->dB_.Graph_)) * BUDGET_LINE_BYTES;
+  if (used <= C__->budget_)
+    return;
+
+  COMPRESSOR_VERBOSE(
+    printf("[compressor] Model uses about %zu bytes out of %zu, restarting it\n", used, C__->budget_);
+  )
+
   deBruijn_Free(&(C__->dB_));
+  deBruijn_Init(&(C__->dB_), 0);
+  C__->state_ = 4;
+  C__->restarts_++;
+}
 
+void Process_Free(CompressorRef C__) {
 #if defined(ENABLE_CACHE_STATS)
-  cache_stats_print();
+  /* statistics are kept by the graph (since the last model restart) */
+  cache_stats_print(C__->dB_.Graph_.cache_);
 #endif
+
+  deBruijn_Free(&(C__->dB_));
 }
 
-void Compressor_encode_(cfreq* freq__, Graph_value gval__) {
+void Compressor_encode_(CompressorRef C__, cfreq* freq__, Graph_value gval__) {
   int32_t lower, upper;
   Graph_value i;
 
   if (freq__->total_ == 0) {
-    arithmetic_encode(0, 1, 1);
+    arithmetic_encode(&(C__->coder_), 0, 1, 1);
     return;
   }
 
@@ -30,42 +63,50 @@ void Compressor_encode_(cfreq* freq__, Graph_value gval__) {
     lower += freq__->symbol_[i];
   upper = lower + freq__->symbol_[i];
 
-  arithmetic_encode(lower, upper, freq__->total_);
+  arithmetic_encode(&(C__->coder_), lower, upper, freq__->total_);
 }
 
-Graph_value Decompressor_decode_(cfreq* freq__) {
+Graph_value Decompressor_decode_(CompressorRef C__, cfreq* freq__) {
   int32_t target, lower, upper;
   Graph_value i;
 
   if (freq__->total_ == 0) {
-    target = arithmetic_decode_target(1);
-    arithmetic_decode(0, 1, 1);
+    target = arithmetic_decode_target(&(C__->coder_), 1);
+    arithmetic_decode(&(C__->coder_), 0, 1, 1);
     return VALUE_ESC;
   }
-  target = arithmetic_decode_target(freq__->total_);
+  target = arithmetic_decode_target(&(C__->coder_), freq__->total_);
 
   for (upper = 0, i = VALUE_A; i <= (VALUE_ESC >> 0x1); i++) {
     lower = upper;
     upper += freq__->symbol_[i];
 
     if (lower <= target && target < upper) {
-      arithmetic_decode(lower, upper, freq__->total_);
+      arithmetic_decode(&(C__->coder_), lower, upper, freq__->total_);
       return (i << 0x1);
     }
   }
   UNREACHABLE;
 }
 
-int32_t finish_symbol_insertion_(CompressorRef C__, int32_t idx__, Graph_value gval__) {
-  int32_t i, rank, temp, len, x;
+LineIdx finish_symbol_insertion_(CompressorRef C__, LineIdx idx__, Graph_value gval__) {
+  int32_t i, len;
+  LineIdx rank, temp, x;
+  LinePos ranks[VALUE_$];
   Graph_Line line;
 
   bool exists_above = false;
   bool exists_bellow = false;
   Graph_value gval = gval__;
 
+  assert(gval__ < VALUE_$);
+
+  /* get W ranks and content of this line (nothing changes until insertion) */
+  Graph_Rank_W_all(&(C__->dB_.Graph_), idx__, ranks);
+  GLine_Get(&(C__->dB_.Graph_), (LinePos) idx__, &line);
+
   /* check if target node already exists above this line */
-  rank = Graph_Rank(&(C__->dB_.Graph_), idx__, VECTOR_W, gval__);
+  rank = ranks[gval__];
   if (rank) {
     temp = Graph_Select(&(C__->dB_.Graph_), rank, VECTOR_W, gval__) - 1;
     len = deBruijn_Get_common_suffix_len_(&(C__->dB_), idx__, temp);
@@ -77,7 +118,7 @@ int32_t finish_symbol_insertion_(CompressorRef C__, int32_t idx__, Graph_value g
 
   if (!exists_above) {
     /* check if target node already exists below this line */
-    rank = Graph_Rank(&(C__->dB_.Graph_), idx__ + 1, VECTOR_W, gval__);
+    rank += (line.W_ == gval__) ? 1 : 0;
     temp = Graph_Select(&(C__->dB_.Graph_), rank + 1, VECTOR_W, gval__) - 1;
 
     if (temp > 0) {
@@ -89,7 +130,6 @@ int32_t finish_symbol_insertion_(CompressorRef C__, int32_t idx__, Graph_value g
   }
 
   /* check what symbol is in W */
-  GLine_Get(&(C__->dB_.Graph_), (uint32_t) idx__, &line);
   if (line.W_ == VALUE_$) {
     /* change symbol to new one and increase frequency to 1 */
     /* These is no need to upgrade the csl as we are not changing suffix */
@@ -154,18 +194,21 @@ int32_t finish_symbol_insertion_(CompressorRef C__, int32_t idx__, Graph_value g
   return x;
 }
 
-void Compressor_Compress_symbol_aux_(CompressorRef C__, Graph_value gval__, int32_t lo__, int32_t up__, int32_t ctx_len__) {
-  int32_t rank1, rank2, i, temp, count;
+void Compressor_Compress_symbol_aux_(CompressorRef C__, Graph_value gval__, LineIdx lo__, LineIdx up__, int32_t ctx_len__) {
+  LineIdx rank1, rank2, i, temp, count;
+  LinePos ranks1[VALUE_$], ranks2[VALUE_$];
   cfreq freq;
 
   /* check if given transition exists in this range */
-  rank1 = Graph_Rank(&(C__->dB_.Graph_), lo__, VECTOR_W, ((gval__ >> 0x1) | 0x10));
-  rank2 = Graph_Rank(&(C__->dB_.Graph_), up__ + 1, VECTOR_W, ((gval__ >> 0x1) | 0x10));
+  Graph_Rank_W_all(&(C__->dB_.Graph_), lo__, ranks1);
+  Graph_Rank_W_all(&(C__->dB_.Graph_), up__ + 1, ranks2);
+  rank1 = ranks1[gval__ & 0xE] + ranks1[gval__ | 0x1];
+  rank2 = ranks2[gval__ & 0xE] + ranks2[gval__ | 0x1];
   count = (rank2 - rank1);
   if (count) {
 
     deBruijn_Get_symbol_frequency_range(&(C__->dB_), lo__, up__, &freq);
-    Compressor_encode_(&freq, gval__);
+    Compressor_encode_(C__, &freq, gval__);
 
     for (i = rank1 + 1; i <= rank2; i++) {
       temp = Graph_Select(&(C__->dB_.Graph_), i, VECTOR_W, ((gval__ >> 0x1) | 0x10)) - 1;
@@ -183,23 +226,24 @@ void Compressor_Compress_symbol_aux_(CompressorRef C__, Graph_value gval__, int3
   } else {
 
     deBruijn_Get_symbol_frequency_range(&(C__->dB_), lo__, up__, &freq);
-    Compressor_encode_(&freq, VALUE_ESC);
+    Compressor_encode_(C__, &freq, VALUE_ESC);
 
     /* find range of shorter context */
-    int lo = deBruijn_shorten_lower(&(C__->dB_), C__->state_, ctx_len__ - 1);
-    int up = deBruijn_shorten_upper(&(C__->dB_), C__->state_, ctx_len__ - 1);
+    LineIdx lo = deBruijn_shorten_lower(&(C__->dB_), C__->state_, ctx_len__ - 1);
+    LineIdx up = deBruijn_shorten_upper(&(C__->dB_), C__->state_, ctx_len__ - 1);
 
     Compressor_Compress_symbol_aux_(C__, gval__, lo, up, ctx_len__ - 1);
   }
 }
 
-void Decompressor_Decompress_symbol_aux_(CompressorRef C__, Graph_value* gval__, int32_t lo__, int32_t up__, int32_t ctx_len__) {
-  int32_t rank1, rank2, i, temp, count;
+void Decompressor_Decompress_symbol_aux_(CompressorRef C__, Graph_value* gval__, LineIdx lo__, LineIdx up__, int32_t ctx_len__) {
+  LineIdx rank1, rank2, i, temp, count;
+  LinePos ranks1[VALUE_$], ranks2[VALUE_$];
   cfreq freq;
 
   /* get decompressed symbol */
   deBruijn_Get_symbol_frequency_range(&(C__->dB_), lo__, up__, &freq);
-  Graph_value symbol = Decompressor_decode_(&freq);
+  Graph_value symbol = Decompressor_decode_(C__, &freq);
 
   if (symbol == VALUE_ESC) {
     COMPRESSOR_VERBOSE(
@@ -207,8 +251,8 @@ void Decompressor_Decompress_symbol_aux_(CompressorRef C__, Graph_value* gval__,
     )
 
     /* find range of shorter context */
-    int lo = deBruijn_shorten_lower(&(C__->dB_), C__->state_, ctx_len__ - 1);
-    int up = deBruijn_shorten_upper(&(C__->dB_), C__->state_, ctx_len__ - 1);
+    LineIdx lo = deBruijn_shorten_lower(&(C__->dB_), C__->state_, ctx_len__ - 1);
+    LineIdx up = deBruijn_shorten_upper(&(C__->dB_), C__->state_, ctx_len__ - 1);
 
     Decompressor_Decompress_symbol_aux_(C__, gval__, lo, up, ctx_len__ - 1);
 
@@ -218,8 +262,10 @@ void Decompressor_Decompress_symbol_aux_(CompressorRef C__, Graph_value* gval__,
     )
 
     /* check if given transition exists in this range */
-    rank1 = Graph_Rank(&(C__->dB_.Graph_), lo__, VECTOR_W, ((symbol >> 0x1) | 0x10));
-    rank2 = Graph_Rank(&(C__->dB_.Graph_), up__ + 1, VECTOR_W, ((symbol >> 0x1) | 0x10));
+    Graph_Rank_W_all(&(C__->dB_.Graph_), lo__, ranks1);
+    Graph_Rank_W_all(&(C__->dB_.Graph_), up__ + 1, ranks2);
+    rank1 = ranks1[symbol & 0xE] + ranks1[symbol | 0x1];
+    rank2 = ranks2[symbol & 0xE] + ranks2[symbol | 0x1];
 
     count = (rank2 - rank1);
     if (count) {
@@ -245,7 +291,7 @@ void Decompressor_Decompress_symbol_aux_(CompressorRef C__, Graph_value* gval__,
 }
 
 void Compressor_Compress_symbol(CompressorRef C__, Graph_value gval__) {
-  int32_t transition;
+  LineIdx transition;
   cfreq freq;
 
   transition = deBruijn_Find_Edge(&(C__->dB_), C__->state_, gval__ & 0xE);
@@ -256,16 +302,17 @@ void Compressor_Compress_symbol(CompressorRef C__, Graph_value gval__) {
     )
     /* output escape character */
     deBruijn_Get_symbol_frequency(&(C__->dB_), C__->state_, &freq);
-    Compressor_encode_(&freq, VALUE_ESC);
+    Compressor_encode_(C__, &freq, VALUE_ESC);
 
     /* find range of shorter context */
-    int lo = deBruijn_shorten_lower(&(C__->dB_), C__->state_, CONTEXT_LENGTH - 1);
-    int up = deBruijn_shorten_upper(&(C__->dB_), C__->state_, CONTEXT_LENGTH - 1);
+    LineIdx lo = deBruijn_shorten_lower(&(C__->dB_), C__->state_, CONTEXT_LENGTH - 1);
+    LineIdx up = deBruijn_shorten_upper(&(C__->dB_), C__->state_, CONTEXT_LENGTH - 1);
 
     Compressor_Compress_symbol_aux_(C__, gval__, lo, up, CONTEXT_LENGTH - 1);
 
     /* insert new node into the graph */
     C__->state_ = finish_symbol_insertion_(C__, C__->state_, gval__);
+    process_check_budget_(C__);
 
   } else {
     /* we have a transition in this node */
@@ -275,7 +322,7 @@ void Compressor_Compress_symbol(CompressorRef C__, Graph_value gval__) {
 
     /* output given character */
     deBruijn_Get_symbol_frequency(&(C__->dB_), C__->state_, &freq);
-    Compressor_encode_(&freq, gval__);
+    Compressor_encode_(C__, &freq, gval__);
 
     Graph_Increase_frequency(&(C__->dB_.Graph_), transition, 1);
     C__->state_ = deBruijn_Forward_(&(C__->dB_), transition);
@@ -283,12 +330,12 @@ void Compressor_Compress_symbol(CompressorRef C__, Graph_value gval__) {
 }
 
 void Decompressor_Decompress_symbol(CompressorRef C__, Graph_value* gval__) {
-  int32_t transition;
+  LineIdx transition;
   cfreq freq;
 
   /* get decompressed symbol */
   deBruijn_Get_symbol_frequency(&(C__->dB_), C__->state_, &freq);
-  Graph_value symbol = Decompressor_decode_(&freq);
+  Graph_value symbol = Decompressor_decode_(C__, &freq);
 
   if (symbol == VALUE_ESC) {
     COMPRESSOR_VERBOSE(
@@ -296,13 +343,14 @@ void Decompressor_Decompress_symbol(CompressorRef C__, Graph_value* gval__) {
     )
 
     /* find range of shorter context */
-    int lo = deBruijn_shorten_lower(&(C__->dB_), C__->state_, CONTEXT_LENGTH - 1);
-    int up = deBruijn_shorten_upper(&(C__->dB_), C__->state_, CONTEXT_LENGTH - 1);
+    LineIdx lo = deBruijn_shorten_lower(&(C__->dB_), C__->state_, CONTEXT_LENGTH - 1);
+    LineIdx up = deBruijn_shorten_upper(&(C__->dB_), C__->state_, CONTEXT_LENGTH - 1);
 
     Decompressor_Decompress_symbol_aux_(C__, gval__, lo, up, CONTEXT_LENGTH - 1);
 
     /* insert new node into the graph */
     C__->state_ = finish_symbol_insertion_(C__, C__->state_, *gval__);
+    process_check_budget_(C__);
 
   } else {
     COMPRESSOR_VERBOSE(
@@ -2,7 +2,6 @@
 #define _COMPRESSOR__
 
 #include "arith/arith.h"
-#include "arith/bitio.h"
 
 #include "deBruijn.h"
 #include "defines.h"
@@ -12,37 +11,59 @@
     func                         \
   }
 
+/* Bytes each graph line is accounted for by the memory budget. Real size of
+ * the line depends on the build, but the model must be restarted at the same
+ * symbols by all of them. This is a part of the file format. */
+#define BUDGET_LINE_BYTES 8
+
 typedef struct {
   deBruijn_graph dB_;
-  int32_t state_;
+  arith_coder coder_; /* arithmetic coder of the output (or input) stream */
+  LineIdx state_;
+  size_t budget_;     /* model size limit in bytes (0 for unlimited) */
+  uint32_t restarts_; /* number of model restarts caused by the limit */
 } compressor;
 
 #define CompressorRef compressor*
 
-#define Compression_Start(ofp__) { \
-  startoutputtingbits(ofp__);      \
-  start_encode();                  \
+#define Compression_Start(C__, ofp__) {            \
+  startoutputtingbits(&((C__)->coder_.io), ofp__); \
+  start_encode(&((C__)->coder_));                  \
 }
-#define Compression_Finalize() { \
-  finish_encode();               \
-  doneoutputtingbits();          \
+#define Compression_Finalize(C__) {        \
+  finish_encode(&((C__)->coder_));         \
+  doneoutputtingbits(&((C__)->coder_.io)); \
 }
 
-#define Decompression_Start(ifp__) { \
-  startinputtingbits(ifp__);         \
-  start_decode();                    \
+#define Decompression_Start(C__, ifp__) {         \
+  startinputtingbits(&((C__)->coder_.io), ifp__); \
+  start_decode(&((C__)->coder_));                 \
 }
-#define Decompression_Finalize() { \
-  finish_decode();                 \
-  doneinputtingbits();             \
+#define Decompression_Finalize(C__) {     \
+  finish_decode(&((C__)->coder_));        \
+  doneinputtingbits(&((C__)->coder_.io)); \
 }
 
 /*
  * Initialize compressor object for eighter compression or decompression.
  *
  * @param  C__  Reference to compressor object.
+ * @param  symbols__  Expected number of processed symbols (or 0 if unknown).
+ */
+void Process_Init(CompressorRef C__, LinePos symbols__);
+
+/*
+ * Set memory budget of the model.
+ *
+ * Once the model outgrows the budget, it is thrown away and built again from
+ * scratch. Size of the model is estimated as BUDGET_LINE_BYTES per graph line
+ * and depends only on the processed symbols, so the same budget must be used
+ * for the compression and the decompression of the same data.
+ *
+ * @param  C__  Reference to compressor object.
+ * @param  budget__  Memory budget in bytes (or 0 for unlimited).
  */
-void Process_Init(CompressorRef C__);
+void Process_Set_budget(CompressorRef C__, size_t budget__);
 
 /*
  * Free memory associated with the compressor.
@@ -83,7 +104,7 @@ void Decompressor_Decompress_symbol(CompressorRef C__, Graph_value* gval__);
  * @param  gval__ Additional symbol (Graph_value).
  * @param  ctx_len__ Length of context in given node.
  */
-void Compressor_Increase_frequency_rec_(CompressorRef C__, int32_t idx__, Graph_value gval__, int32_t ctx_len__);
+void Compressor_Increase_frequency_rec_(CompressorRef C__, LineIdx idx__, Graph_value gval__, int32_t ctx_len__);
 
 #endif  /* _UNITY */
 
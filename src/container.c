@@ -0,0 +1,172 @@
+#include <string.h>
+
+#include "container.h"
+#include "arith/arith.h"
+
+/* Model parameters of this build as stored in the header */
+#if defined(LABEL_CONTEXT_SHORTENING)
+  #define CONTAINER_SHORTENING 0
+#elif defined(INTEGER_CONTEXT_SHORTENING)
+  #define CONTAINER_SHORTENING 1
+#else
+  #define CONTAINER_SHORTENING 2
+#endif
+
+#if defined(FREQ_INCREASE_NONE)
+  #define CONTAINER_FREQ_INCREASE 0
+#elif defined(FREQ_INCREASE_FIRST)
+  #define CONTAINER_FREQ_INCREASE 1
+#else
+  #define CONTAINER_FREQ_INCREASE 2
+#endif
+
+#if defined(FREQ_COUNT_EACH)
+  #define CONTAINER_FREQ_COUNT 0
+#else
+  #define CONTAINER_FREQ_COUNT 1
+#endif
+
+#if defined(FRUGAL_BITS)
+  #define CONTAINER_CODER 0x1
+#else
+  #define CONTAINER_CODER 0x0
+#endif
+
+/* flags known to this version */
+#define CONTAINER_FLAGS (CONTAINER_FLAG_BLOCK_TABLE | CONTAINER_FLAG_FRAMED)
+
+/* size of one entry of the block table (or frame) */
+#define CONTAINER_ENTRY_SIZE 16
+
+static void write_uint_(FILE* ofp__, uint64_t value__, int32_t bytes__) {
+  int32_t i;
+  uint8_t buffer[8];
+
+  for (i = 0; i < bytes__; i++)
+    buffer[i] = (uint8_t) (value__ >> (i * 8));
+  fwrite(buffer, sizeof(uint8_t), bytes__, ofp__);
+}
+
+static bool read_uint_(FILE* ifp__, uint64_t* value__, int32_t bytes__) {
+  int32_t i;
+  uint8_t buffer[8];
+
+  if (fread(buffer, sizeof(uint8_t), bytes__, ifp__) != (size_t) bytes__)
+    return false;
+
+  *value__ = 0;
+  for (i = 0; i < bytes__; i++)
+    *value__ |= (uint64_t) buffer[i] << (i * 8);
+  return true;
+}
+
+void Container_Header_Init(ContainerHeaderRef header__, uint8_t flags__, uint32_t budget__) {
+  header__->version_ = CONTAINER_VERSION;
+  header__->flags_ = flags__;
+  header__->context_length_ = CONTEXT_LENGTH;
+  header__->shortening_ = CONTAINER_SHORTENING;
+  header__->freq_increase_ = CONTAINER_FREQ_INCREASE;
+  header__->freq_count_ = CONTAINER_FREQ_COUNT;
+  header__->coder_ = CONTAINER_CODER;
+  header__->budget_ = budget__;
+}
+
+void Container_Header_Write(ContainerHeaderRef header__, FILE* ofp__) {
+  uint8_t fields[8];
+
+  fields[0] = header__->version_;
+  fields[1] = header__->flags_;
+  fields[2] = header__->context_length_;
+  fields[3] = header__->shortening_;
+  fields[4] = header__->freq_increase_;
+  fields[5] = header__->freq_count_;
+  fields[6] = header__->coder_;
+  fields[7] = 0;
+
+  fwrite(CONTAINER_MAGIC, sizeof(char), 4, ofp__);
+  fwrite(fields, sizeof(uint8_t), 8, ofp__);
+  write_uint_(ofp__, header__->budget_, 4);
+}
+
+container_status Container_Header_Read(ContainerHeaderRef header__, FILE* ifp__) {
+  char magic[4];
+  uint8_t fields[8];
+  uint64_t budget;
+  container_header expected;
+
+  if (fread(magic, sizeof(char), 4, ifp__) != 4)
+    return CONTAINER_READ_ERROR;
+  if (memcmp(magic, CONTAINER_MAGIC, 4))
+    return CONTAINER_BAD_MAGIC;
+
+  if (fread(fields, sizeof(uint8_t), 8, ifp__) != 8 || !read_uint_(ifp__, &budget, 4))
+    return CONTAINER_READ_ERROR;
+
+  header__->version_ = fields[0];
+  header__->flags_ = fields[1];
+  header__->context_length_ = fields[2];
+  header__->shortening_ = fields[3];
+  header__->freq_increase_ = fields[4];
+  header__->freq_count_ = fields[5];
+  header__->coder_ = fields[6];
+  header__->budget_ = (uint32_t) budget;
+
+  if (header__->version_ != CONTAINER_VERSION || (header__->flags_ & ~CONTAINER_FLAGS))
+    return CONTAINER_BAD_VERSION;
+
+  Container_Header_Init(&expected, header__->flags_, header__->budget_);
+  if (header__->context_length_ != expected.context_length_ ||
+      header__->shortening_ != expected.shortening_ ||
+      header__->freq_increase_ != expected.freq_increase_ ||
+      header__->freq_count_ != expected.freq_count_ ||
+      header__->coder_ != expected.coder_)
+    return CONTAINER_BAD_MODEL;
+
+  return CONTAINER_OK;
+}
+
+void Container_Table_Write(block_entry* table__, uint32_t count__, FILE* ofp__) {
+  uint32_t i;
+
+  for (i = 0; i < count__; i++) {
+    write_uint_(ofp__, table__[i].size_, 8);
+    write_uint_(ofp__, table__[i].symbols_, 8);
+  }
+  write_uint_(ofp__, count__, 4);
+}
+
+block_entry* Container_Table_Read(uint32_t* count__, FILE* ifp__) {
+  uint32_t i;
+  uint64_t count;
+  block_entry* table;
+
+  if (fseek(ifp__, -4, SEEK_END) || !read_uint_(ifp__, &count, 4))
+    FATAL("Cannot read number of blocks from the file");
+  *count__ = (uint32_t) count;
+
+  table = (block_entry*) malloc_((count + 1) * sizeof(block_entry));
+  if (table == NULL)
+    FATAL("Cannot allocate block table");
+
+  if (fseek(ifp__, -4 - (long) (count * CONTAINER_ENTRY_SIZE), SEEK_END))
+    FATAL("Cannot read block table from the file");
+
+  for (i = 0; i < count; i++) {
+    if (!read_uint_(ifp__, &(table[i].size_), 8) || !read_uint_(ifp__, &(table[i].symbols_), 8))
+      FATAL("Cannot read block table from the file");
+  }
+  return table;
+}
+
+void Container_Frame_Write(block_entry* frame__, FILE* ofp__) {
+  write_uint_(ofp__, frame__->size_, 8);
+  write_uint_(ofp__, frame__->symbols_, 8);
+}
+
+bool Container_Frame_Read(block_entry* frame__, FILE* ifp__) {
+  return read_uint_(ifp__, &(frame__->size_), 8) && read_uint_(ifp__, &(frame__->symbols_), 8);
+}
+
+bool Container_Seekable(FILE* fp__) {
+  return fseek(fp__, 0, SEEK_CUR) == 0;
+}
@@ -0,0 +1,145 @@
+#ifndef _CONTAINER__
+#define _CONTAINER__
+
+#include <stdio.h>
+
+#include "defines.h"
+
+/*
+ * Format of compressed files.
+ *
+ * Each file starts with a fixed size header identifying the format and the
+ * model parameters the data were compressed with (decompression with any
+ * other parameters would produce garbage). Compressed blocks follow one after
+ * another and the file ends with the block table and the number of blocks.
+ * Nothing is written before it is known, so the file is written in one pass.
+ *
+ *   header:  magic (4B) | version (1B) | flags (1B) | context length (1B) |
+ *            context shortening (1B) | frequency increase (1B) |
+ *            escape frequency (1B) | coder options (1B) | reserved (1B) |
+ *            memory budget in MB (4B)
+ *   blocks:  compressed blocks
+ *   table:   (compressed size (8B) | number of symbols (8B)) for each block |
+ *            number of blocks (4B)
+ *
+ * Streams which must be read without seeking have no block table. Instead,
+ * each block is preceded by a frame with its compressed size and number of
+ * symbols (same as the table entry) and the stream ends with an empty frame.
+ *
+ *   stream:  header | (frame (16B) | compressed block) for each block |
+ *            empty frame (16B)
+ *
+ * All integers are stored in little endian.
+ */
+#define CONTAINER_MAGIC "dBPC"
+#define CONTAINER_VERSION 1
+#define CONTAINER_HEADER_SIZE 16
+
+/* file ends with the block table */
+#define CONTAINER_FLAG_BLOCK_TABLE 0x1
+/* each block is preceded by a frame */
+#define CONTAINER_FLAG_FRAMED 0x2
+
+typedef struct {
+  uint8_t version_;
+  uint8_t flags_;
+  uint8_t context_length_;
+  uint8_t shortening_;
+  uint8_t freq_increase_;
+  uint8_t freq_count_;
+  uint8_t coder_;
+  uint32_t budget_;  /* memory budget of the model in MB */
+} container_header;
+
+#define ContainerHeaderRef container_header*
+
+typedef enum {
+  CONTAINER_OK,
+  CONTAINER_READ_ERROR,
+  CONTAINER_BAD_MAGIC,
+  CONTAINER_BAD_VERSION,
+  CONTAINER_BAD_MODEL
+} container_status;
+
+/* Entry of the block table (or frame) */
+typedef struct {
+  uint64_t size_;     /* size of the compressed block in bytes */
+  uint64_t symbols_;  /* number of symbols in the block */
+} block_entry;
+
+/*
+ * Initialize header with model parameters of this build.
+ *
+ * @param  header__  Reference to container header.
+ * @param  flags__  Header flags.
+ * @param  budget__  Memory budget of the model in MB.
+ */
+void Container_Header_Init(ContainerHeaderRef header__, uint8_t flags__, uint32_t budget__);
+
+/*
+ * Write header to the beginning of the file.
+ *
+ * @param  header__  Reference to container header.
+ * @param  ofp__  Output file.
+ */
+void Container_Header_Write(ContainerHeaderRef header__, FILE* ofp__);
+
+/*
+ * Read header from the beginning of the file and check that the data can be
+ * decompressed by this build.
+ *
+ * @param  header__  [Out] Reference to container header.
+ * @param  ifp__  Input file.
+ *
+ * @return  CONTAINER_OK or the reason why the file cannot be decompressed.
+ */
+container_status Container_Header_Read(ContainerHeaderRef header__, FILE* ifp__);
+
+/*
+ * Write block table and number of blocks to the end of the file.
+ *
+ * @param  table__  Block table.
+ * @param  count__  Number of blocks.
+ * @param  ofp__  Output file.
+ */
+void Container_Table_Write(block_entry* table__, uint32_t count__, FILE* ofp__);
+
+/*
+ * Read block table from the end of the file (file must be seekable).
+ *
+ * @param  count__  [Out] Number of blocks.
+ * @param  ifp__  Input file.
+ *
+ * @return  Allocated block table.
+ */
+block_entry* Container_Table_Read(uint32_t* count__, FILE* ifp__);
+
+/*
+ * Write frame of the following block (or empty frame at the end of stream).
+ *
+ * @param  frame__  Block table entry of the block.
+ * @param  ofp__  Output file.
+ */
+void Container_Frame_Write(block_entry* frame__, FILE* ofp__);
+
+/*
+ * Read frame of the following block.
+ *
+ * @param  frame__  [Out] Block table entry of the block (empty at the end).
+ * @param  ifp__  Input file.
+ *
+ * @return  False if the frame cannot be read.
+ */
+bool Container_Frame_Read(block_entry* frame__, FILE* ifp__);
+
+/*
+ * Check whether the file can be seeked and thus can end with the block table
+ * (pipes and terminals can hold only framed streams).
+ *
+ * @param  fp__  Checked file.
+ *
+ * @return  True if the file can be seeked.
+ */
+bool Container_Seekable(FILE* fp__);
+
+#endif
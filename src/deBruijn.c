@@ -1,10 +1,19 @@
 #include "deBruijn.h"
 
-void deBruijn_Init(deBruijnRef dB__) {
+void deBruijn_Init(deBruijnRef dB__, LinePos symbols__) {
   Graph_Line line;
+  LinePos lines = symbols__;
+
+  /* Each symbol adds at most one line (which is about what random sequences
+   * do, repetitive ones stay well below). Number of lines is also bounded by
+   * the number of distinct contexts. */
+#if 2 * CONTEXT_LENGTH + 3 < 32
+  if (lines > ((LinePos) 0x1 << (2 * CONTEXT_LENGTH + 3)))
+    lines = (LinePos) 0x1 << (2 * CONTEXT_LENGTH + 3);
+#endif
 
   /* initialize all structures */
-  Graph_Init(&(dB__->Graph_));
+  Graph_Init(&(dB__->Graph_), lines + 5);
 
   GLine_Fill(&line, VALUE_1, VALUE_A, 1);
   GLine_Insert(&(dB__->Graph_), 0, &line);
@@ -32,38 +41,21 @@ void deBruijn_Free(deBruijnRef dB__) {
   Graph_Free(&(dB__->Graph_));
 }
 
-int32_t deBruijn_Forward_(deBruijnRef dB__, int32_t idx__) {
-  int32_t rank, spos, temp;
-  Graph_Line line;
-
+LineIdx deBruijn_Forward_(deBruijnRef dB__, LineIdx idx__) {
   DEBRUIJN_VERBOSE(
-    printf("[deBruijn]: Calling Forward on index %d\n", idx__);
+    printf("[deBruijn]: Calling Forward on index %" PRI_IDX "\n", idx__);
   )
 
-  /* find edge label of given edge (outgoing edge symbol) */
-  GLine_Get(&(dB__->Graph_), idx__, &line);
-
-  /* if edge label is dollar, there is nowhere to go */
-  if (line.W_ == VALUE_$) return -1;
-
-  /* calculate rank of edge label in the W array */
-  rank = Graph_Rank(&(dB__->Graph_), idx__ + 1, VECTOR_W, (line.W_ & 0xE));
-
-  /* get starting position of edge label */
-  spos = dB__->F_[line.W_ >> 0x1];
-
-  /* get index of the last edge of the node pointed to by given edge */
-  temp = Graph_Rank(&(dB__->Graph_), spos, VECTOR_L, VALUE_1);
-  return Graph_Select(&(dB__->Graph_), temp + rank, VECTOR_L, VALUE_1) - 1;
+  return Graph_Forward(&(dB__->Graph_), (LinePos) idx__, dB__->F_);
 }
 
-int32_t deBruijn_Backward_(deBruijnRef dB__, int32_t idx__) {
-  int32_t base, temp;
+LineIdx deBruijn_Backward_(deBruijnRef dB__, LineIdx idx__) {
+  LineIdx base, temp;
   Graph_value symbol;
   Graph_Line line;
 
   DEBRUIJN_VERBOSE(
-    printf("[deBruijn]: Calling Backward on index %d\n", idx__);
+    printf("[deBruijn]: Calling Backward on index %" PRI_IDX "\n", idx__);
   )
 
   assert(idx__ < Graph_Size(&(dB__->Graph_)) && idx__ >= 0);
@@ -82,18 +74,18 @@ int32_t deBruijn_Backward_(deBruijnRef dB__, int32_t idx__) {
   temp = Graph_Rank(&(dB__->Graph_), idx__ + 1, VECTOR_L, VALUE_1);
 
   /* if given line is not last edge of the node, add that node */
-  GLine_Get(&(dB__->Graph_), (uint32_t) idx__, &line);
+  GLine_Get(&(dB__->Graph_), (LinePos) idx__, &line);
   temp += (line.L_) ? 0 : 1;
 
   /* get index of the edge leading to given node */
   return Graph_Select(&(dB__->Graph_), temp - base, VECTOR_W, symbol) - 1;
 }
 
-int32_t deBruijn_Outdegree(deBruijnRef dB__, int32_t idx__) {
-  int32_t node_id;
+int32_t deBruijn_Outdegree(deBruijnRef dB__, LineIdx idx__) {
+  LineIdx node_id;
 
   DEBRUIJN_VERBOSE(
-    printf("[deBruijn]: Calling Outdegree on index %d\n", idx__);
+    printf("[deBruijn]: Calling Outdegree on index %" PRI_IDX "\n", idx__);
   )
 
   assert(idx__ < Graph_Size(&(dB__->Graph_)) && idx__ >= 0);
@@ -106,15 +98,15 @@ int32_t deBruijn_Outdegree(deBruijnRef dB__, int32_t idx__) {
          Graph_Select(&(dB__->Graph_), node_id, VECTOR_L, VALUE_1);
 }
 
-int32_t deBruijn_Find_Edge(deBruijnRef dB__, int32_t idx__, Graph_value gval__) {
+LineIdx deBruijn_Find_Edge(deBruijnRef dB__, LineIdx idx__, Graph_value gval__) {
   return Graph_Find_Edge(&(dB__->Graph_), idx__, gval__);
 }
 
-int32_t deBruijn_Outgoing(deBruijnRef dB__, int32_t idx__, Graph_value gval__) {
-  int32_t edge_idx;
+LineIdx deBruijn_Outgoing(deBruijnRef dB__, LineIdx idx__, Graph_value gval__) {
+  LineIdx edge_idx;
 
   DEBRUIJN_VERBOSE(
-    printf("[deBruijn]: Calling Outgoing on index %d and value %d\n", idx__, gval__);
+    printf("[deBruijn]: Calling Outgoing on index %" PRI_IDX " and value %d\n", idx__, gval__);
   )
 
   /* get index of edge we should follow */
@@ -128,7 +120,7 @@ int32_t deBruijn_Outgoing(deBruijnRef dB__, int32_t idx__, Graph_value gval__) {
   return deBruijn_Forward_(dB__, edge_idx);
 }
 
-int32_t deBruijn_Indegree(deBruijnRef dB__, int32_t idx__) {
+int32_t deBruijn_Indegree(deBruijnRef dB__, LineIdx idx__) {
   UNUSED(dB__);
   UNUSED(idx__);
 
@@ -136,7 +128,7 @@ int32_t deBruijn_Indegree(deBruijnRef dB__, int32_t idx__) {
   return 0;
 }
 
-int32_t deBruijn_Incomming(deBruijnRef dB__, int32_t idx__, Graph_value gval__) {
+LineIdx deBruijn_Incomming(deBruijnRef dB__, LineIdx idx__, Graph_value gval__) {
   UNUSED(dB__);
   UNUSED(idx__);
   UNUSED(gval__);
@@ -145,7 +137,7 @@ int32_t deBruijn_Incomming(deBruijnRef dB__, int32_t idx__, Graph_value gval__)
   return 0;
 }
 
-void deBruijn_Label(deBruijnRef dB__, int32_t idx__, char *buffer__) {
+void deBruijn_Label(deBruijnRef dB__, LineIdx idx__, char *buffer__) {
   int8_t symbol;
   int32_t pos, i;
 
@@ -163,9 +155,9 @@ void deBruijn_Label(deBruijnRef dB__, int32_t idx__, char *buffer__) {
 
 void deBruijn_Print(deBruijnRef dB__, bool labels__) {
   char label[CONTEXT_LENGTH + 2];
-  int32_t i, j, size;
-  int32_t nextPos = 0;
-  int32_t next = 0;
+  int32_t j, next = 0;
+  LineIdx i, nextPos = 0;
+  Graph_Iterator iter;
   Graph_Line line;
 
   /* print header for main structure */
@@ -181,9 +173,12 @@ void deBruijn_Print(deBruijnRef dB__, bool labels__) {
     printf("     F  L  W   P\n-----------------\n");
   }
 
-  size = Graph_Size(&(dB__->Graph_));
-  for (i = 0; i < size; i++) {
-    printf("%4d: ", i);
+  if (!Graph_Size(&(dB__->Graph_))) return;
+
+  Graph_Iterator_Init(&iter, &(dB__->Graph_), 0);
+  do {
+    i = (LineIdx) Graph_Iterator_Position(&iter);
+    printf("%4" PRI_IDX ": ", i);
 
     /* handle base positions for all symbols */
     if (i == nextPos) {
@@ -208,7 +203,7 @@ void deBruijn_Print(deBruijnRef dB__, bool labels__) {
     }
 
     /* find edge label of given edge (outgoing edge symbol) */
-    GLine_Get(&(dB__->Graph_), (uint32_t) i, &line);
+    Graph_Iterator_Get(&iter, &line);
 
     printf("%d  ", line.L_);
 
@@ -224,15 +219,15 @@ void deBruijn_Print(deBruijnRef dB__, bool labels__) {
     }
     printf("%c%c  ", GET_SYMBOL_FROM_VALUE(line.W_), (line.W_ & 0x1) ? 'x' : ' ');
     printf("%d\n", line.P_);
-  }
+  } while (Graph_Iterator_Next(&iter));
 }
 
-int32_t deBruijn_Get_common_suffix_len_(deBruijnRef dB__, int32_t idx1__, int32_t idx2__) {
+int32_t deBruijn_Get_common_suffix_len_(deBruijnRef dB__, LineIdx idx1__, LineIdx idx2__) {
   int32_t common;
   int32_t symbol1, symbol2;
 
   DEBRUIJN_VERBOSE(
-    printf("[deBruijn]: Calling Get_common_suffix_len on index %d and %d\n", idx1__, idx2__);
+    printf("[deBruijn]: Calling Get_common_suffix_len on index %" PRI_IDX " and %" PRI_IDX "\n", idx1__, idx2__);
   )
   common = 0;
 
@@ -258,12 +253,12 @@ int32_t deBruijn_Get_common_suffix_len_(deBruijnRef dB__, int32_t idx1__, int32_
   return common;
 }
 
-void deBruijn_update_csl(deBruijnRef dB__, int32_t target__) {
+void deBruijn_update_csl(deBruijnRef dB__, LineIdx target__) {
 
 #if defined(INTEGER_CONTEXT_SHORTENING) \
   || defined(RAS_CONTEXT_SHORTENING)
 
-  int32_t graph_size;
+  LineIdx graph_size;
 
   graph_size = Graph_Size(&(dB__->Graph_));
   assert(target__ <= graph_size);
@@ -286,83 +281,171 @@ void deBruijn_update_csl(deBruijnRef dB__, int32_t target__) {
 #endif
 }
 
-int32_t deBruijn_shorten_lower(deBruijnRef dB__, int32_t idx__, int32_t ctx_len__) {
+#if defined(LABEL_CONTEXT_SHORTENING)
+
+/*
+ * Line visited by the context shortening scan.
+ *
+ * Scan moves over the lines with graph iterator and keeps rank of L values
+ * up to the current line, so the first backward step of each line costs only
+ * a single select instead of full deBruijn_Backward_.
+ */
+typedef struct {
+  LineIdx idx_;
+  LineIdx rank_;  /* number of L values set up to this line (including) */
+  LineIdx back_;  /* first backward step (-2 if not known yet) */
+  Graph_value L_;
+} scan_line_;
+
+static void deBruijn_scan_line_(GIterRef iter__, scan_line_* line__, LineIdx rank__) {
+  Graph_Line line;
+
+  Graph_Iterator_Get(iter__, &line);
+  line__->idx_ = (LineIdx) Graph_Iterator_Position(iter__);
+  line__->rank_ = rank__;
+  line__->back_ = -2;
+  line__->L_ = line.L_;
+}
+
+static void deBruijn_scan_init_(deBruijnRef dB__, GIterRef iter__, LineIdx idx__,
+                                scan_line_* line__, LineIdx* bases__) {
+  int32_t i;
+
+  for (i = 0; i < SYMBOL_COUNT; i++)
+    bases__[i] = -1;
+
+  Graph_Iterator_Init(iter__, &(dB__->Graph_), (LinePos) idx__);
+  deBruijn_scan_line_(iter__, line__,
+                      Graph_Rank(&(dB__->Graph_), idx__ + 1, VECTOR_L, VALUE_1));
+}
+
+/* Same as deBruijn_Backward_ with ranks taken from the scan. */
+static LineIdx deBruijn_scan_backward_(deBruijnRef dB__, scan_line_* line__, LineIdx* bases__) {
+  Graph_value symbol;
+
+  if (line__->back_ != -2)
+    return line__->back_;
+
+  symbol = GET_VALUE_FROM_IDX(line__->idx_, dB__);
+  if (symbol == VALUE_$)
+    return line__->back_ = -1;
+
+  /* rank to current base (it is the same for the whole scan) */
+  if (bases__[symbol >> 0x1] == -1)
+    bases__[symbol >> 0x1] = Graph_Rank(&(dB__->Graph_), dB__->F_[symbol >> 0x1], VECTOR_L, VALUE_1);
+
+  line__->back_ = Graph_Select(&(dB__->Graph_),
+                               line__->rank_ + (line__->L_ ? 0 : 1) - bases__[symbol >> 0x1],
+                               VECTOR_W, symbol) - 1;
+  return line__->back_;
+}
+
+/* Same as deBruijn_Get_common_suffix_len_ of scan line and line above. */
+static int32_t deBruijn_scan_csl_(deBruijnRef dB__, scan_line_* line__,
+                                  scan_line_* above__, LineIdx* bases__) {
+  int32_t symbol, common;
+  LineIdx idx1, idx2;
+
+  symbol = GET_VALUE_FROM_IDX(line__->idx_, dB__);
+  if (symbol == VALUE_$ || symbol != GET_VALUE_FROM_IDX(above__->idx_, dB__))
+    return 0;
+
+  /* first step is done from the scan, the rest is random access anyway */
+  idx1 = deBruijn_scan_backward_(dB__, line__, bases__);
+  idx2 = deBruijn_scan_backward_(dB__, above__, bases__);
+  common = 1 + deBruijn_Get_common_suffix_len_(dB__, idx1, idx2);
+  return (common < CONTEXT_LENGTH) ? common : CONTEXT_LENGTH;
+}
+
+#endif
+
+LineIdx deBruijn_shorten_lower(deBruijnRef dB__, LineIdx idx__, int32_t ctx_len__) {
 
   DEBRUIJN_VERBOSE(
-    printf("[deBruijn]: Calling Shorten_context on index %d (ctx len: %d)\n", idx__, ctx_len__);
+    printf("[deBruijn]: Calling Shorten_context on index %" PRI_IDX " (ctx len: %d)\n", idx__, ctx_len__);
   )
 
   /* if this is root node it is not possible to shorten context */
   if (idx__ < dB__->F_[0] || ctx_len__ == 0) return 0;
 
-  while (idx__ > 0) {
+#if defined(INTEGER_CONTEXT_SHORTENING)
+  /* first line is never a context boundary itself (result is the same) */
+  idx__ = Graph_Find_csl_lower(&(dB__->Graph_), (LinePos) idx__, ctx_len__);
+  return (idx__ > 0) ? idx__ : 0;
+#elif defined(LABEL_CONTEXT_SHORTENING)
+  Graph_Iterator iter;
+  LineIdx bases[SYMBOL_COUNT];
+  scan_line_ line, above;
+
+  deBruijn_scan_init_(dB__, &iter, idx__, &line, bases);
+  while (Graph_Iterator_Prev(&iter)) {
+    /* rank up to the line above excludes L value of the current one */
+    deBruijn_scan_line_(&iter, &above, line.rank_ - line.L_);
+
     /* check for length of common suffix */
-#if defined(LABEL_CONTEXT_SHORTENING)
-    if (deBruijn_Get_common_suffix_len_(dB__, idx__, idx__ - 1) < ctx_len__)
-#elif defined(INTEGER_CONTEXT_SHORTENING)
-    if (Graph_Get_csl(&(dB__->Graph_), idx__) < ctx_len__)
-#endif
-      return idx__;
+    if (deBruijn_scan_csl_(dB__, &line, &above, bases) < ctx_len__)
+      return line.idx_;
 
     /* move one line higher */
-    idx__--;
+    line = above;
   }
   return 0;
+#else
+  return idx__;
+#endif
 }
-int32_t deBruijn_shorten_upper(deBruijnRef dB__, int32_t idx__, int32_t ctx_len__) {
+LineIdx deBruijn_shorten_upper(deBruijnRef dB__, LineIdx idx__, int32_t ctx_len__) {
 
   DEBRUIJN_VERBOSE(
-    printf("[deBruijn]: Calling Shorten_context on index %d (ctx len: %d)\n", idx__, ctx_len__);
+    printf("[deBruijn]: Calling Shorten_context on index %" PRI_IDX " (ctx len: %d)\n", idx__, ctx_len__);
   )
 
   /* if this is root node it is not possible to shorten context */
-  int gsize = Graph_Size(&(dB__->Graph_));
+  LineIdx gsize = Graph_Size(&(dB__->Graph_));
   if (idx__ < dB__->F_[0] || ctx_len__ == 0) return gsize - 1;
 
-  idx__++;
-  while (idx__ < gsize) {
+#if defined(INTEGER_CONTEXT_SHORTENING)
+  return Graph_Find_csl_upper(&(dB__->Graph_), (LinePos) idx__ + 1, ctx_len__) - 1;
+#elif defined(LABEL_CONTEXT_SHORTENING)
+  Graph_Iterator iter;
+  LineIdx bases[SYMBOL_COUNT];
+  scan_line_ line, above;
+
+  deBruijn_scan_init_(dB__, &iter, idx__, &above, bases);
+  while (Graph_Iterator_Next(&iter)) {
+    deBruijn_scan_line_(&iter, &line, above.rank_);
+    line.rank_ += line.L_;
+
     /* check for length of common suffix */
-#if defined(LABEL_CONTEXT_SHORTENING)
-    if (deBruijn_Get_common_suffix_len_(dB__, idx__, idx__ - 1) < ctx_len__)
-#elif defined(INTEGER_CONTEXT_SHORTENING)
-    if (Graph_Get_csl(&(dB__->Graph_), idx__) < ctx_len__)
-#endif
-      return idx__ - 1;
+    if (deBruijn_scan_csl_(dB__, &line, &above, bases) < ctx_len__)
+      return above.idx_;
 
-    /* move one line higher */
-    idx__++;
+    /* move one line lower */
+    above = line;
   }
   return gsize - 1;
+#else
+  return (idx__ + 1 < gsize) ? idx__ : gsize - 1;
+#endif
 }
 
 
-void deBruijn_Get_symbol_frequency(deBruijnRef dB__, uint32_t idx__, cfreq* freq__) {
+void deBruijn_Get_symbol_frequency(deBruijnRef dB__, LinePos idx__, cfreq* freq__) {
   Graph_Get_symbol_frequency(&(dB__->Graph_), idx__, freq__);
 }
 
-void deBruijn_Get_symbol_frequency_range(deBruijnRef dB__, int32_t lo_, int32_t up_, cfreq* freq__) {
+void deBruijn_Get_symbol_frequency_range(deBruijnRef dB__, LineIdx lo_, LineIdx up_, cfreq* freq__) {
 
   DEBRUIJN_VERBOSE(
-    printf("[deBruijn]: Calling Get_symbol_frequency on range  TODO\n");
+    printf("[deBruijn]: Calling Get_symbol_frequency on range %" PRI_IDX " - %" PRI_IDX "\n", lo_, up_);
   )
 
-  int32_t idx, cnt;
-  Graph_Line line;
+  int32_t cnt;
 
-  freq__->total_ = 0;
+  Graph_Get_symbol_frequency_range(&(dB__->Graph_), (LinePos) lo_, (LinePos) up_, freq__);
 
-  cnt = 0;
-  memset(freq__, 0, sizeof(*freq__));
-  for (idx = lo_; idx <= up_; idx++) {
-    cnt++;
-
-    GLine_Get(&(dB__->Graph_), (uint32_t)idx, &line);
-    if (line.W_ == VALUE_$)
-      continue;
-
-    freq__->symbol_[line.W_ >> 0x1] = line.P_;
-    freq__->total_ += line.P_;
-  }
+  /* each line in the range is an outgoing edge (dollars included) */
+  cnt = (up_ >= lo_) ? up_ - lo_ + 1 : 0;
 
 #if defined(FREQ_COUNT_ONCE)
   int32_t i;
@@ -378,21 +461,26 @@ void deBruijn_Insert_test_data(deBruijnRef dB__, const Graph_value *L__, const G
                                const int32_t *P__, const int32_t F__[SYMBOL_COUNT],
                                const int32_t size__) {
   int32_t i;
-  Graph_Line line;
+  Graph_Line* lines;
 
   DEBRUIJN_VERBOSE(
     printf("[deBruijn]: Inserting test data\n");
   )
 
-  Graph_Init(&(dB__->Graph_));
+  assert(size__ > 0);
+  for (i = 0; i < SYMBOL_COUNT; i++)
+    dB__->F_[i] = F__[i];
 
-  memcpy(dB__->F_, F__, sizeof(dB__->F_));
+  lines = (Graph_Line*) malloc_(size__ * sizeof(Graph_Line));
+  if (lines == NULL)
+    FATAL("Cannot allocate memory for test data");
 
-  /* insert test data */
-  for (i = 0; i < size__; i++) {
-    GLine_Fill(&line, L__[i], W__[i], P__[i]);
-    GLine_Insert(&(dB__->Graph_), i, &line);
-  }
+  /* build graph from test data */
+  for (i = 0; i < size__; i++)
+    GLine_Fill(&(lines[i]), L__[i], W__[i], P__[i]);
+  Graph_Build(&(dB__->Graph_), lines, NULL, size__);
+
+  free_(lines);
 
   /* updated common suffix lengths after insertion is done */
   for (i = 1; i < size__; i += 2)
@@ -36,7 +36,7 @@
     : (idx__ < dB__->F_[3]) ? VALUE_G : VALUE_T)
 
 typedef struct {
-  int32_t F_[SYMBOL_COUNT];
+  LineIdx F_[SYMBOL_COUNT];
   Graph_Struct Graph_;
 
   int32_t depth;
@@ -48,8 +48,9 @@ typedef struct {
  * Initialize deBruijn_graph object.
  *
  * @param  dB__  Reference to deBruijn_graph object.
+ * @param  symbols__  Expected number of processed symbols (or 0 if unknown).
  */
-void deBruijn_Init(deBruijnRef dB__);
+void deBruijn_Init(deBruijnRef dB__, LinePos symbols__);
 
 /*
  * Free all memory associated with deBruijn graph object.
@@ -66,7 +67,7 @@ void deBruijn_Free(deBruijnRef dB__);
  *
  * @return  A number of outgoing edges.
  */
-int32_t deBruijn_Outdegree(deBruijnRef dB__, int32_t idx__);
+int32_t deBruijn_Outdegree(deBruijnRef dB__, LineIdx idx__);
 
 /*
  * Get position of given edge symbol in given node.
@@ -77,7 +78,7 @@ int32_t deBruijn_Outdegree(deBruijnRef dB__, int32_t idx__);
  *
  * @return  Index of edge in given node.
  */
-int32_t deBruijn_Find_Edge(deBruijnRef dB__, int32_t idx__, Graph_value gval__);
+LineIdx deBruijn_Find_Edge(deBruijnRef dB__, LineIdx idx__, Graph_value gval__);
 
 /*
  * From given node follow edge labeled by given symbol.
@@ -88,7 +89,7 @@ int32_t deBruijn_Find_Edge(deBruijnRef dB__, int32_t idx__, Graph_value gval__);
  *
  * @return  Index of new node.
  */
-int32_t deBruijn_Outgoing(deBruijnRef dB__, int32_t idx__, Graph_value gval__);
+LineIdx deBruijn_Outgoing(deBruijnRef dB__, LineIdx idx__, Graph_value gval__);
 
 /*
  * Get number of edges that point to current node.
@@ -96,7 +97,7 @@ int32_t deBruijn_Outgoing(deBruijnRef dB__, int32_t idx__, Graph_value gval__);
  * As this is not important for compression and it's not super straightforward,
  * it is not implemented.
  */
-int32_t deBruijn_Indegree(deBruijnRef dB__, int32_t idx__);
+int32_t deBruijn_Indegree(deBruijnRef dB__, LineIdx idx__);
 
 /*
  * Get node starting with given symbol that has an edge to given node.
@@ -104,7 +105,7 @@ int32_t deBruijn_Indegree(deBruijnRef dB__, int32_t idx__);
  * As this is not important for compression and it's not super straightforward,
  * it is not implemented.
  */
-int32_t deBruijn_Incomming(deBruijnRef dB__, int32_t idx__, Graph_value gval__);
+LineIdx deBruijn_Incomming(deBruijnRef dB__, LineIdx idx__, Graph_value gval__);
 
 /*
  * Get label of a node corresponding to given line.
@@ -118,7 +119,7 @@ int32_t deBruijn_Incomming(deBruijnRef dB__, int32_t idx__, Graph_value gval__);
  * @param  idx__  Edge index (line) in deBruijn graph.
  * @param  buffer__  [out] Output buffer with label in symbols.
  */
-void deBruijn_Label(deBruijnRef dB__, int32_t idx__, char *buffer__);
+void deBruijn_Label(deBruijnRef dB__, LineIdx idx__, char *buffer__);
 
 /*
  * Print whole deBruijn graph struct.
@@ -141,8 +142,8 @@ void deBruijn_Print(deBruijnRef dB__, bool labels__);
  *
  * @return  Index of first lower/upper line with given context length.
  */
-int32_t deBruijn_shorten_lower(deBruijnRef dB__, int32_t idx__, int32_t ctx_len__);
-int32_t deBruijn_shorten_upper(deBruijnRef dB__, int32_t idx__, int32_t ctx_len__);
+LineIdx deBruijn_shorten_lower(deBruijnRef dB__, LineIdx idx__, int32_t ctx_len__);
+LineIdx deBruijn_shorten_upper(deBruijnRef dB__, LineIdx idx__, int32_t ctx_len__);
 
 /*
  * Update longest common suffix length with its neighbours.
@@ -152,7 +153,7 @@ int32_t deBruijn_shorten_upper(deBruijnRef dB__, int32_t idx__, int32_t ctx_len_
  * @param  dB__  Reference to deBruijn_graph object.
  * @param  target__  Edge index (line) in deBruijn graph.
  */
-void deBruijn_update_csl(deBruijnRef dB__, int32_t target__);
+void deBruijn_update_csl(deBruijnRef dB__, LineIdx target__);
 
 /*
  * Get symbol frequencies from node pointed to by given index.
@@ -161,7 +162,7 @@ void deBruijn_update_csl(deBruijnRef dB__, int32_t target__);
  * @param  idx__  Edge index (line) in deBruijn graph.
  * @param  freq__  [Out] Frequency count structure.
  */
-void deBruijn_Get_symbol_frequency(deBruijnRef dB__, uint32_t idx__, cfreq *freq__);
+void deBruijn_Get_symbol_frequency(deBruijnRef dB__, LinePos idx__, cfreq *freq__);
 
 /*
  * Get symbol frequencies from given range.
@@ -171,7 +172,7 @@ void deBruijn_Get_symbol_frequency(deBruijnRef dB__, uint32_t idx__, cfreq *freq
  * @param  up__  Upper bound of given range
  * @param  freq__  [Out] Frequency count structure.
  */
-void deBruijn_Get_symbol_frequency_range(deBruijnRef dB__, int32_t lo__, int32_t up__, cfreq* freq__);
+void deBruijn_Get_symbol_frequency_range(deBruijnRef dB__, LineIdx lo__, LineIdx up__, cfreq* freq__);
 
 /*
  * Move to next node pointed to by given edge (line) index.
@@ -182,7 +183,7 @@ void deBruijn_Get_symbol_frequency_range(deBruijnRef dB__, int32_t lo__, int32_t
  * @return  Index of last edge of the next node pointed to by given edge or -1
  * if there is no next node.
  */
-int32_t deBruijn_Forward_(deBruijnRef dB__, int32_t idx__);
+LineIdx deBruijn_Forward_(deBruijnRef dB__, LineIdx idx__);
 
 /*
  * Move to parent node of given one.
@@ -193,7 +194,7 @@ int32_t deBruijn_Forward_(deBruijnRef dB__, int32_t idx__);
  * @return  Index of parent node (its edge pointing to given one) or -1 if there
  * is no parent node.
  */
-int32_t deBruijn_Backward_(deBruijnRef dB__, int32_t idx__);
+LineIdx deBruijn_Backward_(deBruijnRef dB__, LineIdx idx__);
 
 /*
  * Get length of common suffix of given line and line above.
@@ -204,7 +205,7 @@ int32_t deBruijn_Backward_(deBruijnRef dB__, int32_t idx__);
  *
  * @return  Length of longest common suffix
  */
-int32_t deBruijn_Get_common_suffix_len_(deBruijnRef dB__, int32_t idx1__, int32_t idx2__);
+int32_t deBruijn_Get_common_suffix_len_(deBruijnRef dB__, LineIdx idx1__, LineIdx idx2__);
 
 /*
  * Initialize structure with given test data.
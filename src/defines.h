@@ -27,7 +27,7 @@
   #define COMPRESSOR_VERBOSE_ false
 #endif
 
-/* number of preallocated block pointers */
+/* minimal number of preallocated block pointers */
 #ifndef INITIAL_BLOCK_COUNT_
   #define INITIAL_BLOCK_COUNT_ 2
 #endif
@@ -39,6 +39,19 @@
 #ifndef MEMORY_BLOCK_SIZE_LOG_
   #define MEMORY_BLOCK_SIZE_LOG_ 5
 #endif
+/* log2 of the largest first block of memory arena (when its size is taken
+ * from the expected graph size) */
+#ifndef MEMORY_ARENA_MAX_LOG_
+  #define MEMORY_ARENA_MAX_LOG_ 24
+#endif
+/* Size of the huge page memory arena blocks are aligned to */
+#ifndef HUGE_PAGE_SIZE
+  #define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+#endif
+/* Directory for the backing file of mapped memory */
+#ifndef MAPPED_MEMORY_DIR
+  #define MAPPED_MEMORY_DIR "."
+#endif
 
 /* Length of the PPMC context */
 #ifndef CONTEXT_LENGTH
@@ -54,6 +67,19 @@
   #define MAX_STACK_SIZE 64
 #endif
 
+/*
+ * Maximal number of children of one internal node when ENABLE_BTREE_NODES is
+ * defined. Nodes are split in half when they are full.
+ */
+#ifndef BTREE_FANOUT
+  #define BTREE_FANOUT 16
+#endif
+
+/* Size of the cache line internal B+ tree nodes are aligned to. */
+#ifndef CACHE_LINE_SIZE
+  #define CACHE_LINE_SIZE 64
+#endif
+
 
 #ifndef REMOTE_OPTIMIZATION_CONTROL
 /**************** OPTIMIZATION DEFINES **********************
@@ -63,12 +89,39 @@
  * reduced performance */
 #define ENABLE_RED_BLACK_BALANCING
 
-/* Use cache for leaf lookup when performing rank, select and other tree
- * related operations. If cache size is 0, no cache is used. */
+/* Use B+ tree like internal nodes with up to BTREE_FANOUT children and prefix
+ * counters of those children instead of the binary tree. Such tree is much
+ * shallower, it is always balanced (ENABLE_RED_BLACK_BALANCING has no effect)
+ * and one tree level costs only few cache line accesses. */
+//#define ENABLE_BTREE_NODES
+
+/* Store 64 lines in each leaf (in 64 bit vectors) instead of 32. There are
+ * half as many leaves and internal nodes and the tree is one level shallower. */
+#define ENABLE_LEAF_64
+
+/* Store P values of leaf lines in 8 bit counters. Leaf with any value which
+ * doesn't fit gets separately allocated 32 bit counters for all of its lines.
+ * Most edges have tiny frequencies and so this saves most of the leaf size. */
+#define ENABLE_PACKED_FREQUENCY
+
+/* Keep P and csl values of leaves (not needed during tree traversal, rank and
+ * select) in a separate parallel array so that the hot part of each leaf takes
+ * fewer cache lines. Each leaf costs one more pointer. */
+//#define ENABLE_SPLIT_LEAVES
+
+/* Use finger cache for leaf lookup when performing line access and other tree
+ * related operations. Cache size is the number of remembered root to leaf
+ * paths (fingers). If cache size is 0, no cache is used. */
 #define CACHE_SIZE 1
-/* Calculate number of cache hits and misses */
+/* Calculate number of cache hits and misses and how far the searches went */
 //#define ENABLE_CACHE_STATS
 
+/* Move the graph tree into new memory in depth first order (Graph_Compact)
+ * after each COMPACT_INTERVAL inserted lines, so that tree paths don't get
+ * scattered over the whole memory in long runs. If it is 0, tree is never
+ * compacted. */
+#define COMPACT_INTERVAL 0
+
 /* These define the way of how context shortening is handled.
  * LABEL_CONTEXT_SHORTENING calculates context each time shortening occurs.
  * INTEGER_CONTEXT_SHORTENING saves context sizes in integer variables.
@@ -100,6 +153,23 @@
 #define DIRECT_MEMORY
 //#define SIMPLE_MEMORY
 
+/* Allocate nodes and leaves (in DIRECT_MEMORY and INDEXED_MEMORY models) from
+ * an arena of geometrically growing blocks, where each block is twice the size
+ * of the previous one, instead of MEMORY_BLOCK_SIZE_ element blocks. First
+ * block is as big as the expected graph size when it is known.
+ *
+ * Indexed memory needs one more bit scan for each access in this mode. */
+#define ENABLE_MEMORY_ARENA
+/* Align arena blocks bigger than HUGE_PAGE_SIZE to huge pages and advise the
+ * kernel to back them with transparent huge pages (fewer TLB misses). */
+#define ENABLE_HUGE_PAGES
+/* Map arena blocks from a file in MAPPED_MEMORY_DIR instead of allocating
+ * them, so that the system can page cold parts of the graph out to disk when
+ * the graph doesn't fit into memory (at the cost of speed). Blocks never move
+ * once mapped and so this works with both memory models. Huge pages are not
+ * used in this mode. */
+//#define ENABLE_MAPPED_MEMORY
+
 /* These define the way how frequency increases are handeled.
  * FREQ_INCREASE_NONE no frequency increase in shortened contexts.
  * FREQ_INCREASE_FIRST only first outgoing edge has its frequecny increased.
@@ -127,6 +197,11 @@
  * other variables to save space occupied by them. */
 #define EMBEDED_FLAGS
 
+/* Use 64 bit line positions and line counters in nodes and leaves (and 64 bit
+ * symbol count in the file header) so that graphs with more than 2^31 lines
+ * can be built. Every node and leaf header is twice as big. */
+//#define ENABLE_64BIT_POSITIONS
+
 /* Following defines enable single traversal ranks and selects. There is no
  * downside to those and thus they should be enabled for optimal performance.
  */
@@ -226,6 +301,27 @@
   #error "You must define exacly one frequency increase model."
 #endif
 
+#if defined(ENABLE_HUGE_PAGES) && (!defined(ENABLE_MEMORY_ARENA))
+  #error "Huge pages are supported only with ENABLE_MEMORY_ARENA."
+#endif
+
+#if defined(ENABLE_MAPPED_MEMORY) && (!defined(ENABLE_MEMORY_ARENA) || defined(SIMPLE_MEMORY))
+  #error "Mapped memory is supported only with ENABLE_MEMORY_ARENA and not with SIMPLE_MEMORY."
+#endif
+
+#if defined(ENABLE_MAPPED_MEMORY)
+  /* file backed pages are never huge */
+  #undef ENABLE_HUGE_PAGES
+#endif
+
+#if defined(ENABLE_BTREE_NODES) && (BTREE_FANOUT < 4)
+  #error "BTREE_FANOUT must be at least 4."
+#endif
+
+#if defined(ENABLE_BTREE_NODES) && (!defined(FAST_RANK) || !defined(FAST_SELECT))
+  #error "B+ tree nodes are supported only with FAST_RANK and FAST_SELECT."
+#endif
+
 #if CACHE_SIZE
 #define ENABLE_LOOKUP_CACHE
 #endif
@@ -234,4 +330,8 @@
 #error "Cache stats cannot be enabled when cache itself is disabled"
 #endif
 
+#if COMPACT_INTERVAL
+#define ENABLE_GRAPH_COMPACTION
+#endif
+
 #endif
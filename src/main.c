@@ -1,11 +1,16 @@
+#include <pthread.h>
 #include <stdio.h>
 
 #include "compressor.h"
+#include "container.h"
 #include "defines.h"
 #include "utils.h"
 
 #define IO_BUFFER_SIZE 1024
 
+/* default number of symbols in one block of block mode */
+#define BLOCK_SIZE_DEFAULT (8 << 20)
+
 #define MAIN_VERBOSE(func) \
   if (MAIN_VERBOSE_) {     \
     func                   \
@@ -13,11 +18,19 @@
 
 static void usage(char* program__) {
   fprintf(stderr,
-          "\nUsage: %s [-e | -d] [-h] [file] [-o [file]] \n\n"
+          "\nUsage: %s [-e | -d] [-h] [-m [MB]] [-T [threads]] [-B [symbols]] [--range [start:length]]\n"
+          "          [file | -] [-o [file | -]] \n\n"
           "-e: Encode\n"
           "-d: Decode\n"
           "-h: This help\n"
-          "-o: Output file [file]\n",
+          "-m: Memory budget of the model in MB (encoding only, 0 for unlimited)\n"
+          "-T: Number of threads processing independent blocks\n"
+          "-B: Number of symbols in one block (encoding only)\n"
+          "--range: Output only given range of symbols (decoding only)\n"
+          "-o: Output file [file]\n"
+          "Use - for standard input or output. Output to a pipe is always compressed\n"
+          "in blocks which can be decompressed from the standard input as they come.\n"
+          "Other files are copied into a temporary file first.\n",
           program__);
 
   exit(EXIT_FAILURE);
@@ -31,140 +44,597 @@ typedef enum {
 
 const char* const mode_str[] = {"UNKNOWN", "ENCODE", "DECODE"};
 
-static void main_encode(FILE* ifp__, FILE* ofp__) {
-  char ibuffer[IO_BUFFER_SIZE];
-  int32_t total, idx, buffer_len;
-  compressor C;
-  Graph_value symbol;
-
-  MAIN_VERBOSE(
-    printf("Starting compression\n");
-  )
-
-  Process_Init(&C);
-  Compression_Start(ofp__);
-
-  buffer_len = 0;
-  idx = total = 0;
-
-  /* keep space in file header for number of symbols */
-  fwrite(&total, sizeof(total), 1, ofp__);
+/* Buffered reader of input symbols */
+typedef struct {
+  FILE* fp_;
+  char buffer_[IO_BUFFER_SIZE];
+  int32_t idx_;
+  int32_t len_;
+} input_reader;
+
+/* Buffered writer of output symbols */
+typedef struct {
+  FILE* fp_;
+  char buffer_[IO_BUFFER_SIZE];
+  int32_t idx_;
+} output_writer;
+
+/* Block compressed by one worker thread */
+typedef struct {
+  Graph_value* symbols_;
+  LinePos length_;
+  uint32_t budget_;
+  FILE* fp_;  /* temporary file with the compressed block */
+  uint64_t size_;
+  uint32_t restarts_;
+} block_job;
+
+/* Block decompressed by one worker thread */
+typedef struct {
+  FILE* fp_;          /* compressed block (closed by the worker) */
+  uint64_t skip_;     /* number of leading symbols which are not output */
+  uint64_t length_;   /* number of output symbols */
+  uint32_t budget_;
+  output_writer* writer_;  /* writer of the symbols or NULL to keep them in output_ */
+  char* output_;
+} block_decode_job;
+
+static void input_reader_init_(input_reader* reader__, FILE* fp__) {
+  reader__->fp_ = fp__;
+  reader__->idx_ = 0;
+  reader__->len_ = 0;
+}
 
+/*
+ * Read next symbol from the input. Whitespaces are skipped and unexpected
+ * symbols terminate the program.
+ *
+ * @param  reader__  Reference to input reader.
+ * @param  symbol__  [Out] Read symbol.
+ *
+ * @return  False if there are no more symbols.
+ */
+static bool input_reader_next_(input_reader* reader__, Graph_value* symbol__) {
   do {
-    if (buffer_len <= idx) {
-      if (!fgets(ibuffer, IO_BUFFER_SIZE, (FILE*) ifp__))
-        break;
+    if (reader__->len_ <= reader__->idx_) {
+      if (!fgets(reader__->buffer_, IO_BUFFER_SIZE, reader__->fp_))
+        return false;
 
-      buffer_len = strlen(ibuffer);
-      idx = 0;
+      reader__->len_ = strlen(reader__->buffer_);
+      reader__->idx_ = 0;
     }
 
-    switch (ibuffer[idx]) {
+    switch (reader__->buffer_[reader__->idx_++]) {
       case 'a':
       case 'A':
-        symbol = VALUE_A;
-        break;
+        *symbol__ = VALUE_A;
+        return true;
       case 'c':
       case 'C':
-        symbol = VALUE_C;
-        break;
+        *symbol__ = VALUE_C;
+        return true;
       case 'g':
       case 'G':
-        symbol = VALUE_G;
-        break;
+        *symbol__ = VALUE_G;
+        return true;
       case 't':
       case 'T':
-        symbol = VALUE_T;
-        break;
+        *symbol__ = VALUE_T;
+        return true;
       case ' ':
       case '\n':
       case '\t':
-        idx++;
         continue;
       default:
-        fprintf(stderr, "Unexpected symbol in input file %c.\n", ibuffer[idx]);
+        fprintf(stderr, "Unexpected symbol in input file %c.\n", reader__->buffer_[reader__->idx_ - 1]);
         fprintf(stderr,
                 "File can contain four letters of dna (both lower and uppercase) and spaces\n");
-        fclose(ifp__);
-        fclose(ofp__);
         exit(EXIT_FAILURE);
     }
+  } while (true);
+}
+
+/*
+ * Get output character of given symbol.
+ *
+ * @param  val__  Decompressed symbol.
+ *
+ * @return  Character of the symbol or '\0' for symbols which cannot be outputs.
+ */
+static char symbol_to_char_(Graph_value val__) {
+  switch (val__) {
+    case VALUE_A:
+      return 'A';
+    case VALUE_C:
+      return 'C';
+    case VALUE_G:
+      return 'G';
+    case VALUE_T:
+      return 'T';
+    default:
+      /* Other Graph_values cannot be outputs */
+      return '\0';
+  }
+}
+
+static void output_writer_init_(output_writer* writer__, FILE* fp__) {
+  writer__->fp_ = fp__;
+  writer__->idx_ = 0;
+}
+
+static void output_writer_flush_(output_writer* writer__) {
+  if (writer__->idx_)
+    fwrite(writer__->buffer_, sizeof(char), writer__->idx_, writer__->fp_);
+  writer__->idx_ = 0;
+}
+
+static void output_writer_put_(output_writer* writer__, Graph_value val__) {
+  char symbol = symbol_to_char_(val__);
+
+  if (symbol)
+    writer__->buffer_[writer__->idx_++] = symbol;
+
+  if (writer__->idx_ == IO_BUFFER_SIZE)
+    output_writer_flush_(writer__);
+}
+
+/*
+ * Copy given number of bytes between files.
+ *
+ * @param  ifp__  Input file.
+ * @param  ofp__  Output file (or NULL to skip the bytes).
+ * @param  size__  Number of copied bytes.
+ */
+static void copy_bytes_(FILE* ifp__, FILE* ofp__, uint64_t size__) {
+  char buffer[IO_BUFFER_SIZE];
+  size_t bytes;
+
+  while (size__) {
+    bytes = (size__ < IO_BUFFER_SIZE) ? size__ : IO_BUFFER_SIZE;
+    if (fread(buffer, sizeof(char), bytes, ifp__) != bytes)
+      FATAL("Unexpected end of compressed data");
+    if (ofp__ != NULL)
+      fwrite(buffer, sizeof(char), bytes, ofp__);
+    size__ -= bytes;
+  }
+}
+
+static void main_encode(FILE* ifp__, FILE* ofp__, uint32_t budget__) {
+  input_reader reader;
+  long length, start, end;
+  compressor C;
+  Graph_value symbol;
+  container_header header;
+  block_entry block;
 
+  MAIN_VERBOSE(
+    fprintf(stderr, "Starting compression\n");
+  )
+
+  /* length of the input is a good estimate of the number of symbols */
+  length = (fseek(ifp__, 0, SEEK_END) == 0) ? ftell(ifp__) : 0;
+  rewind(ifp__);
+  if (length < 0 || (unsigned long) length > LINE_POS_MAX)
+    length = 0;
+
+  /* decompressor must restart the model at the same places */
+  Container_Header_Init(&header, CONTAINER_FLAG_BLOCK_TABLE, budget__);
+  Container_Header_Write(&header, ofp__);
+
+  /* size of the block is taken from the output position */
+  start = ftell(ofp__);
+  if (start < 0)
+    FATAL("Cannot get position in the output file");
+
+  Process_Init(&C, (LinePos) length);
+  Process_Set_budget(&C, (size_t) budget__ << 20);
+  Compression_Start(&C, ofp__);
+
+  input_reader_init_(&reader, ifp__);
+  block.symbols_ = 0;
+
+  while (input_reader_next_(&reader, &symbol)) {
     Compressor_Compress_symbol(&C, symbol);
-    idx++;
-    total++;
-  } while (true);
+    block.symbols_++;
+  }
 
-  Compression_Finalize();
+  Compression_Finalize(&C);
+
+  MAIN_VERBOSE(
+    fprintf(stderr, "Model was restarted %u times\n", C.restarts_);
+  )
   Process_Free(&C);
 
-  /* save total number of letters into the header of the output file */
-  fseek(ofp__, 0, SEEK_SET);
-  fwrite(&total, sizeof(total), 1, ofp__);
+  /* whole input is stored as a single block */
+  end = ftell(ofp__);
+  if (end < start)
+    FATAL("Cannot get position in the output file");
+  block.size_ = (uint64_t) (end - start);
+  Container_Table_Write(&block, 1, ofp__);
 
   MAIN_VERBOSE(
-    printf("Finished compression\n");
+    fprintf(stderr, "Finished compression\n");
   )
 }
 
-static void main_decode(FILE* ifp__, FILE* ofp__) {
-  char obuffer[IO_BUFFER_SIZE];
-  int32_t i, idx, total;
+/*
+ * Compress one block into a temporary file (worker thread entry point).
+ *
+ * @param  job__  Reference to the block_job.
+ */
+static void* block_compress_worker_(void* job__) {
+  block_job* job = (block_job*) job__;
+  LinePos i;
+  long size;
   compressor C;
-  Graph_value val;
+
+  job->fp_ = tmpfile();
+  if (job->fp_ == NULL)
+    FATAL("Cannot create temporary file for compressed block");
+
+  Process_Init(&C, job->length_);
+  Process_Set_budget(&C, (size_t) job->budget_ << 20);
+  Compression_Start(&C, job->fp_);
+
+  for (i = 0; i < job->length_; i++)
+    Compressor_Compress_symbol(&C, job->symbols_[i]);
+
+  Compression_Finalize(&C);
+  job->restarts_ = C.restarts_;
+  Process_Free(&C);
+
+  size = ftell(job->fp_);
+  if (size < 0)
+    FATAL("Cannot get size of compressed block");
+  job->size_ = (uint64_t) size;
+  rewind(job->fp_);
+  return NULL;
+}
+
+/*
+ * Split the input into blocks and compress each of them independently on one
+ * of the worker threads. Compressed blocks are written in order and followed
+ * by the block table and number of blocks, so that the whole container is
+ * written in one pass. Streams have a frame in front of each block instead.
+ *
+ * @param  ifp__  Input file.
+ * @param  ofp__  Output file.
+ * @param  budget__  Memory budget of each block model in MB.
+ * @param  threads__  Number of worker threads.
+ * @param  block_size__  Number of symbols in one block.
+ * @param  framed__  If the output is a stream which is read without seeking.
+ */
+static void main_encode_blocks(FILE* ifp__, FILE* ofp__, uint32_t budget__,
+                               uint32_t threads__, LinePos block_size__, bool framed__) {
+  uint32_t t, running, count, capacity, restarts;
+  input_reader reader;
+  container_header header;
+  block_entry last;
+  block_job* jobs;
+  block_entry* table;
+  pthread_t* workers;
 
   MAIN_VERBOSE(
-    printf("Starting decompression\n");
+    fprintf(stderr, "Starting compression of blocks with %u threads\n", threads__);
   )
 
-  /* keep space in file header for number of symbols */
-  if (!fread(&total, sizeof(total), 1, ifp__)) {
-    fprintf(stderr, "Cannot read total size from the file\n");
-    fclose(ifp__);
-    fclose(ofp__);
-    exit(EXIT_FAILURE);
+  jobs = (block_job*) malloc_(threads__ * sizeof(block_job));
+  workers = (pthread_t*) malloc_(threads__ * sizeof(pthread_t));
+  if (jobs == NULL || workers == NULL)
+    FATAL("Cannot allocate block jobs");
+
+  for (t = 0; t < threads__; t++) {
+    jobs[t].symbols_ = (Graph_value*) malloc_(block_size__ * sizeof(Graph_value));
+    if (jobs[t].symbols_ == NULL)
+      FATAL("Cannot allocate block buffer");
+    jobs[t].budget_ = budget__;
   }
 
-  Process_Init(&C);
-  Decompression_Start(ifp__);
+  capacity = threads__;
+  table = (block_entry*) malloc_(capacity * sizeof(block_entry));
+  if (table == NULL)
+    FATAL("Cannot allocate block table");
 
-  idx = 0;
-  for (i = 0; i < total; i++) {
-    Decompressor_Decompress_symbol(&C, &val);
+  Container_Header_Init(&header, framed__ ? CONTAINER_FLAG_FRAMED : CONTAINER_FLAG_BLOCK_TABLE,
+                        budget__);
+  Container_Header_Write(&header, ofp__);
 
-    switch (val) {
-      case VALUE_A:
-        obuffer[idx++] = 'A';
-        break;
-      case VALUE_C:
-        obuffer[idx++] = 'C';
-        break;
-      case VALUE_G:
-        obuffer[idx++] = 'G';
-        break;
-      case VALUE_T:
-        obuffer[idx++] = 'T';
-        break;
-      default:
-        /* Other Graph_values cannot be outputs */
+  input_reader_init_(&reader, ifp__);
+  count = restarts = 0;
+
+  do {
+    /* read one block for each thread */
+    for (running = 0; running < threads__; running++) {
+      block_job* job = &(jobs[running]);
+
+      job->length_ = 0;
+      while (job->length_ < block_size__ && input_reader_next_(&reader, &(job->symbols_[job->length_])))
+        job->length_++;
+
+      if (!job->length_)
         break;
     }
 
-    if (idx == IO_BUFFER_SIZE) {
-      fwrite(obuffer, sizeof(char), IO_BUFFER_SIZE, ofp__);
-      idx = 0;
+    for (t = 0; t < running; t++) {
+      if (pthread_create(&(workers[t]), NULL, block_compress_worker_, &(jobs[t])))
+        FATAL("Cannot start worker thread");
     }
+
+    /* output blocks in their original order */
+    for (t = 0; t < running; t++) {
+      pthread_join(workers[t], NULL);
+
+      if (count == capacity) {
+        capacity *= 2;
+        table = (block_entry*) realloc_(table, capacity * sizeof(block_entry));
+        if (table == NULL)
+          FATAL("Cannot allocate block table");
+      }
+      table[count].size_ = jobs[t].size_;
+      table[count].symbols_ = jobs[t].length_;
+      if (framed__)
+        Container_Frame_Write(&(table[count]), ofp__);
+      count++;
+      restarts += jobs[t].restarts_;
+
+      copy_bytes_(jobs[t].fp_, ofp__, jobs[t].size_);
+      fclose(jobs[t].fp_);
+    }
+  } while (running == threads__ && jobs[threads__ - 1].length_ == block_size__);
+
+  if (framed__) {
+    last.size_ = last.symbols_ = 0;
+    Container_Frame_Write(&last, ofp__);
+  } else {
+    Container_Table_Write(table, count, ofp__);
+  }
+
+  MAIN_VERBOSE(
+    fprintf(stderr, "Compressed %u blocks\n", count);
+    fprintf(stderr, "Models were restarted %u times\n", restarts);
+  )
+
+  for (t = 0; t < threads__; t++)
+    free_(jobs[t].symbols_);
+  free_(jobs);
+  free_(workers);
+  free_(table);
+
+  MAIN_VERBOSE(
+    fprintf(stderr, "Finished compression\n");
+  )
+}
+
+/*
+ * Copy the rest of the input into a temporary file which can be read with
+ * seeking.
+ *
+ * @param  ifp__  Input file.
+ *
+ * @return  Temporary file positioned at its beginning.
+ */
+static FILE* spool_input_(FILE* ifp__) {
+  char buffer[IO_BUFFER_SIZE];
+  size_t bytes;
+  FILE* spool;
+
+  spool = tmpfile();
+  if (spool == NULL)
+    FATAL("Cannot create temporary file for the input");
+
+  while ((bytes = fread(buffer, sizeof(char), IO_BUFFER_SIZE, ifp__)) > 0) {
+    if (fwrite(buffer, sizeof(char), bytes, spool) != bytes)
+      FATAL("Cannot write temporary file for the input");
   }
+  rewind(spool);
+  return spool;
+}
+
+/*
+ * Decompress requested part of one block into memory (worker thread entry
+ * point).
+ *
+ * @param  job__  Reference to the block_decode_job.
+ */
+static void* block_decompress_worker_(void* job__) {
+  block_decode_job* job = (block_decode_job*) job__;
+  uint64_t i, symbols;
+  compressor C;
+  Graph_value val;
+
+  /* number of symbols is only a hint (blocks may be longer than LinePos) */
+  symbols = job->skip_ + job->length_;
+  Process_Init(&C, ((LinePos) symbols == symbols) ? (LinePos) symbols : 0);
+  Process_Set_budget(&C, (size_t) job->budget_ << 20);
+  Decompression_Start(&C, job->fp_);
 
-  /* output rest of the buffer */
-  if (idx)
-    fwrite(obuffer, sizeof(char), idx, ofp__);
+  /* the model of the block must be replayed from its first symbol */
+  for (i = 0; i < job->skip_; i++)
+    Decompressor_Decompress_symbol(&C, &val);
+
+  for (i = 0; i < job->length_; i++) {
+    Decompressor_Decompress_symbol(&C, &val);
+    if (job->writer_ != NULL)
+      output_writer_put_(job->writer_, val);
+    else
+      job->output_[i] = symbol_to_char_(val);
+  }
 
-  Decompression_Finalize();
+  Decompression_Finalize(&C);
   Process_Free(&C);
 
+  fclose(job->fp_);
+  return NULL;
+}
+
+/*
+ * Decompress range of symbols from given file. Only blocks covering the range
+ * are decompressed, each of them on one of the worker threads. First block of
+ * each batch is decompressed by the main thread directly to the output and
+ * only the others are kept in memory until it is their turn.
+ *
+ * Streams are read without seeking. Their blocks are copied into temporary
+ * files, as the decoder may read ahead of the end of the block. Files with the
+ * block table read from standard input are staged in a temporary file first
+ * (table is at the end) and their blocks are then copied in the same way.
+ *
+ * @param  ifile__  Name of the input file (or NULL for standard input).
+ * @param  ifp__  Input file.
+ * @param  ofp__  Output file.
+ * @param  threads__  Number of worker threads.
+ * @param  start__  Position of the first output symbol.
+ * @param  length__  Maximal number of output symbols.
+ */
+static void main_decode(const char* ifile__, FILE* ifp__, FILE* ofp__,
+                        uint32_t threads__, uint64_t start__, uint64_t length__) {
+  uint32_t b, t, count, running;
+  long offset;
+  bool framed, staged, finished;
+  uint64_t position, end;
+  FILE* spool = NULL;
+  container_header header;
+  block_entry block;
+  block_entry* table;
+  block_decode_job* jobs;
+  pthread_t* workers;
+  output_writer writer;
+
+  MAIN_VERBOSE(
+    fprintf(stderr, "Starting decompression\n");
+  )
+
+  switch (Container_Header_Read(&header, ifp__)) {
+    case CONTAINER_OK:
+      break;
+    case CONTAINER_READ_ERROR:
+      FATAL("Cannot read header from the file");
+      break;
+    case CONTAINER_BAD_MAGIC:
+      FATAL("File was not compressed by this program");
+      break;
+    case CONTAINER_BAD_VERSION:
+      FATAL("File was compressed by unsupported version of the format");
+      break;
+    case CONTAINER_BAD_MODEL:
+      FATAL("File was compressed with different model parameters (see defines.h)");
+      break;
+  }
+  framed = (header.flags_ & CONTAINER_FLAG_FRAMED) != 0;
+  if (framed) {
+    table = NULL;
+    count = 0;
+  } else {
+    if (!(header.flags_ & CONTAINER_FLAG_BLOCK_TABLE))
+      FATAL("File has no block table");
+    if (ifile__ == NULL)
+      ifp__ = spool = spool_input_(ifp__);
+    table = Container_Table_Read(&count, ifp__);
+    if (spool != NULL)
+      rewind(spool);
+  }
+  staged = framed || spool != NULL;
+
+  jobs = (block_decode_job*) malloc_(threads__ * sizeof(block_decode_job));
+  workers = (pthread_t*) malloc_(threads__ * sizeof(pthread_t));
+  if (jobs == NULL || workers == NULL)
+    FATAL("Cannot allocate block jobs");
+
+  output_writer_init_(&writer, ofp__);
+  for (t = 0; t < threads__; t++) {
+    jobs[t].budget_ = header.budget_;
+    jobs[t].writer_ = (t == 0) ? &writer : NULL;
+    jobs[t].output_ = NULL;
+  }
+
+  end = (length__ > UINT64_MAX - start__) ? UINT64_MAX : start__ + length__;
+
   MAIN_VERBOSE(
-    printf("Finished decompression\n");
+    if (framed)
+      fprintf(stderr, "Decompressing stream with %u threads\n", threads__);
+    else
+      fprintf(stderr, "Decompressing %u blocks with %u threads\n", count, threads__);
+  )
+
+  b = 0;
+  position = 0;
+  offset = CONTAINER_HEADER_SIZE;
+  finished = false;
+  do {
+    /* assign next blocks overlapping the range to threads */
+    for (running = 0; running < threads__ && !finished && position < end; b++) {
+      block_decode_job* job = &(jobs[running]);
+      uint64_t block_end;
+
+      if (framed) {
+        if (!Container_Frame_Read(&block, ifp__))
+          FATAL("Cannot read frame from the stream");
+        finished = (block.symbols_ == 0);
+      } else {
+        finished = (b == count);
+        if (!finished)
+          block = table[b];
+      }
+      if (finished)
+        break;
+
+      block_end = position + block.symbols_;
+      if (block_end > start__) {
+        if (staged) {
+          job->fp_ = tmpfile();
+          if (job->fp_ == NULL)
+            FATAL("Cannot create temporary file for compressed block");
+          copy_bytes_(ifp__, job->fp_, block.size_);
+          rewind(job->fp_);
+        } else {
+          /* each worker reads the container through its own stream */
+          job->fp_ = fopen(ifile__, "rb");
+          if (job->fp_ == NULL || fseek(job->fp_, offset, SEEK_SET))
+            FATAL("Cannot open compressed block");
+        }
+
+        job->skip_ = (start__ > position) ? start__ - position : 0;
+        job->length_ = ((block_end < end) ? block_end : end) - position - job->skip_;
+
+        if (running) {
+          job->output_ = (char*) realloc_(job->output_, job->length_ * sizeof(char));
+          if (job->output_ == NULL)
+            FATAL("Cannot allocate block buffer");
+
+          if (pthread_create(&(workers[running]), NULL, block_decompress_worker_, job))
+            FATAL("Cannot start worker thread");
+        }
+        running++;
+      } else if (staged) {
+        copy_bytes_(ifp__, NULL, block.size_);
+      }
+
+      offset += block.size_;
+      position = block_end;
+    }
+
+    if (!running)
+      break;
+
+    block_decompress_worker_(&(jobs[0]));
+    output_writer_flush_(&writer);
+
+    /* output other blocks in their original order */
+    for (t = 1; t < running; t++) {
+      pthread_join(workers[t], NULL);
+      fwrite(jobs[t].output_, sizeof(char), jobs[t].length_, ofp__);
+    }
+  } while (true);
+
+  for (t = 0; t < threads__; t++)
+    free_(jobs[t].output_);
+  free_(jobs);
+  free_(workers);
+  free_(table);
+  if (spool != NULL)
+    fclose(spool);
+
+  MAIN_VERBOSE(
+    fprintf(stderr, "Finished decompression\n");
   )
 }
 
@@ -175,6 +645,14 @@ static void main_decode(FILE* ifp__, FILE* ofp__) {
 int main(int argc, char* argv[]) {
   int32_t i;
   bool expect_ofile = false;
+  unsigned long budget = 0;
+  unsigned long threads = 0;
+  unsigned long block_size = 0;
+  unsigned long long range_start = 0;
+  unsigned long long range_length = UINT64_MAX;
+  bool range = false;
+  bool stream = false;
+  char* end;
 
   char* ofile = NULL;
   char* ifile = NULL;
@@ -184,7 +662,7 @@ int main(int argc, char* argv[]) {
   compressor_mode mode = UNKNOWN;
 
   for (i = 1; i < argc; i++) {
-    if (argv[i][0] == '-') {
+    if (argv[i][0] == '-' && argv[i][1] != '\0') {
 
       /* raise an error if no file is given after -o flag */
       if (expect_ofile) {
@@ -202,9 +680,60 @@ int main(int argc, char* argv[]) {
         case 'o':
           expect_ofile = true;
           break;
+        case 'm':
+          if (i + 1 >= argc) {
+            fprintf(stderr, "Memory budget expected after -m\n");
+            usage(argv[0]);
+          }
+          budget = strtoul(argv[++i], &end, 10);
+          if (*end != '\0' || budget > UINT32_MAX) {
+            fprintf(stderr, "Invalid memory budget %s\n", argv[i]);
+            usage(argv[0]);
+          }
+          break;
+        case 'T':
+          if (i + 1 >= argc) {
+            fprintf(stderr, "Number of threads expected after -T\n");
+            usage(argv[0]);
+          }
+          threads = strtoul(argv[++i], &end, 10);
+          if (*end != '\0' || threads == 0 || threads > UINT32_MAX) {
+            fprintf(stderr, "Invalid number of threads %s\n", argv[i]);
+            usage(argv[0]);
+          }
+          break;
+        case 'B':
+          if (i + 1 >= argc) {
+            fprintf(stderr, "Block size expected after -B\n");
+            usage(argv[0]);
+          }
+          block_size = strtoul(argv[++i], &end, 10);
+          if (*end != '\0' || block_size == 0 || block_size >= LINE_POS_MAX) {
+            fprintf(stderr, "Invalid block size %s\n", argv[i]);
+            usage(argv[0]);
+          }
+          break;
         case 'h':
           usage(argv[0]);
           break;
+        case '-':
+          if (strcmp(argv[i], "--range")) {
+            fprintf(stderr, "Unexpected argument %s.\n", argv[i]);
+            usage(argv[0]);
+          }
+          if (i + 1 >= argc) {
+            fprintf(stderr, "Range expected after --range\n");
+            usage(argv[0]);
+          }
+          range_start = strtoull(argv[++i], &end, 10);
+          if (*end == ':')
+            range_length = strtoull(end + 1, &end, 10);
+          if (*end != '\0' || argv[i][0] == ':') {
+            fprintf(stderr, "Invalid range %s (expected start:length)\n", argv[i]);
+            usage(argv[0]);
+          }
+          range = true;
+          break;
         default:
           fprintf(stderr, "Unexpected argument %s.\n", argv[i]);
           usage(argv[0]);
@@ -241,7 +770,32 @@ int main(int argc, char* argv[]) {
     usage(argv[0]);
   }
 
-  if (mode == ENCODE)
+#if defined(SIMPLE_MEMORY)
+  if (budget) {
+    fprintf(stderr, "Memory budget cannot be used with SIMPLE_MEMORY model\n");
+    exit(EXIT_FAILURE);
+  }
+#endif
+
+  if (block_size && mode != ENCODE) {
+    fprintf(stderr, "Block size can be given only when encoding\n");
+    usage(argv[0]);
+  }
+  if (range && mode != DECODE) {
+    fprintf(stderr, "Range can be given only when decoding\n");
+    usage(argv[0]);
+  }
+
+#if defined(ENABLE_MEMORY_PROFILING)
+  if (threads > 1) {
+    fprintf(stderr, "Multiple threads cannot be used with ENABLE_MEMORY_PROFILING\n");
+    exit(EXIT_FAILURE);
+  }
+#endif
+
+  if (!strcmp(ifile, "-"))
+    ifp = stdin;
+  else if (mode == ENCODE)
     ifp = fopen(ifile, "r");
   else if (mode == DECODE)
     ifp = fopen(ifile, "rb");
@@ -251,7 +805,9 @@ int main(int argc, char* argv[]) {
     exit(EXIT_FAILURE);
   }
 
-  if (mode == ENCODE)
+  if (!strcmp(ofile, "-"))
+    ofp = stdout;
+  else if (mode == ENCODE)
     ofp = fopen(ofile, "wb");
   else if (mode == DECODE)
     ofp = fopen(ofile, "w");
@@ -262,19 +818,44 @@ int main(int argc, char* argv[]) {
     exit(EXIT_FAILURE);
   }
 
+  /* output which cannot be seeked (pipe) cannot end with the block table and so it gets a
+   * stream of blocks */
+  if (mode == ENCODE && !Container_Seekable(ofp))
+    stream = true;
+
+  /* block mode is used whenever any of its options is given */
+  if (mode == ENCODE && (threads || block_size || stream)) {
+    if (!threads)
+      threads = 1;
+    if (!block_size)
+      block_size = BLOCK_SIZE_DEFAULT;
+  }
+
   MAIN_VERBOSE(
-    printf("Mode: %s\n", mode_str[mode]);
-    printf("Input file: %s\n", ifile);
-    printf("Output file: %s\n", ofile);
+    fprintf(stderr, "Mode: %s\n", mode_str[mode]);
+    fprintf(stderr, "Input file: %s\n", ifile);
+    fprintf(stderr, "Output file: %s\n", ofile);
+    if (budget)
+      fprintf(stderr, "Memory budget: %lu MB\n", budget);
+    if (block_size)
+      fprintf(stderr, "Blocks: %lu symbols, %lu threads\n", block_size, threads);
+    else if (threads)
+      fprintf(stderr, "Threads: %lu\n", threads);
+    if (range)
+      fprintf(stderr, "Range: %llu:%llu\n", range_start, range_length);
   )
 
   init_memory_profiling();
   init_time_profiling();
 
-  if (mode == ENCODE)
-    main_encode(ifp, ofp);
+  if (mode == ENCODE && threads)
+    main_encode_blocks(ifp, ofp, (uint32_t) budget, (uint32_t) threads, (LinePos) block_size,
+                       stream);
+  else if (mode == ENCODE)
+    main_encode(ifp, ofp, (uint32_t) budget);
   else if (mode == DECODE)
-    main_decode(ifp, ofp);
+    main_decode(strcmp(ifile, "-") ? ifile : NULL, ifp, ofp, threads ? (uint32_t) threads : 1,
+                (uint64_t) range_start, (uint64_t) range_length);
 
   finish_time_profiling();
   finish_memory_profiling();
@@ -1,28 +1,225 @@
+/* madvise is not part of C99 */
+#define _DEFAULT_SOURCE
+
 #include "memory.h"
 
+#if defined(ENABLE_HUGE_PAGES) || defined(ENABLE_MAPPED_MEMORY)
+#include <sys/mman.h>
+#endif
+
+#if defined(ENABLE_MAPPED_MEMORY)
+#include <stdlib.h>
+#include <unistd.h>
+
+/*
+ * Open the backing file of mapped memory blocks.
+ *
+ * The file is unlinked right away so that it disappears when the program ends
+ * (no matter how it ends).
+ *
+ * @param  mem__  Reference to memory object.
+ */
+static void memory_map_open_(MemObj mem__) {
+  char path[] = MAPPED_MEMORY_DIR "/deBruijn-XXXXXX";
+
+  mem__->map_fd_ = mkstemp(path);
+  if (mem__->map_fd_ < 0)
+    FATAL("[memory]: Cannot create backing file in " MAPPED_MEMORY_DIR);
+  unlink(path);
+  mem__->map_size_ = 0;
+}
+
+/*
+ * Get size of the mapping holding a block of given size (whole pages).
+ *
+ * @param  size__  Size of the block in bytes.
+ */
+static size_t memory_map_size_(size_t size__) {
+  size_t page = (size_t) sysconf(_SC_PAGESIZE);
+
+  return (size__ + page - 1) & ~(page - 1);
+}
+
+/*
+ * Map new memory block from the end of the backing file.
+ *
+ * Blocks never move once mapped, so neither pointers nor indexes into them
+ * need any fixing. Pages are shared with the file and so the system can write
+ * them out and drop them when it runs out of memory.
+ *
+ * @param  mem__  Reference to memory object.
+ * @param  size__  Requested size in bytes.
+ */
+static void* memory_map_block_(MemObj mem__, size_t size__) {
+  void* block;
+
+  size__ = memory_map_size_(size__);
+  if (ftruncate(mem__->map_fd_, (off_t)(mem__->map_size_ + size__)))
+    FATAL("[memory]: Cannot extend backing file of mapped memory");
+
+  block = mmap(NULL, size__, PROT_READ | PROT_WRITE, MAP_SHARED, mem__->map_fd_,
+               (off_t) mem__->map_size_);
+  if (block == MAP_FAILED)
+    FATAL("[memory]: Cannot map memory block from backing file");
+
+  MEMORY_VERBOSE(
+    printf("[memory]: Mapped %zu bytes at file offset %zu\n", size__, mem__->map_size_);
+  )
+
+  mem__->map_size_ += size__;
+  return block;
+}
+
+#define MEMORY_BLOCK_ALLOC(mem__, size__) memory_map_block_(mem__, size__)
+#define MEMORY_BLOCK_FREE(block__, size__) munmap(block__, memory_map_size_(size__))
+
+#elif defined(ENABLE_BTREE_NODES) || defined(ENABLE_HUGE_PAGES)
+
+/*
+ * Allocate memory aligned to given boundary.
+ *
+ * Pointer to the whole allocation is kept just before the returned block.
+ *
+ * @param  size__  Requested size in bytes.
+ * @param  align__  Alignment (must be power of two).
+ */
+void* memory_aligned_alloc_(size_t size__, size_t align__) {
+  char* raw = (char*) malloc_(size__ + align__ + sizeof(void*));
+  uintptr_t block = ((uintptr_t)(raw + sizeof(void*)) + align__ - 1) &
+                    ~((uintptr_t) align__ - 1);
+
+  ((void**) block)[-1] = raw;
+  return (void*) block;
+}
+
+/*
+ * Free memory allocated with memory_aligned_alloc_.
+ *
+ * @param  block__  Pointer to the aligned block.
+ */
+void memory_aligned_free_(void* block__) {
+  free_(((void**) block__)[-1]);
+}
+
+/*
+ * Allocate memory block for nodes or leaves.
+ *
+ * Blocks are aligned to the cache line (so that B+ tree nodes don't cross it)
+ * and huge blocks are aligned to huge pages and backed by them if possible.
+ *
+ * @param  size__  Requested size in bytes.
+ */
+void* memory_block_alloc_(size_t size__) {
+#if defined(ENABLE_HUGE_PAGES)
+  if (size__ >= HUGE_PAGE_SIZE) {
+    void* block = memory_aligned_alloc_(size__, HUGE_PAGE_SIZE);
+
+#if defined(MADV_HUGEPAGE)
+    /* this is only an advice and nothing happens if it is not followed */
+    madvise(block, size__ & ~((size_t) HUGE_PAGE_SIZE - 1), MADV_HUGEPAGE);
+#endif
+    return block;
+  }
+#endif
+  return memory_aligned_alloc_(size__, CACHE_LINE_SIZE);
+}
+
+#define MEMORY_BLOCK_ALLOC(mem__, size__) memory_block_alloc_(size__)
+#define MEMORY_BLOCK_FREE(block__, size__) memory_aligned_free_(block__)
+
+#else  /* defined(ENABLE_MAPPED_MEMORY) */
+
+#define MEMORY_BLOCK_ALLOC(mem__, size__) malloc_(size__)
+#define MEMORY_BLOCK_FREE(block__, size__) free_(block__)
+
+#endif  /* defined(ENABLE_MAPPED_MEMORY) */
+
 #if defined(DIRECT_MEMORY) || defined(INDEXED_MEMORY)
 
-MemObj Memory_init(void) {
+#if defined(ENABLE_MEMORY_ARENA)
+
+/*
+ * Get log2 of the first arena block size for given expected number of elements.
+ *
+ * @param  count__  Expected number of elements (or 0 if unknown).
+ */
+static int32_t memory_block_log_(LinePos count__) {
+  int32_t log = MEMORY_BLOCK_SIZE_LOG_;
+
+  while (log < MEMORY_ARENA_MAX_LOG_ && ((LinePos) 0x1 << log) < count__)
+    log++;
+  return log;
+}
+
+#endif
+
+/*
+ * Get number of block pointers needed for given expected number of elements.
+ *
+ * @param  log__  log2 of the first block size (ignored without ENABLE_MEMORY_ARENA).
+ * @param  count__  Expected number of elements (or 0 if unknown).
+ */
+static int32_t memory_block_count_(int32_t log__, LinePos count__) {
+  int32_t blocks = 0;
+  LinePos capacity = 0;
+
+#if !defined(ENABLE_MEMORY_ARENA)
+  UNUSED(log__);
+#endif
+
+  /* there are never more elements than indexes */
+  if (count__ > MEMORY_MAX_ELEMENTS_)
+    count__ = MEMORY_MAX_ELEMENTS_;
+
+  while (capacity < count__)
+    capacity += MEMORY_BLOCK_ELEMENTS_(log__, blocks++);
+  return (blocks > INITIAL_BLOCK_COUNT_) ? blocks : INITIAL_BLOCK_COUNT_;
+}
+
+MemObj Memory_init(LinePos leafs__, LinePos nodes__) {
   MemObj mem = (memory_32e*) malloc_(sizeof(memory_32e));
 
+#if defined(ENABLE_MEMORY_ARENA)
+  mem->n_block_log_ = memory_block_log_(nodes__);
+  mem->l_block_log_ = memory_block_log_(leafs__);
+  mem->n_block_count_ = memory_block_count_(mem->n_block_log_, nodes__);
+  mem->l_block_count_ = memory_block_count_(mem->l_block_log_, leafs__);
+#else
+  mem->n_block_count_ = memory_block_count_(MEMORY_BLOCK_SIZE_LOG_, nodes__);
+  mem->l_block_count_ = memory_block_count_(MEMORY_BLOCK_SIZE_LOG_, leafs__);
+#endif
+
+#if defined(ENABLE_MAPPED_MEMORY)
+  memory_map_open_(mem);
+#endif
+
   /* initialize node and leaf blocks and first block */
-  mem->nodes_ = (NodeRef*) malloc_(INITIAL_BLOCK_COUNT_ * sizeof(NodeRef));
-  mem->leafs_ = (LeafRef*) malloc_(INITIAL_BLOCK_COUNT_ * sizeof(LeafRef));
+  mem->nodes_ = (NodeSlot**) malloc_(mem->n_block_count_ * sizeof(NodeSlot*));
+  mem->leafs_ = (LeafRef*) malloc_(mem->l_block_count_ * sizeof(LeafRef));
+
+  mem->nodes_[0] = (NodeSlot*) MEMORY_BLOCK_ALLOC(mem,
+      MEMORY_BLOCK_ELEMENTS_(mem->n_block_log_, 0) * sizeof(NodeSlot));
+  mem->leafs_[0] = (LeafRef) MEMORY_BLOCK_ALLOC(mem,
+      MEMORY_BLOCK_ELEMENTS_(mem->l_block_log_, 0) * sizeof(LeafStruct));
 
-  mem->nodes_[0] = (NodeRef) malloc_(MEMORY_BLOCK_SIZE_ * sizeof(node_32e));
-  mem->leafs_[0] = (LeafRef) malloc_(MEMORY_BLOCK_SIZE_ * sizeof(leaf_32e));
+#if defined(ENABLE_SPLIT_LEAVES)
+  mem->payloads_ = (PayloadRef*) malloc_(mem->l_block_count_ * sizeof(PayloadRef));
+  mem->payloads_[0] = (PayloadRef) MEMORY_BLOCK_ALLOC(mem,
+      MEMORY_BLOCK_ELEMENTS_(mem->l_block_log_, 0) * sizeof(leaf_payload));
+#endif
 
   /* initialize all counters */
-  mem->n_block_count_ = INITIAL_BLOCK_COUNT_;
   mem->n_current_block_ = 0;
   mem->n_current_block_index_ = 0;
   mem->n_last_index_ = -1;
 
-  mem->l_block_count_ = INITIAL_BLOCK_COUNT_;
   mem->l_current_block_ = 0;
   mem->l_current_block_index_ = 0;
   mem->l_last_index_ = -1;
 
+  mem->n_free_ = MEMORY_NULL;
+  mem->l_free_ = MEMORY_NULL;
+
   return mem;
 }
 
@@ -31,27 +228,65 @@ void Memory_free(MemObj* mem__) {
   MemObj mem = *mem__;
 
   for (i = 0; i <= mem->n_current_block_; i++)
-    free_(mem->nodes_[i]);
+    MEMORY_BLOCK_FREE(mem->nodes_[i],
+                      MEMORY_BLOCK_ELEMENTS_(mem->n_block_log_, i) * sizeof(NodeSlot));
   free_(mem->nodes_);
 
+#if defined(ENABLE_PACKED_FREQUENCY)
+  int32_t j, count;
+
+  /* free full width P vectors of all leaves which needed them */
+  for (i = 0; i <= mem->l_current_block_; i++) {
+    count = (i == mem->l_current_block_) ? mem->l_current_block_index_
+                                         : MEMORY_BLOCK_ELEMENTS_(mem->l_block_log_, i);
+    for (j = 0; j < count; j++) {
+      if (LEAF_PAYLOAD(&(mem->leafs_[i][j]))->wideP_ != NULL)
+        free_(LEAF_PAYLOAD(&(mem->leafs_[i][j]))->wideP_);
+    }
+  }
+#endif
+
   for (i = 0; i <= mem->l_current_block_; i++)
-    free_(mem->leafs_[i]);
+    MEMORY_BLOCK_FREE(mem->leafs_[i],
+                      MEMORY_BLOCK_ELEMENTS_(mem->l_block_log_, i) * sizeof(LeafStruct));
   free_(mem->leafs_);
 
+#if defined(ENABLE_SPLIT_LEAVES)
+  for (i = 0; i <= mem->l_current_block_; i++)
+    MEMORY_BLOCK_FREE(mem->payloads_[i],
+                      MEMORY_BLOCK_ELEMENTS_(mem->l_block_log_, i) * sizeof(leaf_payload));
+  free_(mem->payloads_);
+#endif
+
+#if defined(ENABLE_MAPPED_MEMORY)
+  close(mem->map_fd_);
+#endif
+
   free_(mem);
   mem__ = NULL;
 }
 
 MemPtr Memory_new_leaf(MemObj mem__) {
+  MemPtr leaf;
+
+  /* reuse released leaf first */
+  if (mem__->l_free_ != MEMORY_NULL) {
+    leaf = mem__->l_free_;
+    memcpy(&(mem__->l_free_), MEMORY_GET_LEAF(mem__, leaf), sizeof(MemPtr));
+    MAKE_LEAF(MEMORY_GET_LEAF(mem__, leaf));
+    return leaf;
+  }
+
 #if defined(INDEXED_MEMORY)
   /* Check if all memory was depleted. This is a limitation in the program design, and it is not
    * possible to continue if this happens. */
-  if (mem__->l_last_index_ >= 0x3FFFFFFF)
+  if (mem__->l_last_index_ >= MEMORY_MAX_ELEMENTS_)
     FATAL("[memory]: Reached maximum possible number of leafs");
 #endif
 
   /* check if we need new memory block */
-  if (mem__->l_current_block_index_ >= MEMORY_BLOCK_SIZE_) {
+  if (mem__->l_current_block_index_ >=
+      MEMORY_BLOCK_ELEMENTS_(mem__->l_block_log_, mem__->l_current_block_)) {
     MEMORY_VERBOSE(
       printf("[memory]: Creating new leaf memory block\n");
     )
@@ -65,18 +300,39 @@ MemPtr Memory_new_leaf(MemObj mem__) {
       /* realloc block memory */
       mem__->l_block_count_ *= 2;
       mem__->leafs_ = (LeafRef*) realloc_(mem__->leafs_, mem__->l_block_count_ * sizeof(LeafRef));
+#if defined(ENABLE_SPLIT_LEAVES)
+      mem__->payloads_ =
+          (PayloadRef*) realloc_(mem__->payloads_, mem__->l_block_count_ * sizeof(PayloadRef));
+#endif
     }
 
     /* allocate new memory block */
     mem__->l_current_block_index_ = 0;
-    mem__->leafs_[mem__->l_current_block_] =
-        (LeafRef) malloc_(MEMORY_BLOCK_SIZE_ * sizeof(leaf_32e));
+    mem__->leafs_[mem__->l_current_block_] = (LeafRef) MEMORY_BLOCK_ALLOC(mem__,
+        MEMORY_BLOCK_ELEMENTS_(mem__->l_block_log_, mem__->l_current_block_) * sizeof(LeafStruct));
+#if defined(ENABLE_SPLIT_LEAVES)
+    mem__->payloads_[mem__->l_current_block_] = (PayloadRef) MEMORY_BLOCK_ALLOC(mem__,
+        MEMORY_BLOCK_ELEMENTS_(mem__->l_block_log_, mem__->l_current_block_) * sizeof(leaf_payload));
+#endif
   }
 
+#if defined(ENABLE_SPLIT_LEAVES)
+  /* payload has the same position in the parallel arena */
+  mem__->leafs_[mem__->l_current_block_][mem__->l_current_block_index_].payload_ =
+      &(mem__->payloads_[mem__->l_current_block_][mem__->l_current_block_index_]);
+#endif
+
+#if defined(ENABLE_PACKED_FREQUENCY)
+  /* Memory_free checks this even in leaves which were never cleared */
+  LEAF_PAYLOAD(&(mem__->leafs_[mem__->l_current_block_][mem__->l_current_block_index_]))->wideP_ =
+      NULL;
+#endif
+
   /* return MemPtr reference */
+  mem__->l_last_index_++;
 #if defined(INDEXED_MEMORY)
   mem__->l_current_block_index_++;
-  return ((++mem__->l_last_index_) << 1) | 0x1;
+  return (mem__->l_last_index_ << 1) | 0x1;
 #elif defined(DIRECT_MEMORY)
   MAKE_LEAF(&(mem__->leafs_[mem__->l_current_block_][mem__->l_current_block_index_++]));
   return (MemPtr)(&(mem__->leafs_[mem__->l_current_block_][mem__->l_current_block_index_ - 1]));
@@ -84,15 +340,26 @@ MemPtr Memory_new_leaf(MemObj mem__) {
 }
 
 MemPtr Memory_new_node(MemObj mem__) {
+  MemPtr node;
+
+  /* reuse released node first */
+  if (mem__->n_free_ != MEMORY_NULL) {
+    node = mem__->n_free_;
+    memcpy(&(mem__->n_free_), MEMORY_GET_NODE(mem__, node), sizeof(MemPtr));
+    MAKE_NODE(MEMORY_GET_NODE(mem__, node));
+    return node;
+  }
+
 #if defined(INDEXED_MEMORY)
   /* Check if all memory was depleted. This is a limitation in the program design, and it is not
    * possible to continue if this happens. */
-  if (mem__->n_last_index_ >= 0x3FFFFFFF)
+  if (mem__->n_last_index_ >= MEMORY_MAX_ELEMENTS_)
     FATAL("[memory]: Reached maximum possible number of nodes");
 #endif
 
   /* check if we need new memory block */
-  if (mem__->n_current_block_index_ >= MEMORY_BLOCK_SIZE_) {
+  if (mem__->n_current_block_index_ >=
+      MEMORY_BLOCK_ELEMENTS_(mem__->n_block_log_, mem__->n_current_block_)) {
     MEMORY_VERBOSE(
       printf("[memory]: Creating new node memory block\n");
     )
@@ -105,28 +372,50 @@ MemPtr Memory_new_node(MemObj mem__) {
 
       /* realloc block memory */
       mem__->n_block_count_ *= 2;
-      mem__->nodes_ = (NodeRef*) realloc_(mem__->nodes_, mem__->n_block_count_ * sizeof(NodeRef));
+      mem__->nodes_ = (NodeSlot**) realloc_(mem__->nodes_, mem__->n_block_count_ * sizeof(NodeSlot*));
     }
 
     /* allocate new memory block */
     mem__->n_current_block_index_ = 0;
-    mem__->nodes_[mem__->n_current_block_] =
-        (NodeRef) malloc_(MEMORY_BLOCK_SIZE_ * sizeof(node_32e));
+    mem__->nodes_[mem__->n_current_block_] = (NodeSlot*) MEMORY_BLOCK_ALLOC(mem__,
+        MEMORY_BLOCK_ELEMENTS_(mem__->n_block_log_, mem__->n_current_block_) * sizeof(NodeSlot));
   }
 
   /* return MemPtr reference */
+  mem__->n_last_index_++;
 #if defined(INDEXED_MEMORY)
   mem__->n_current_block_index_++;
-  return (++mem__->n_last_index_) << 1;
+  return mem__->n_last_index_ << 1;
 #elif defined(DIRECT_MEMORY)
-  MAKE_NODE(&(mem__->nodes_[mem__->n_current_block_][mem__->n_current_block_index_++]));
+  MAKE_NODE((NodeRef) &(mem__->nodes_[mem__->n_current_block_][mem__->n_current_block_index_++]));
   return (MemPtr)(&(mem__->nodes_[mem__->n_current_block_][mem__->n_current_block_index_ - 1]));
 #endif
 }
 
+void Memory_free_leaf(MemObj mem__, MemPtr leaf__) {
+  LeafRef leaf_ref = MEMORY_GET_LEAF(mem__, leaf__);
+
+#if defined(ENABLE_PACKED_FREQUENCY)
+  if (LEAF_PAYLOAD(leaf_ref)->wideP_ != NULL) {
+    free_(LEAF_PAYLOAD(leaf_ref)->wideP_);
+    LEAF_PAYLOAD(leaf_ref)->wideP_ = NULL;
+  }
+#endif
+
+  memcpy(leaf_ref, &(mem__->l_free_), sizeof(MemPtr));
+  mem__->l_free_ = leaf__;
+}
+
+void Memory_free_node(MemObj mem__, MemPtr node__) {
+  memcpy(MEMORY_GET_NODE(mem__, node__), &(mem__->n_free_), sizeof(MemPtr));
+  mem__->n_free_ = node__;
+}
+
 #else  /* defined(DIRECT_MEMORY) || defined(INDEXED_MEMORY) */
 
-MemObj Memory_init(void) {
+MemObj Memory_init(LinePos leafs__, LinePos nodes__) {
+  UNUSED(leafs__);
+  UNUSED(nodes__);
   return NULL;
 }
 
@@ -138,17 +427,40 @@ void Memory_free(MemObj* mem__) {
 MemPtr Memory_new_leaf(MemObj mem__) {
   UNUSED(mem__);
 
-  MemPtr leaf = (MemPtr) malloc_(sizeof(leaf_32e));
+  LeafRef leaf = (LeafRef) malloc_(sizeof(LeafStruct));
+#if defined(ENABLE_SPLIT_LEAVES)
+  leaf->payload_ = (PayloadRef) malloc_(sizeof(leaf_payload));
+#endif
   MAKE_LEAF(leaf);
-  return leaf;
+  return (MemPtr) leaf;
 }
 
 MemPtr Memory_new_node(MemObj mem__) {
   UNUSED(mem__);
 
-  MemPtr node = (MemPtr) malloc_(sizeof(node_32e));
+  MemPtr node = (MemPtr) MEMORY_BLOCK_ALLOC(mem__, sizeof(NodeSlot));
   MAKE_NODE(node);
   return node;
 }
 
+void Memory_free_leaf(MemObj mem__, MemPtr leaf__) {
+  LeafRef leaf_ref = MEMORY_GET_LEAF(mem__, leaf__);
+
+  UNUSED(mem__);
+
+#if defined(ENABLE_PACKED_FREQUENCY)
+  if (LEAF_PAYLOAD(leaf_ref)->wideP_ != NULL)
+    free_(LEAF_PAYLOAD(leaf_ref)->wideP_);
+#endif
+#if defined(ENABLE_SPLIT_LEAVES)
+  free_(leaf_ref->payload_);
+#endif
+  free_(leaf_ref);
+}
+
+void Memory_free_node(MemObj mem__, MemPtr node__) {
+  UNUSED(mem__);
+  MEMORY_BLOCK_FREE(node__, sizeof(NodeSlot));
+}
+
 #endif  /* defined(DIRECT_MEMORY) || defined(INDEXED_MEMORY) */
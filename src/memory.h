@@ -1,36 +1,88 @@
 #ifndef _COMPRESSION_MEMORY__
 #define _COMPRESSION_MEMORY__
 
+#include <inttypes.h>
 #include <limits.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <string.h>
 
 #include "defines.h"
 #include "utils.h"
 
+/* types of line positions and line counters (unsigned and signed) */
+#if defined(ENABLE_64BIT_POSITIONS)
+  #define LinePos uint64_t
+  #define LineIdx int64_t
+  #define PRI_POS PRIu64
+  #define PRI_IDX PRId64
+  #define LINE_POS_MAX UINT64_MAX
+#else
+  #define LinePos uint32_t
+  #define LineIdx int32_t
+  #define PRI_POS PRIu32
+  #define PRI_IDX PRId32
+  #define LINE_POS_MAX UINT32_MAX
+#endif
+
+/* highest bit of line counter (used for flags with EMBEDED_FLAGS) */
+#define COUNTER_FLAG ((LinePos) 0x1 << (sizeof(LinePos) * 8 - 1))
+
 #define MEMORY_VERBOSE(func) \
   if (MEMORY_VERBOSE_) {     \
     func                     \
   }
 
+/* number of elements in given memory block */
+#if defined(ENABLE_MEMORY_ARENA)
+  #define MEMORY_BLOCK_ELEMENTS_(log, block) ((int32_t) 0x1 << ((log) + (block)))
+#else
+  #define MEMORY_BLOCK_ELEMENTS_(log, block) MEMORY_BLOCK_SIZE_
+#endif
+
+/* maximum number of elements of one type (upper index bits are flags) */
+#define MEMORY_MAX_ELEMENTS_ 0x3FFFFFFF
+
 /* definitions for indexed memory model */
 #if defined(INDEXED_MEMORY)
 
 #define MEMORY_GET_ANY(mem, arg)                            \
   ((NodeRef)((arg & 0x1) ? (void*)MEMORY_GET_LEAF(mem, arg) \
                          : (void*)MEMORY_GET_NODE(mem, arg)))
-#define MEMORY_GET_NODE(mem, arg)                              \
-  (NodeRef)(&(mem->nodes_[arg >> (MEMORY_BLOCK_SIZE_LOG_ + 1)] \
-                         [(arg >> 1) & (MEMORY_BLOCK_SIZE_ - 1)]))
-#define MEMORY_GET_LEAF(mem, arg)                              \
-  (LeafRef)(&(mem->leafs_[arg >> (MEMORY_BLOCK_SIZE_LOG_ + 1)] \
-                         [(arg >> 1) & (MEMORY_BLOCK_SIZE_ - 1)]))
+
+#if defined(ENABLE_MEMORY_ARENA)
+
+/* Block b of the arena starts at index (2^b - 1) << log, so index shifted by the
+ * size of the first block has block number in its highest bit and index inside
+ * the block in the remaining ones. */
+#define MEMORY_ARENA_SLOT_(log, arg) (((uint32_t) (arg) >> 1) + ((uint32_t) 0x1 << (log)))
+#define MEMORY_ARENA_GET_(blocks, log, arg)                                         \
+  (&((blocks)[31 - __builtin_clz(MEMORY_ARENA_SLOT_(log, arg)) - (log)]             \
+             [MEMORY_ARENA_SLOT_(log, arg) &                                        \
+              (0x7FFFFFFFu >> __builtin_clz(MEMORY_ARENA_SLOT_(log, arg)))]))
+
+#define MEMORY_GET_NODE(mem, arg) \
+  ((NodeRef) MEMORY_ARENA_GET_(mem->nodes_, mem->n_block_log_, arg))
+#define MEMORY_GET_LEAF(mem, arg) \
+  ((LeafRef) MEMORY_ARENA_GET_(mem->leafs_, mem->l_block_log_, arg))
+
+#else  /* defined(ENABLE_MEMORY_ARENA) */
+
+#define MEMORY_GET_NODE(mem, arg)                               \
+  ((NodeRef)(&(mem->nodes_[arg >> (MEMORY_BLOCK_SIZE_LOG_ + 1)] \
+                          [(arg >> 1) & (MEMORY_BLOCK_SIZE_ - 1)])))
+#define MEMORY_GET_LEAF(mem, arg)                               \
+  ((LeafRef)(&(mem->leafs_[arg >> (MEMORY_BLOCK_SIZE_LOG_ + 1)] \
+                          [(arg >> 1) & (MEMORY_BLOCK_SIZE_ - 1)])))
+
+#endif  /* defined(ENABLE_MEMORY_ARENA) */
 
 #define MAKE_NODE(arg) {}
 #define MAKE_LEAF(arg) {}
 #define IS_LEAF(arg) (arg & 0x1)
 
 #define MemPtr int32_t
+#define MEMORY_NULL -1
 
 /* definitions for direct memory model */
 #elif (defined(SIMPLE_MEMORY) || defined(DIRECT_MEMORY))  /* defined(INDEXED_MEMORY) */
@@ -41,9 +93,9 @@
 
 #if defined(EMBEDED_FLAGS)
 
-#define MAKE_NODE(arg) (arg)->rW_[5] &= 0x7FFFFFFF
-#define MAKE_LEAF(arg) (arg)->rW_[5] |= 0x80000000
-#define IS_LEAF(arg) (((arg)->rW_[5]) & 0x80000000)
+#define MAKE_NODE(arg) (arg)->rW_[5] &= ~COUNTER_FLAG
+#define MAKE_LEAF(arg) (arg)->rW_[5] |= COUNTER_FLAG
+#define IS_LEAF(arg) (((arg)->rW_[5]) & COUNTER_FLAG)
 
 #else  /* defined(EMBEDED_FLAGS) */
 
@@ -54,18 +106,19 @@
 #endif  /* defined(EMBEDED_FLAGS) */
 
 #define MemPtr struct node_32e*
+#define MEMORY_NULL NULL
 
 #endif  /* defined(INDEXED_MEMORY) */
 
 
 #if defined(EMBEDED_FLAGS)
 
-#define IS_RED(arg) (((arg)->rW_[6]) & 0x80000000)
-#define MAKE_RED(arg) (arg)->rW_[6] |= 0x80000000
-#define MAKE_BLACK(arg) (arg)->rW_[6] &= 0x7FFFFFFF
+#define IS_RED(arg) (((arg)->rW_[6]) & COUNTER_FLAG)
+#define MAKE_RED(arg) (arg)->rW_[6] |= COUNTER_FLAG
+#define MAKE_BLACK(arg) (arg)->rW_[6] &= ~COUNTER_FLAG
 
 #define GET_RVECTOR(arg, idx) \
-  ((idx == 5 || idx == 6) ? ((arg->rW_[idx]) & 0x7FFFFFFF) : (arg->rW_[idx]))
+  ((idx == 5 || idx == 6) ? ((arg->rW_[idx]) & ~COUNTER_FLAG) : (arg->rW_[idx]))
 
 #else  /* defined(EMBEDED_FLAGS) */
 
@@ -78,12 +131,69 @@
 #endif  /* defined(EMBEDED_FLAGS) */
 
 
+#if defined(ENABLE_BTREE_NODES)
+
+/* counters summed over the first few children of B+ tree node */
+typedef struct {
+  LinePos rL_;
+  LinePos rW_[8];
+  LinePos f_[4];
+} node_prefix;
+
+/*
+ * Internal node of B+ tree variant of the structure.
+ *
+ * Header is the same as in the binary node (and the leaf) and it holds counters
+ * of the whole subtree. For the tree traversal there are inclusive prefix sums
+ * of children counters. Position prefix sums are kept in separate array so
+ * that the search for the correct child touches only one or two cache lines.
+ */
 typedef struct node_32e {
-  uint32_t p_;  /* shared counter for total number of elements */
-  uint32_t rL_; /* number of set bits in L vector */
+  LinePos p_;  /* shared counter for total number of elements */
+  LinePos rL_; /* number of set bits in L vector */
 
   /* number of set bits in all W vectors */
-  uint32_t rW_[8];
+  LinePos rW_[8];
+
+  /* sum of P values of lines with each symbol in W (A, C, G, T) */
+  LinePos f_[4];
+
+#if (defined(SIMPLE_MEMORY) || defined(DIRECT_MEMORY)) && (!defined(EMBEDED_FLAGS))
+  Bool32 is_leaf;
+#endif
+
+  uint32_t count_; /* number of children */
+
+  LinePos pre_p_[BTREE_FANOUT];       /* p_ counters of children 0..i */
+  node_prefix prefix_[BTREE_FANOUT];  /* other counters of children 0..i */
+  MemPtr children_[BTREE_FANOUT];
+
+#if defined(INTEGER_CONTEXT_SHORTENING)
+  uint8_t min_csl_; /* minimal common suffix length in the whole subtree */
+  uint8_t child_csl_[BTREE_FANOUT]; /* minimal common suffix length of each child */
+#endif
+} node_32e;
+
+/* Nodes are stored in slots padded to whole cache lines, so that nodes in
+ * blocks aligned to the cache line never cross more lines than needed. */
+typedef union {
+  node_32e node_;
+  uint8_t lines_[(sizeof(node_32e) + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE];
+} node_slot;
+
+#define NodeSlot node_slot
+
+#else  /* defined(ENABLE_BTREE_NODES) */
+
+typedef struct node_32e {
+  LinePos p_;  /* shared counter for total number of elements */
+  LinePos rL_; /* number of set bits in L vector */
+
+  /* number of set bits in all W vectors */
+  LinePos rW_[8];
+
+  /* sum of P values of lines with each symbol in W (A, C, G, T) */
+  LinePos f_[4];
 
   /*
    * Highest bits of r5 and r6 are used as a flags for red black tree balancing algorithm and the
@@ -105,32 +215,101 @@ typedef struct node_32e {
 #if !defined(EMBEDED_FLAGS)
   Bool32 rb_flag_; /* red/black node flag */
 #endif
+
+#if defined(INTEGER_CONTEXT_SHORTENING)
+  uint8_t min_csl_; /* minimal common suffix length in the whole subtree */
+#endif
 } node_32e;
 
+#define NodeSlot node_32e
+
+#endif  /* defined(ENABLE_BTREE_NODES) */
+
+/* leaf holds one machine word of lines in each bit vector */
+#if defined(ENABLE_LEAF_64)
+  #define LEAF_SIZE 64
+  #define LeafVector uint64_t
+  #define LeafStruct leaf_64e
+#else
+  #define LEAF_SIZE 32
+  #define LeafVector uint32_t
+  #define LeafStruct leaf_32e
+#endif
+#define LEAF_HALF (LEAF_SIZE / 2)
+
+/* csl values are packed into the smallest power of two bit fields which can
+ * hold all values up to CONTEXT_LENGTH (there are as many leaf vectors as bits
+ * in one field) */
+#if defined(INTEGER_CONTEXT_SHORTENING)
+  #if CONTEXT_LENGTH < 4
+    #define LEAF_CSL_BITS 2
+  #elif CONTEXT_LENGTH < 16
+    #define LEAF_CSL_BITS 4
+  #else
+    #define LEAF_CSL_BITS 8
+  #endif
+#endif
+
+/* leaf data not needed for tree traversal, rank and select */
 typedef struct {
-  uint32_t p_;  /* shared counter for total number of elements */
-  uint32_t rL_; /* number of set bits in L vector */
+#if defined(ENABLE_PACKED_FREQUENCY)
+  uint8_t vectorP_[LEAF_SIZE];
+  uint32_t* wideP_; /* full width P vector (or NULL when all values fit above) */
+#else
+  uint32_t vectorP_[LEAF_SIZE];
+#endif
+
+#if defined(INTEGER_CONTEXT_SHORTENING)
+  LeafVector context_[LEAF_CSL_BITS];
+#endif
+} leaf_payload;
+
+typedef struct {
+  LinePos p_;  /* shared counter for total number of elements */
+  LinePos rL_; /* number of set bits in L vector */
 
   /* number of set bits in all W vectors */
-  uint32_t rW_[8];
+  LinePos rW_[8];
+
+  /* sum of P values of lines with each symbol in W (A, C, G, T) */
+  LinePos f_[4];
 
 #if (defined(SIMPLE_MEMORY) || defined(DIRECT_MEMORY)) && (!defined(EMBEDED_FLAGS))
   Bool32 is_leaf;
 #endif
 
   /* all graph data vectors */
-  uint32_t vectorL_;
-  uint32_t vectorW_[4];
-  uint32_t vectorP_[32];
+  LeafVector vectorL_;
+  LeafVector vectorW_[4];
 
 #if defined(INTEGER_CONTEXT_SHORTENING)
-  uint8_t context_[32];
+  uint8_t min_csl_; /* minimal common suffix length of all lines */
 #endif
 
-} leaf_32e;
+#if defined(ENABLE_SPLIT_LEAVES)
+  leaf_payload* payload_; /* payload in the parallel arena */
+#else
+  leaf_payload payload_;
+#endif
+} LeafStruct;
 
 #define NodeRef node_32e*
-#define LeafRef leaf_32e*
+#define LeafRef LeafStruct*
+#define PayloadRef leaf_payload*
+
+#if defined(ENABLE_SPLIT_LEAVES)
+  #define LEAF_PAYLOAD(leaf) ((leaf)->payload_)
+#else
+  #define LEAF_PAYLOAD(leaf) (&((leaf)->payload_))
+#endif
+
+/* Zero all counters, vectors and payload of given leaf. */
+#define MEMORY_CLEAR_LEAF(leaf) {                            \
+    PayloadRef payload = LEAF_PAYLOAD(leaf);                 \
+                                                             \
+    memset(payload, 0, sizeof(leaf_payload));                \
+    memset(&((leaf)->p_), 0, offsetof(LeafStruct, payload_)); \
+  }
 
 #if defined(SIMPLE_MEMORY)
 
@@ -141,8 +320,11 @@ typedef struct {
 #else  /* defined(SIMPLE_MEMORY) */
 
 typedef struct {
-  NodeRef* nodes_;
+  NodeSlot** nodes_;
   LeafRef* leafs_;
+#if defined(ENABLE_SPLIT_LEAVES)
+  PayloadRef* payloads_; /* payload blocks (parallel to leaf blocks) */
+#endif
 
   int32_t n_block_count_;         /* number of allocated block pointers */
   int32_t n_current_block_;       /* index of current block */
@@ -153,6 +335,21 @@ typedef struct {
   int32_t l_current_block_;       /* index of current block */
   int32_t l_current_block_index_; /* index inside current block (first free if possible) */
   int32_t l_last_index_;          /* last global index (without bitshift) */
+
+#if defined(ENABLE_MEMORY_ARENA)
+  int32_t n_block_log_;           /* log2 of number of elements in the first node block */
+  int32_t l_block_log_;           /* log2 of number of elements in the first leaf block */
+#endif
+
+  /* Released elements are chained through their first bytes and reused
+   * before any new ones (MEMORY_NULL if there are none). */
+  MemPtr n_free_;                 /* first released node */
+  MemPtr l_free_;                 /* first released leaf */
+
+#if defined(ENABLE_MAPPED_MEMORY)
+  int map_fd_;                    /* backing file of all blocks */
+  size_t map_size_;               /* size of the backing file */
+#endif
 } memory_32e;
 
 #endif  /* defined(SIMPLE_MEMORY) */
@@ -162,9 +359,15 @@ typedef struct {
 /*
  * Initialize and return memory object.
  *
+ * Expected numbers of elements are only hints for the size of the first memory
+ * arena blocks and for the number of reserved block pointers.
+ *
+ * @param  leafs__  Expected number of leaves (or 0 if unknown).
+ * @param  nodes__  Expected number of internal nodes (or 0 if unknown).
+ *
  * @return  Reference to memory object.
  */
-MemObj Memory_init(void);
+MemObj Memory_init(LinePos leafs__, LinePos nodes__);
 
 /*
  * Free all memory associated with given memory object.
@@ -190,4 +393,20 @@ MemPtr Memory_new_leaf(MemObj mem__);
  */
 MemPtr Memory_new_node(MemObj mem__);
 
+/*
+ * Release memory leaf so that it can be reused by Memory_new_leaf.
+ *
+ * @param  mem__  Reference to memory object.
+ * @param  leaf__  Released leaf.
+ */
+void Memory_free_leaf(MemObj mem__, MemPtr leaf__);
+
+/*
+ * Release memory internal node so that it can be reused by Memory_new_node.
+ *
+ * @param  mem__  Reference to memory object.
+ * @param  node__  Released node.
+ */
+void Memory_free_node(MemObj mem__, MemPtr node__);
+
 #endif
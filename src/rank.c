@@ -1,8 +1,9 @@
 #include "structure.h"
 
 
-int32_t graph_rank_simple_(Graph_Struct Graph__, uint32_t pos__, int32_t type__) {
-  int32_t i, limit, rank;
+LineIdx graph_rank_simple_(Graph_Struct Graph__, LinePos pos__, int32_t type__) {
+  int32_t limit;
+  LineIdx rank;
   MemPtr current;
 
   current = Graph__.root_;
@@ -24,12 +25,29 @@ int32_t graph_rank_simple_(Graph_Struct Graph__, uint32_t pos__, int32_t type__)
   }
 
   /* traverse the tree and enter correct leaf */
+#if defined(ENABLE_BTREE_NODES)
+  uint32_t idx;
+  UNUSED(left_child);
+
+  while (!IS_LEAF(current)) {
+    node_ref = MEMORY_GET_NODE(Graph__.mem_, current);
+
+    /* find first child whose prefix covers whole query */
+    for (idx = 0; idx + 1 < node_ref->count_ && node_ref->pre_p_[idx] < pos__; idx++) {}
+    pos__ -= BTREE_PREFIX_P(node_ref, idx);
+    if (type__ == VECTOR_L)
+      rank += BTREE_PREFIX(node_ref, idx, rL_);
+    else if (type__ == VECTOR_W0)
+      rank += BTREE_PREFIX(node_ref, idx, rW_[0]);
+    current = node_ref->children_[idx];
+  }
+#else
   while (!IS_LEAF(current)) {
     node_ref = MEMORY_GET_NODE(Graph__.mem_, current);
     left_child = MEMORY_GET_ANY(Graph__.mem_, node_ref->left_);
 
     /* get p_ counter of left child and act accordingly */
-    if ((uint32_t) left_child->p_ >= pos__) {
+    if ((LinePos) left_child->p_ >= pos__) {
       current = node_ref->left_;
     } else {
       pos__ -= left_child->p_;
@@ -41,24 +59,25 @@ int32_t graph_rank_simple_(Graph_Struct Graph__, uint32_t pos__, int32_t type__)
         rank += GET_RVECTOR(left_child, 0);
     }
   }
+#endif
   leaf_ref = MEMORY_GET_LEAF(Graph__.mem_, current);
 
   /* handle last leaf of this query */
-  limit = (pos__ <= 32) ? pos__ : 32;
+  limit = (pos__ <= LEAF_SIZE) ? pos__ : LEAF_SIZE;
   if (type__ == VECTOR_L)
-    for (i = 0; i < limit; i++)
-      rank += (leaf_ref->vectorL_ >> (31 - i)) & 0x1;
+    rank += RANK(leaf_ref->vectorL_ & LEAF_PREFIX(limit));
   else if (type__ == VECTOR_W0)
-    for (i = 0; i < limit; i++)
-      rank += (leaf_ref->vectorW_[0] >> (31 - i)) & 0x1;
+    rank += RANK(leaf_ref->vectorW_[0] & LEAF_PREFIX(limit));
 
   return rank;
 }
 
-int32_t graph_rank_masked_(Graph_Struct Graph__, uint32_t pos__, int32_t type__) {
+#if !defined(ENABLE_BTREE_NODES)
+
+LineIdx graph_rank_masked_(Graph_Struct Graph__, LinePos pos__, int32_t type__) {
 
-  int32_t i, temp, rank;
-  int32_t vector, local_p, mask;
+  LineIdx temp, rank, local_p;
+  LeafVector vector, mask;
 
   MemPtr current = Graph__.root_;
   rank = 0;
@@ -72,31 +91,31 @@ int32_t graph_rank_masked_(Graph_Struct Graph__, uint32_t pos__, int32_t type__)
   node_ref = MEMORY_GET_ANY(Graph__.mem_, current);
   if (type__ == VECTOR_W1) {
     local_p = node_ref->p_ - GET_RVECTOR(node_ref, 0);
-    if (pos__ >= (uint32_t) local_p)
+    if (pos__ >= (LinePos) local_p)
       return GET_RVECTOR(node_ref, 1);
   } else if (type__ == VECTOR_W2) {
     local_p = GET_RVECTOR(node_ref, 0);
-    if (pos__ >= (uint32_t) local_p)
+    if (pos__ >= (LinePos) local_p)
       return GET_RVECTOR(node_ref, 2);
   } else if (type__ == VECTOR_W3) {
     local_p = node_ref->p_ - GET_RVECTOR(node_ref, 0) - GET_RVECTOR(node_ref, 1);
-    if (pos__ >= (uint32_t) local_p)
+    if (pos__ >= (LinePos) local_p)
       return GET_RVECTOR(node_ref, 3);
   } else if (type__ == VECTOR_W4) {
     local_p = GET_RVECTOR(node_ref, 1);
-    if (pos__ >= (uint32_t) local_p)
+    if (pos__ >= (LinePos) local_p)
       return GET_RVECTOR(node_ref, 4);
   } else if (type__ == VECTOR_W5) {
     local_p = GET_RVECTOR(node_ref, 0) - GET_RVECTOR(node_ref, 2);
-    if (pos__ >= (uint32_t) local_p)
+    if (pos__ >= (LinePos) local_p)
       return GET_RVECTOR(node_ref, 5);
   } else if (type__ == VECTOR_W6) {
     local_p = GET_RVECTOR(node_ref, 2);
-    if (pos__ >= (uint32_t) local_p)
+    if (pos__ >= (LinePos) local_p)
       return GET_RVECTOR(node_ref, 6);
   } else if (type__ == VECTOR_W7) {
     local_p = GET_RVECTOR(node_ref, 6);
-    if (pos__ >= (uint32_t) local_p)
+    if (pos__ >= (LinePos) local_p)
       return GET_RVECTOR(node_ref, 7);
   }
 
@@ -122,7 +141,7 @@ int32_t graph_rank_masked_(Graph_Struct Graph__, uint32_t pos__, int32_t type__)
       temp = GET_RVECTOR(left_child, 6);
     }
 
-    if ((uint32_t) temp >= pos__) {
+    if ((LinePos) temp >= pos__) {
       current = node_ref->left_;
     } else {
       pos__ -= temp;
@@ -171,18 +190,17 @@ int32_t graph_rank_masked_(Graph_Struct Graph__, uint32_t pos__, int32_t type__)
         leaf_ref->vectorW_[3];
     mask = leaf_ref->vectorW_[0] & leaf_ref->vectorW_[1] & leaf_ref->vectorW_[2];
   }
-  for (i = 0; pos__; i++) {
-    if ((mask >> (31 - i)) & 0x1) {
-      rank += (vector >> (31 - i)) & 0x1;
-      pos__--;
-    }
-  }
+  /* count set bits on first pos__ lines selected by the mask */
+  if (pos__)
+    rank += RANK(vector & LEAF_PREFIX(graph_leaf_select_(mask, pos__) + 1));
   return rank;
 }
 
-int32_t graph_fast_rank_masked_(Graph_Struct Graph__, uint32_t pos__, bool zero__, int32_t type__) {
-  int32_t i, rank, total;
-  int32_t vector, local_p, mask;
+#endif  /* !defined(ENABLE_BTREE_NODES) */
+
+LineIdx graph_fast_rank_masked_(Graph_Struct Graph__, LinePos pos__, bool zero__, int32_t type__) {
+  LineIdx rank, total, local_p;
+  LeafVector vector, mask;
 
   MemPtr current = Graph__.root_;
   rank = 0;
@@ -196,48 +214,64 @@ int32_t graph_fast_rank_masked_(Graph_Struct Graph__, uint32_t pos__, bool zero_
 
   node_ref = MEMORY_GET_ANY(Graph__.mem_, current);
   if (type__ == VECTOR_W1) {
-    if (pos__ >= (uint32_t) node_ref->p_) {
+    if (pos__ >= (LinePos) node_ref->p_) {
       local_p = node_ref->p_ - GET_RVECTOR(node_ref, 0);
       return (zero__) ? local_p - GET_RVECTOR(node_ref, 1) : GET_RVECTOR(node_ref, 1);
     }
   } else if (type__ == VECTOR_W2) {
-    if (pos__ >= (uint32_t) node_ref->p_) {
+    if (pos__ >= (LinePos) node_ref->p_) {
       local_p = GET_RVECTOR(node_ref, 0);
       return (zero__) ? local_p - GET_RVECTOR(node_ref, 2) : GET_RVECTOR(node_ref, 2);
     }
   } else if (type__ == VECTOR_W3) {
-    if (pos__ >= (uint32_t) node_ref->p_) {
+    if (pos__ >= (LinePos) node_ref->p_) {
       local_p = node_ref->p_ - GET_RVECTOR(node_ref, 0) - GET_RVECTOR(node_ref, 1);
       return (zero__) ? local_p - GET_RVECTOR(node_ref, 3) : GET_RVECTOR(node_ref, 3);
     }
   } else if (type__ == VECTOR_W4) {
-    if (pos__ >= (uint32_t) node_ref->p_) {
+    if (pos__ >= (LinePos) node_ref->p_) {
       local_p = GET_RVECTOR(node_ref, 1);
       return (zero__) ? local_p - GET_RVECTOR(node_ref, 4) : GET_RVECTOR(node_ref, 4);
     }
   } else if (type__ == VECTOR_W5) {
-    if (pos__ >= (uint32_t) node_ref->p_) {
+    if (pos__ >= (LinePos) node_ref->p_) {
       local_p = GET_RVECTOR(node_ref, 0) - GET_RVECTOR(node_ref, 2);
       return (zero__) ? local_p - GET_RVECTOR(node_ref, 5) : GET_RVECTOR(node_ref, 5);
     }
   } else if (type__ == VECTOR_W6) {
-    if (pos__ >= (uint32_t) node_ref->p_) {
+    if (pos__ >= (LinePos) node_ref->p_) {
       local_p = GET_RVECTOR(node_ref, 2);
       return (zero__) ? local_p - GET_RVECTOR(node_ref, 6) : GET_RVECTOR(node_ref, 6);
     }
   } else if (type__ == VECTOR_W7) {
-    if (pos__ >= (uint32_t) node_ref->p_) {
+    if (pos__ >= (LinePos) node_ref->p_) {
       local_p = GET_RVECTOR(node_ref, 6);
       return (zero__) ? local_p - GET_RVECTOR(node_ref, 7) : GET_RVECTOR(node_ref, 7);
     }
   }
 
   /* traverse the tree and enter correct leaf */
+#if defined(ENABLE_BTREE_NODES)
+  uint32_t idx;
+  UNUSED(left_child);
+
+  while (!IS_LEAF(current)) {
+    node_ref = MEMORY_GET_NODE(Graph__.mem_, current);
+
+    for (idx = 0; idx + 1 < node_ref->count_ && node_ref->pre_p_[idx] < pos__; idx++) {}
+    if (idx) {
+      pos__ -= node_ref->pre_p_[idx - 1];
+      rank += GRAPH_MASKED_ONES(node_ref->prefix_[idx - 1].rW_, type__);
+      total += GRAPH_MASKED_P(node_ref->pre_p_[idx - 1], node_ref->prefix_[idx - 1].rW_, type__);
+    }
+    current = node_ref->children_[idx];
+  }
+#else
   while (!IS_LEAF(current)) {
     node_ref = MEMORY_GET_NODE(Graph__.mem_, current);
     left_child = MEMORY_GET_ANY(Graph__.mem_, node_ref->left_);
 
-    if ((uint32_t)left_child->p_ >= pos__) {
+    if ((LinePos) left_child->p_ >= pos__) {
       current = node_ref->left_;
     } else {
       pos__ -= left_child->p_;
@@ -267,6 +301,7 @@ int32_t graph_fast_rank_masked_(Graph_Struct Graph__, uint32_t pos__, bool zero_
       }
     }
   }
+#endif
   leaf_ref = MEMORY_GET_LEAF(Graph__.mem_, current);
 
   /* handle last leaf of this query */
@@ -293,13 +328,8 @@ int32_t graph_fast_rank_masked_(Graph_Struct Graph__, uint32_t pos__, bool zero_
         leaf_ref->vectorW_[3];
     mask = leaf_ref->vectorW_[0] & leaf_ref->vectorW_[1] & leaf_ref->vectorW_[2];
   }
-  for (i = 0; pos__; i++) {
-    pos__--;
-    if ((mask >> (31 - i)) & 0x1) {
-      total++;
-      rank += (vector >> (31 - i)) & 0x1;
-    }
-  }
+  total += RANK(mask & LEAF_PREFIX(pos__));
+  rank += RANK(vector & LEAF_PREFIX(pos__));
   return (zero__) ? total - rank : rank;
 }
 
@@ -309,11 +339,11 @@ int32_t graph_fast_rank_masked_(Graph_Struct Graph__, uint32_t pos__, bool zero_
  * @param  Graph__  Reference to graph structure.
  * @param  pos__  Rank query position.
  */
-int32_t graph_Lrank_(Graph_Struct Graph__, uint32_t pos__) {
+LineIdx graph_Lrank_(Graph_Struct Graph__, LinePos pos__) {
   return graph_rank_simple_(Graph__, pos__, VECTOR_L);
 }
 
-int32_t Graph_Rank_L(GraphRef Graph__, uint32_t pos__, Graph_value val__) {
+LineIdx Graph_Rank_L(GraphRef Graph__, LinePos pos__, Graph_value val__) {
   if (val__ == VALUE_0)
     return pos__ - graph_Lrank_(*Graph__, pos__);
   else if (val__ == VALUE_1)
@@ -323,8 +353,8 @@ int32_t Graph_Rank_L(GraphRef Graph__, uint32_t pos__, Graph_value val__) {
   return 0;
 }
 
-int32_t Graph_Rank_W(GraphRef Graph__, uint32_t pos__, Graph_value val__) {
-  int32_t temp;
+LineIdx Graph_Rank_W(GraphRef Graph__, LinePos pos__, Graph_value val__) {
+  LineIdx temp;
 
 #ifdef FAST_RANK
   switch (val__) {
@@ -415,3 +445,105 @@ int32_t Graph_Rank_W(GraphRef Graph__, uint32_t pos__, Graph_value val__) {
   FATAL("VECTOR_W does not support this query value.");
   return 0;
 }
+
+/*
+ * Count lines with given W value from counters of a (sub)tree.
+ *
+ * @param  p__  Number of lines.
+ * @param  r__  All eight rW_ counters.
+ * @param  val__  Query value [enum: Graph_value].
+ */
+#define GRAPH_COUNT_W(p__, r__, val__)                          \
+      (((val__) == VALUE_A) ? (p__) - r__[0] - r__[1] - r__[3] \
+    : ((val__) == VALUE_Ax) ? r__[3]                            \
+    : ((val__) == VALUE_C) ? r__[1] - r__[4]                    \
+    : ((val__) == VALUE_Cx) ? r__[4]                            \
+    : ((val__) == VALUE_G) ? r__[0] - r__[2] - r__[5]           \
+    : ((val__) == VALUE_Gx) ? r__[5]                            \
+    : ((val__) == VALUE_T) ? r__[2] - r__[6]                    \
+    : ((val__) == VALUE_Tx) ? r__[6] - r__[7] : r__[7])
+
+Graph_value graph_rank_W_access_(Graph_Struct Graph__, LinePos pos__, LinePos ranks__[VALUE_$ + 1]) {
+  int32_t i, wavelet_mask;
+  LinePos p, r[8];
+  LeafVector prefix;
+
+  MemPtr current = Graph__.root_;
+
+  LeafRef leaf_ref;
+  NodeRef node_ref;
+  NodeRef left_child;
+
+  p = 0;
+  memset(r, 0, sizeof(r));
+
+  /* traverse the tree and sum counters of all subtrees left of the path */
+#if defined(ENABLE_BTREE_NODES)
+  uint32_t idx;
+  UNUSED(left_child);
+  while (!IS_LEAF(current)) {
+    node_ref = MEMORY_GET_NODE(Graph__.mem_, current);
+
+    BTREE_CHILD_BY_POS(node_ref, pos__, idx);
+    if (idx) {
+      p += node_ref->pre_p_[idx - 1];
+      for (i = 0; i < 8; i++)
+        r[i] += node_ref->prefix_[idx - 1].rW_[i];
+    }
+    current = node_ref->children_[idx];
+  }
+#else
+  while (!IS_LEAF(current)) {
+    node_ref = MEMORY_GET_NODE(Graph__.mem_, current);
+    left_child = MEMORY_GET_ANY(Graph__.mem_, node_ref->left_);
+
+    if (left_child->p_ > pos__) {
+      current = node_ref->left_;
+    } else {
+      pos__ -= left_child->p_;
+      current = node_ref->right_;
+
+      p += left_child->p_;
+      for (i = 0; i < 8; i++)
+        r[i] += GET_RVECTOR(left_child, i);
+    }
+  }
+#endif
+  leaf_ref = MEMORY_GET_LEAF(Graph__.mem_, current);
+
+  /* add counters of the leaf prefix (including queried line) */
+  prefix = LEAF_PREFIX(pos__ + 1);
+
+  p += pos__ + 1;
+  r[0] += RANK(leaf_ref->vectorW_[0] & prefix);
+  r[1] += RANK((~(leaf_ref->vectorW_[0])) & (leaf_ref->vectorW_[1]) & prefix);
+  r[2] += RANK((leaf_ref->vectorW_[0]) & (leaf_ref->vectorW_[1]) & prefix);
+  r[3] += RANK((~(leaf_ref->vectorW_[0])) & (~(leaf_ref->vectorW_[1])) & (leaf_ref->vectorW_[2]) & prefix);
+  r[4] += RANK((~(leaf_ref->vectorW_[0])) & (leaf_ref->vectorW_[1]) & (leaf_ref->vectorW_[2]) & prefix);
+  r[5] += RANK((leaf_ref->vectorW_[0]) & (~(leaf_ref->vectorW_[1])) & (leaf_ref->vectorW_[2]) & prefix);
+  r[6] += RANK((leaf_ref->vectorW_[0]) & (leaf_ref->vectorW_[1]) & (leaf_ref->vectorW_[2]) & prefix);
+  r[7] += RANK((leaf_ref->vectorW_[0]) & (leaf_ref->vectorW_[1]) & (leaf_ref->vectorW_[2]) & (leaf_ref->vectorW_[3]) & prefix);
+
+  for (i = VALUE_A; i <= VALUE_$; i++)
+    ranks__[i] = GRAPH_COUNT_W(p, r, i);
+
+  wavelet_mask = LEAF_BIT(leaf_ref->vectorW_[3], pos__) |
+                 LEAF_BIT(leaf_ref->vectorW_[2], pos__) << 0x1 |
+                 LEAF_BIT(leaf_ref->vectorW_[1], pos__) << 0x2 |
+                 LEAF_BIT(leaf_ref->vectorW_[0], pos__) << 0x3;
+
+  return GET_VALUE_FROM_MASK(wavelet_mask);
+}
+
+void Graph_Rank_W_all(GraphRef Graph__, LinePos pos__, LinePos ranks__[VALUE_$]) {
+  LinePos ranks[VALUE_$ + 1];
+
+  if (!pos__) {
+    memset(ranks__, 0, VALUE_$ * sizeof(LinePos));
+    return;
+  }
+
+  /* ranks up to and including previous line are ranks before given position */
+  graph_rank_W_access_(*Graph__, pos__ - 1, ranks);
+  memcpy(ranks__, ranks, VALUE_$ * sizeof(LinePos));
+}
@@ -1,10 +1,38 @@
 #include "structure.h"
 
+#if defined(__BMI2__)
+#include <immintrin.h>
+#endif
+
+uint32_t graph_leaf_select_(LeafVector vector__, uint32_t num__) {
+  assert(num__ > 0 && num__ <= (uint32_t) RANK(vector__));
+
+#if defined(__BMI2__)
+  /* deposit single bit to the position of (count - num__)-th set bit counted from the end */
+#if defined(ENABLE_LEAF_64)
+  return LEAF_SIZE - 1 - __builtin_ctzll(_pdep_u64((LeafVector) 0x1 << (RANK(vector__) - num__), vector__));
+#else
+  return LEAF_SIZE - 1 - __builtin_ctz(_pdep_u32((LeafVector) 0x1 << (RANK(vector__) - num__), vector__));
+#endif
+#else
+  uint32_t pos, count;
+
+  /* find the correct byte first */
+  for (pos = 0; (count = RANK((vector__ >> (LEAF_SIZE - 8 - pos)) & 0xFF)) < num__; pos += 8)
+    num__ -= count;
+
+  for (;; pos++)
+    if (LEAF_BIT(vector__, pos) && !(--num__))
+      return pos;
+#endif
+}
+
 
-int32_t graph_select_simple_(Graph_Struct Graph__, uint32_t num__, bool zero__, int32_t type__) {
-  int32_t i, temp;
-  int32_t select = 0;
-  uint32_t local_var;
+LineIdx graph_select_simple_(Graph_Struct Graph__, LinePos num__, bool zero__, int32_t type__) {
+  LineIdx temp;
+  LineIdx select = 0;
+  LinePos local_var;
+  LeafVector vector;
   MemPtr tmp_node;
   MemPtr current = Graph__.root_;
 
@@ -29,6 +57,28 @@ int32_t graph_select_simple_(Graph_Struct Graph__, uint32_t num__, bool zero__,
   }
 
   /* traverse the tree and enter correct leaf */
+#if defined(ENABLE_BTREE_NODES)
+  uint32_t idx;
+  UNUSED(tmp_node);
+
+  while (!IS_LEAF(current)) {
+    node_ref = MEMORY_GET_NODE(Graph__.mem_, current);
+
+    /* find first child whose prefix contains enough searched bits */
+    for (idx = 0; idx + 1 < node_ref->count_; idx++) {
+      local_var = (type__ == VECTOR_L) ? node_ref->prefix_[idx].rL_ : node_ref->prefix_[idx].rW_[0];
+      temp = (zero__) ? node_ref->pre_p_[idx] - local_var : local_var;
+      if ((LinePos) temp >= num__)
+        break;
+    }
+    if (idx) {
+      local_var = (type__ == VECTOR_L) ? node_ref->prefix_[idx - 1].rL_ : node_ref->prefix_[idx - 1].rW_[0];
+      num__ -= (zero__) ? node_ref->pre_p_[idx - 1] - local_var : local_var;
+      select += node_ref->pre_p_[idx - 1];
+    }
+    current = node_ref->children_[idx];
+  }
+#else
   while (!IS_LEAF(current)) {
     node_ref = MEMORY_GET_NODE(Graph__.mem_, current);
     tmp_node = node_ref->left_;
@@ -41,7 +91,7 @@ int32_t graph_select_simple_(Graph_Struct Graph__, uint32_t num__, bool zero__,
     /* get r_ counter of left child and act accordingly */
     temp = (zero__) ? MEMORY_GET_ANY(Graph__.mem_, tmp_node)->p_ - local_var : local_var;
 
-    if ((uint32_t) temp >= num__) {
+    if ((LinePos) temp >= num__) {
       current = tmp_node;
     } else {
       num__ -= temp;
@@ -49,23 +99,21 @@ int32_t graph_select_simple_(Graph_Struct Graph__, uint32_t num__, bool zero__,
       current = node_ref->right_;
     }
   }
+#endif
 
   leaf_ref = MEMORY_GET_LEAF(Graph__.mem_, current);
-  local_var = (type__ == VECTOR_L) ? leaf_ref->vectorL_ : leaf_ref->vectorW_[0];
+  vector = (type__ == VECTOR_L) ? leaf_ref->vectorL_ : leaf_ref->vectorW_[0];
 
   /* handle last leaf of this query */
-  for (i = 0; num__; i++) {
-    num__ -= (zero__) ? ((local_var >> (31 - i)) & 0x1) ^ 1 : ((local_var >> (31 - i)) & 0x1);
-  }
-
-  return select + i;
+  return select + graph_leaf_select_((zero__) ? ~vector : vector, num__) + 1;
 }
 
-int32_t graph_select_masked_(Graph_Struct Graph__, uint32_t num__, bool zero__, int32_t type__) {
-  int32_t i, temp;
-  int32_t local_p, vector, mask;
-  int32_t select = 0;
-  uint32_t local_var;
+LineIdx graph_select_masked_(Graph_Struct Graph__, LinePos num__, bool zero__, int32_t type__) {
+  int32_t i;
+  LineIdx temp, local_p;
+  LeafVector vector, mask;
+  LineIdx select = 0;
+  LinePos local_var;
   MemPtr tmp_node;
   MemPtr current = Graph__.root_;
 
@@ -110,6 +158,30 @@ int32_t graph_select_masked_(Graph_Struct Graph__, uint32_t num__, bool zero__,
   }
 
   /* traverse the tree and enter correct leaf */
+#if defined(ENABLE_BTREE_NODES)
+  UNUSED(tmp_node);
+  while (!IS_LEAF(current)) {
+    node_ref = MEMORY_GET_NODE(Graph__.mem_, current);
+
+    /* find first child whose prefix contains enough searched bits */
+    for (i = 0; (uint32_t) i + 1 < node_ref->count_; i++) {
+      local_var = GRAPH_MASKED_ONES(node_ref->prefix_[i].rW_, type__);
+      temp = (zero__) ? GRAPH_MASKED_P(node_ref->pre_p_[i], node_ref->prefix_[i].rW_, type__) -
+                            local_var
+                      : local_var;
+      if ((LinePos) temp >= num__)
+        break;
+    }
+    if (i) {
+      local_var = GRAPH_MASKED_ONES(node_ref->prefix_[i - 1].rW_, type__);
+      num__ -= (zero__) ? GRAPH_MASKED_P(node_ref->pre_p_[i - 1], node_ref->prefix_[i - 1].rW_, type__) -
+                              local_var
+                        : local_var;
+      select += node_ref->pre_p_[i - 1];
+    }
+    current = node_ref->children_[i];
+  }
+#else
   while (!IS_LEAF(current)) {
     node_ref = MEMORY_GET_NODE(Graph__.mem_, current);
     tmp_node = node_ref->left_;
@@ -149,7 +221,7 @@ int32_t graph_select_masked_(Graph_Struct Graph__, uint32_t num__, bool zero__,
                       : GET_RVECTOR(MEMORY_GET_ANY(Graph__.mem_, tmp_node), 7);
     }
 
-    if ((uint32_t) temp >= num__) {
+    if ((LinePos) temp >= num__) {
       current = tmp_node;
     } else {
       num__ -= temp;
@@ -180,6 +252,7 @@ int32_t graph_select_masked_(Graph_Struct Graph__, uint32_t num__, bool zero__,
 #endif
     }
   }
+#endif
 
   leaf_ref = MEMORY_GET_LEAF(Graph__.mem_, current);
 
@@ -207,19 +280,12 @@ int32_t graph_select_masked_(Graph_Struct Graph__, uint32_t num__, bool zero__,
     mask = leaf_ref->vectorW_[0] & leaf_ref->vectorW_[1] & leaf_ref->vectorW_[2];
   }
 
-  for (i = 0; num__; i++) {
+  i = graph_leaf_select_(mask & ((zero__) ? ~vector : vector), num__);
 #ifdef FAST_SELECT
-    select++;
-    if ((mask >> (31 - i)) & 0x1) {
-      num__ -= (zero__) ? ((vector >> (31 - i)) & 0x1) ^ 1 : ((vector >> (31 - i)) & 0x1);
-    }
+  select += i + 1;
 #else
-    if ((mask >> (31 - i)) & 0x1) {
-      select++;
-      num__ -= (zero__) ? ((vector >> (31 - i)) & 0x1) ^ 1 : ((vector >> (31 - i)) & 0x1);
-    }
+  select += RANK(mask & LEAF_PREFIX(i + 1));
 #endif
-  }
 
   return select;
 }
@@ -231,11 +297,11 @@ int32_t graph_select_masked_(Graph_Struct Graph__, uint32_t num__, bool zero__,
  * @param  pos__  Select query position.
  * @param  zero__  Whether this should select ones or zeroes (true for zero).
  */
-int32_t graph_Lselect_(Graph_Struct Graph__, uint32_t num__, bool zero__) {
+LineIdx graph_Lselect_(Graph_Struct Graph__, LinePos num__, bool zero__) {
   return graph_select_simple_(Graph__, num__, zero__, VECTOR_L);
 }
 
-int32_t Graph_Select_L(GraphRef Graph__, uint32_t pos__, Graph_value val__) {
+LineIdx Graph_Select_L(GraphRef Graph__, LinePos pos__, Graph_value val__) {
   if (val__ == VALUE_0)
     return graph_Lselect_(*Graph__, pos__, true);
   else if (val__ == VALUE_1)
@@ -245,8 +311,8 @@ int32_t Graph_Select_L(GraphRef Graph__, uint32_t pos__, Graph_value val__) {
   return 0;
 }
 
-int32_t Graph_Select_W(GraphRef Graph__, uint32_t pos__, Graph_value val__) {
-  int32_t temp, temp2;
+LineIdx Graph_Select_W(GraphRef Graph__, LinePos pos__, Graph_value val__) {
+  LineIdx temp, temp2;
 
 #ifdef FAST_SELECT
   switch (val__) {
@@ -358,3 +424,149 @@ int32_t Graph_Select_W(GraphRef Graph__, uint32_t pos__, Graph_value val__) {
   FATAL("VECTOR_W does not support this query value.");
   return 0;
 }
+
+LineIdx graph_Lselect_from_(Graph_Struct Graph__, LinePos pos__, LinePos num__) {
+  LinePos start, ones;
+  LeafVector local_var;
+  MemPtr current;
+  MemPtr child;
+
+  NodeRef node_ref;
+  NodeRef left_child;
+  LeafRef leaf_ref;
+
+  assert(num__ > 0);
+  assert(pos__ < MEMORY_GET_ANY(Graph__.mem_, Graph__.root_)->p_);
+
+  STACK_CLEAN(Graph__.stack_);
+  current = Graph__.root_;
+  start = 0;
+
+#if defined(ENABLE_BTREE_NODES)
+  uint32_t idx;
+  UNUSED(child);
+  UNUSED(left_child);
+
+  /* traverse the tree to the leaf holding starting position */
+  while (!IS_LEAF(current)) {
+    node_ref = MEMORY_GET_NODE(Graph__.mem_, current);
+    BTREE_CHILD_BY_POS(node_ref, pos__, idx);
+    start += BTREE_PREFIX_P(node_ref, idx);
+
+    STACK_PUSH(Graph__.stack_, current);
+    STACK_SET_INDEX(Graph__.stack_, idx);
+    current = node_ref->children_[idx];
+  }
+  leaf_ref = MEMORY_GET_LEAF(Graph__.mem_, current);
+
+  /* ones in this leaf on starting position or after it */
+  local_var = leaf_ref->vectorL_ & LEAF_SUFFIX(pos__);
+
+  if (RANK(local_var) < num__) {
+    num__ -= RANK(local_var);
+
+    /* climb up until some right sibling subtree contains enough ones */
+    while ((current = STACK_TOP(Graph__.stack_)) != STACK_ERROR) {
+      idx = STACK_GET_INDEX(Graph__.stack_);
+      STACK_POP(Graph__.stack_);
+
+      node_ref = MEMORY_GET_NODE(Graph__.mem_, current);
+      start -= BTREE_PREFIX_P(node_ref, idx);
+      ones = node_ref->rL_ - node_ref->prefix_[idx].rL_;
+
+      if (ones >= num__)
+        break;
+      num__ -= ones;
+    }
+
+    if (current == STACK_ERROR)
+      return -1;
+
+    /* find the right sibling with the result */
+    ones = node_ref->prefix_[idx].rL_;
+    for (idx++; node_ref->prefix_[idx].rL_ - ones < num__; idx++) {}
+    num__ -= node_ref->prefix_[idx - 1].rL_ - ones;
+    start += node_ref->pre_p_[idx - 1];
+    current = node_ref->children_[idx];
+
+    /* descend into it and find the leaf with the result */
+    while (!IS_LEAF(current)) {
+      node_ref = MEMORY_GET_NODE(Graph__.mem_, current);
+
+      for (idx = 0; node_ref->prefix_[idx].rL_ < num__; idx++) {}
+      num__ -= BTREE_PREFIX(node_ref, idx, rL_);
+      start += BTREE_PREFIX_P(node_ref, idx);
+      current = node_ref->children_[idx];
+    }
+    leaf_ref = MEMORY_GET_LEAF(Graph__.mem_, current);
+    local_var = leaf_ref->vectorL_;
+  }
+#else
+  /* traverse the tree to the leaf holding starting position */
+  while (!IS_LEAF(current)) {
+    STACK_PUSH(Graph__.stack_, current);
+    node_ref = MEMORY_GET_NODE(Graph__.mem_, current);
+    left_child = MEMORY_GET_ANY(Graph__.mem_, node_ref->left_);
+
+    if (left_child->p_ > pos__) {
+      current = node_ref->left_;
+    } else {
+      pos__ -= left_child->p_;
+      start += left_child->p_;
+      current = node_ref->right_;
+    }
+  }
+  leaf_ref = MEMORY_GET_LEAF(Graph__.mem_, current);
+
+  /* ones in this leaf on starting position or after it */
+  local_var = leaf_ref->vectorL_ & LEAF_SUFFIX(pos__);
+
+  if (RANK(local_var) < num__) {
+    num__ -= RANK(local_var);
+
+    /* climb up until right sibling subtree contains enough ones */
+    child = current;
+    while ((current = STACK_POP(Graph__.stack_)) != STACK_ERROR) {
+      node_ref = MEMORY_GET_NODE(Graph__.mem_, current);
+      left_child = MEMORY_GET_ANY(Graph__.mem_, node_ref->left_);
+
+      if (node_ref->left_ != child) {
+        start -= left_child->p_;
+      } else {
+        start += left_child->p_;
+        ones = MEMORY_GET_ANY(Graph__.mem_, node_ref->right_)->rL_;
+
+        if (ones >= num__)
+          break;
+
+        num__ -= ones;
+        start -= left_child->p_;
+      }
+      child = current;
+    }
+
+    if (current == STACK_ERROR)
+      return -1;
+
+    /* descend into right sibling subtree and find the leaf with the result */
+    current = node_ref->right_;
+    while (!IS_LEAF(current)) {
+      node_ref = MEMORY_GET_NODE(Graph__.mem_, current);
+      left_child = MEMORY_GET_ANY(Graph__.mem_, node_ref->left_);
+
+      if (left_child->rL_ >= num__) {
+        current = node_ref->left_;
+      } else {
+        num__ -= left_child->rL_;
+        start += left_child->p_;
+        current = node_ref->right_;
+      }
+    }
+    leaf_ref = MEMORY_GET_LEAF(Graph__.mem_, current);
+    local_var = leaf_ref->vectorL_;
+  }
+#endif
+
+  /* handle last leaf of this query */
+  return start + graph_leaf_select_(local_var, num__) + 1;
+}
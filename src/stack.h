@@ -1,6 +1,9 @@
 /*
  * Simple in memory simulated stack manager.
  * All operations return -1 on error.
+ *
+ * Every graph owns its own stack (so that independent graphs can be used
+ * from different threads) and all macros take a StackRef to it.
  */
 
 #ifndef _SHARED_STACK__
@@ -10,6 +13,9 @@
 
 typedef struct stack_32b {
   MemPtr stack_[MAX_STACK_SIZE];
+#if defined(ENABLE_BTREE_NODES)
+  int32_t index_[MAX_STACK_SIZE]; /* index of child the path continues to */
+#endif
   int32_t current_;
 } stack_32b;
 
@@ -19,21 +25,29 @@ typedef struct stack_32b {
   #define STACK_ERROR NULL
 #endif
 
-#define STACK_GET_PARENT() \
-  ((stack.current_ >= 1) ? stack.stack_[stack.current_ - 1] : STACK_ERROR)
-#define STACK_GET_GRANDPARENT() \
-  ((stack.current_ >= 2) ? stack.stack_[stack.current_ - 2] : STACK_ERROR)
-#define STACK_GET_GRANDGRANDPARENT() \
-  ((stack.current_ >= 3) ? stack.stack_[stack.current_ - 3] : STACK_ERROR)
-#define STACK_PUSH(arg) {                     \
-    if (stack.current_ + 1 >= MAX_STACK_SIZE) \
-      FATAL("Stack overflow");                \
-    stack.stack_[++stack.current_] = arg;     \
+#define STACK_GET_PARENT(stack__) \
+  (((stack__)->current_ >= 1) ? (stack__)->stack_[(stack__)->current_ - 1] : STACK_ERROR)
+#define STACK_GET_GRANDPARENT(stack__) \
+  (((stack__)->current_ >= 2) ? (stack__)->stack_[(stack__)->current_ - 2] : STACK_ERROR)
+#define STACK_GET_GRANDGRANDPARENT(stack__) \
+  (((stack__)->current_ >= 3) ? (stack__)->stack_[(stack__)->current_ - 3] : STACK_ERROR)
+#define STACK_PUSH(stack__, arg) {                   \
+    if ((stack__)->current_ + 1 >= MAX_STACK_SIZE)   \
+      FATAL("Stack overflow");                       \
+    (stack__)->stack_[++(stack__)->current_] = arg;  \
   }
-#define STACK_POP() ((stack.current_ == -1) ? STACK_ERROR : stack.stack_[stack.current_--])
-#define STACK_TOP() ((stack.current_ == -1) ? STACK_ERROR : stack.stack_[stack.current_])
-#define STACK_CLEAN() stack.current_ = -1;
+#define STACK_POP(stack__) \
+  (((stack__)->current_ == -1) ? STACK_ERROR : (stack__)->stack_[(stack__)->current_--])
+#define STACK_TOP(stack__) \
+  (((stack__)->current_ == -1) ? STACK_ERROR : (stack__)->stack_[(stack__)->current_])
+#define STACK_CLEAN(stack__) (stack__)->current_ = -1;
+#define STACK_DEPTH(stack__) ((stack__)->current_ + 1)
+
+#if defined(ENABLE_BTREE_NODES)
+#define STACK_SET_INDEX(stack__, idx) (stack__)->index_[(stack__)->current_] = (idx);
+#define STACK_GET_INDEX(stack__) (((stack__)->current_ == -1) ? -1 : (stack__)->index_[(stack__)->current_])
+#endif
 
-stack_32b stack;
+#define StackRef stack_32b*
 
 #endif
@@ -1,37 +1,539 @@
 #include "structure.h"
 
-#ifdef RAS_CONTEXT_SHORTENING
-#include "universal.h"
+#if defined(INTEGER_CONTEXT_SHORTENING)
+
+/* Lowest bit, value bits and the guard bit of double width csl fields. */
+#define CSL_PAIR_LOW (LEAF_ONES / ((((LeafVector) 0x1) << (2 * LEAF_CSL_BITS)) - 1))
+#define CSL_PAIR_VALUE (CSL_PAIR_LOW * LEAF_CSL_MAX)
+#define CSL_PAIR_GUARD (CSL_PAIR_LOW << LEAF_CSL_BITS)
+
+/*
+ * Recalculate minimal csl of all lines in the leaf.
+ *
+ * @param  leaf__  Reference to the leaf.
+ */
+static void graph_leaf_update_min_csl_(LeafRef leaf__) {
+  uint32_t i;
+
+  leaf__->min_csl_ = UINT8_MAX;
+  for (i = 0; i < leaf__->p_; i++)
+    if (LEAF_GET_CSL(leaf__, i) < leaf__->min_csl_)
+      leaf__->min_csl_ = LEAF_GET_CSL(leaf__, i);
+}
+
+/*
+ * Set csl of given line in the leaf.
+ *
+ * Minimal csl of the leaf is kept up to date and it is recalculated only when
+ * the changed line was the minimal one.
+ *
+ * @param  leaf__  Reference to the leaf.
+ * @param  pos__  Position of the line in the leaf.
+ * @param  csl__  New csl value.
+ */
+static inline void graph_leaf_set_csl_(LeafRef leaf__, uint32_t pos__, int32_t csl__) {
+  uint32_t shift = (pos__ % LEAF_CSL_LANES) * LEAF_CSL_BITS;
+  LeafVector* vector = &(LEAF_PAYLOAD(leaf__)->context_[pos__ / LEAF_CSL_LANES]);
+  int32_t old = (int32_t) ((*vector >> shift) & LEAF_CSL_MAX);
+
+  assert(csl__ >= 0 && csl__ <= LEAF_CSL_MAX);
+  *vector = (*vector & ~((LeafVector) LEAF_CSL_MAX << shift)) | ((LeafVector) csl__ << shift);
+
+  if (csl__ <= leaf__->min_csl_)
+    leaf__->min_csl_ = (uint8_t) csl__;
+  else if (old == leaf__->min_csl_)
+    graph_leaf_update_min_csl_(leaf__);
+}
+
+/*
+ * Move csl of given line and all later ones by one line forward.
+ *
+ * Csl of given line stays the same (as with memmove of the unpacked array).
+ *
+ * @param  leaf__  Reference to the leaf.
+ * @param  pos__  Position of the first moved line.
+ */
+static inline void graph_leaf_shift_csl_(LeafRef leaf__, uint32_t pos__) {
+  int32_t i, word = pos__ / LEAF_CSL_LANES;
+  LeafVector low;
+  LeafVector* context = LEAF_PAYLOAD(leaf__)->context_;
+
+  /* later vectors take the last field of the previous one */
+  for (i = LEAF_CSL_BITS - 1; i > word; i--)
+    context[i] = (context[i] << LEAF_CSL_BITS) | (context[i - 1] >> (LEAF_SIZE - LEAF_CSL_BITS));
+
+  low = ((LeafVector) 0x1 << ((pos__ % LEAF_CSL_LANES) * LEAF_CSL_BITS)) - 1;
+  context[word] = (context[word] & low) | ((context[word] & ~low) << LEAF_CSL_BITS);
+}
+
+/*
+ * Move csl of all lines after given position by one line backward.
+ *
+ * @param  leaf__  Reference to the leaf.
+ * @param  pos__  Position of the removed line.
+ */
+static inline void graph_leaf_unshift_csl_(LeafRef leaf__, uint32_t pos__) {
+  int32_t i, word = pos__ / LEAF_CSL_LANES;
+  LeafVector low;
+  LeafVector* context = LEAF_PAYLOAD(leaf__)->context_;
+
+  low = ((LeafVector) 0x1 << ((pos__ % LEAF_CSL_LANES) * LEAF_CSL_BITS)) - 1;
+  context[word] = (context[word] & low) | ((context[word] >> LEAF_CSL_BITS) & ~low);
+
+  /* previous vectors take the first field of the next one */
+  for (i = word + 1; i < LEAF_CSL_BITS; i++) {
+    context[i - 1] |= context[i] << (LEAF_SIZE - LEAF_CSL_BITS);
+    context[i] >>= LEAF_CSL_BITS;
+  }
+}
+
+/*
+ * Copy csl of all lines from given position of one leaf to the start of another one.
+ *
+ * @param  dst__  Reference to the target leaf.
+ * @param  src__  Reference to the source leaf.
+ * @param  from__  Position of the first copied line.
+ */
+static void graph_leaf_copy_csl_(LeafRef dst__, LeafRef src__, uint32_t from__) {
+  int32_t i, word = from__ / LEAF_CSL_LANES;
+  uint32_t shift = (from__ % LEAF_CSL_LANES) * LEAF_CSL_BITS;
+  LeafVector* dst = LEAF_PAYLOAD(dst__)->context_;
+  LeafVector* src = LEAF_PAYLOAD(src__)->context_;
+
+  for (i = 0; i + word < LEAF_CSL_BITS; i++) {
+    dst[i] = src[i + word] >> shift;
+    if (shift && i + word + 1 < LEAF_CSL_BITS)
+      dst[i] |= src[i + word + 1] << (LEAF_SIZE - shift);
+  }
+  for (; i < LEAF_CSL_BITS; i++)
+    dst[i] = 0;
+}
+
+/*
+ * Get lines of one packed csl vector with csl lower than given value.
+ *
+ * Even and odd fields are compared separately in double width fields where the
+ * guard bit above each value stops the borrow of the subtraction.
+ *
+ * @param  vector__  Packed csl vector.
+ * @param  csl__  Compared csl value.
+ *
+ * @return  Vector with the lowest bit of field of each such line set.
+ */
+static inline LeafVector graph_csl_lower_mask_(LeafVector vector__, int32_t csl__) {
+  LeafVector limit, even, odd;
+
+  if (csl__ <= 0)
+    return 0;
+
+  /* each value is lower than anything above the field range */
+  limit = CSL_PAIR_LOW * (LeafVector) ((csl__ > LEAF_CSL_MAX) ? LEAF_CSL_MAX + 1 : csl__);
+
+  even = ~(((vector__ & CSL_PAIR_VALUE) | CSL_PAIR_GUARD) - limit) & CSL_PAIR_GUARD;
+  odd = ~((((vector__ >> LEAF_CSL_BITS) & CSL_PAIR_VALUE) | CSL_PAIR_GUARD) - limit) & CSL_PAIR_GUARD;
+  return (even >> LEAF_CSL_BITS) | odd;
+}
+
+/*
+ * Find the last line at or before given position of the leaf with csl lower than given value.
+ *
+ * @param  leaf__  Reference to the leaf.
+ * @param  pos__  Starting position (must be lower than leaf size).
+ * @param  csl__  Compared csl value.
+ *
+ * @return  Position of such line or -1 if there is none.
+ */
+static int32_t graph_leaf_csl_lower_(LeafRef leaf__, uint32_t pos__, int32_t csl__) {
+  int32_t word = pos__ / LEAF_CSL_LANES;
+  LeafVector mask;
+  LeafVector* context = LEAF_PAYLOAD(leaf__)->context_;
+
+  /* ignore lines after the starting position */
+  mask = graph_csl_lower_mask_(context[word], csl__) &
+         (LEAF_ONES >> (LEAF_SIZE - 1 - (pos__ % LEAF_CSL_LANES) * LEAF_CSL_BITS));
+
+  while (!mask) {
+    if (--word < 0)
+      return -1;
+    mask = graph_csl_lower_mask_(context[word], csl__);
+  }
+  return word * LEAF_CSL_LANES + (LEAF_SIZE - 1 - LEAF_CLZ(mask)) / LEAF_CSL_BITS;
+}
+
+/*
+ * Find the first line at or after given position of the leaf with csl lower than given value.
+ *
+ * @param  leaf__  Reference to the leaf.
+ * @param  pos__  Starting position.
+ * @param  csl__  Compared csl value.
+ *
+ * @return  Position of such line or leaf size if there is none.
+ */
+static uint32_t graph_leaf_csl_upper_(LeafRef leaf__, uint32_t pos__, int32_t csl__) {
+  uint32_t word = pos__ / LEAF_CSL_LANES;
+  uint32_t found;
+  LeafVector mask;
+  LeafVector* context = LEAF_PAYLOAD(leaf__)->context_;
+
+  if (pos__ >= leaf__->p_)
+    return leaf__->p_;
+
+  /* ignore lines before the starting position */
+  mask = graph_csl_lower_mask_(context[word], csl__) &
+         (LEAF_ONES << ((pos__ % LEAF_CSL_LANES) * LEAF_CSL_BITS));
+
+  while (!mask) {
+    if (++word * LEAF_CSL_LANES >= leaf__->p_)
+      return leaf__->p_;
+    mask = graph_csl_lower_mask_(context[word], csl__);
+  }
+
+  /* fields after the last line are not defined */
+  found = word * LEAF_CSL_LANES + LEAF_CTZ(mask) / LEAF_CSL_BITS;
+  return (found < leaf__->p_) ? found : leaf__->p_;
+}
+
+/*
+ * Get minimal csl stored in the given subtree.
+ *
+ * @param  Graph__  Reference to Graph_Struct object.
+ * @param  ptr__  Root of the subtree.
+ */
+static inline uint8_t graph_min_csl_(GraphRef Graph__, MemPtr ptr__) {
+#if !defined(INDEXED_MEMORY)
+  UNUSED(Graph__);  /* direct pointers don't need the memory object */
+#endif
+
+  if (IS_LEAF(ptr__))
+    return MEMORY_GET_LEAF(Graph__->mem_, ptr__)->min_csl_;
+  return MEMORY_GET_NODE(Graph__->mem_, ptr__)->min_csl_;
+}
+
+#if defined(ENABLE_BTREE_NODES)
+
+/*
+ * Recalculate minimal csl of one child of B+ tree node and of the node itself.
+ *
+ * @param  Graph__  Reference to Graph_Struct object.
+ * @param  node_ref__  Reference to the node.
+ * @param  idx__  Index of the changed child.
+ */
+static void graph_btree_update_min_csl_(GraphRef Graph__, NodeRef node_ref__, uint32_t idx__) {
+  uint32_t i;
+
+  node_ref__->child_csl_[idx__] = graph_min_csl_(Graph__, node_ref__->children_[idx__]);
+
+  node_ref__->min_csl_ = UINT8_MAX;
+  for (i = 0; i < node_ref__->count_; i++)
+    if (node_ref__->child_csl_[i] < node_ref__->min_csl_)
+      node_ref__->min_csl_ = node_ref__->child_csl_[i];
+}
+
+#else
+
+#define GRAPH_UPDATE_MIN_CSL(Graph__, node_ref__) {                  \
+    uint8_t Xleft = graph_min_csl_(Graph__, (node_ref__)->left_);    \
+    uint8_t Xright = graph_min_csl_(Graph__, (node_ref__)->right_);  \
+    (node_ref__)->min_csl_ = (Xleft < Xright) ? Xleft : Xright;      \
+  }
+
+#endif  /* ENABLE_BTREE_NODES */
+
+#else
+
+#define GRAPH_UPDATE_MIN_CSL(Graph__, node_ref__) {}
+
+#endif  /* INTEGER_CONTEXT_SHORTENING */
+
+#if defined(ENABLE_BTREE_NODES)
+
+/*
+ * Add (or remove) counters of one line to given counters.
+ *
+ * @param  counters__  [In/Out] Counters to be updated.
+ * @param  mask__  Mask of the W value of the line.
+ * @param  P__  P value of the line.
+ * @param  sign__  Whether the line is added (1) or removed (-1).
+ */
+void graph_btree_line_counters_(node_prefix* counters__, int32_t mask__, uint32_t P__, int32_t sign__) {
+  Graph_value value = GET_VALUE_FROM_MASK(mask__);
+
+  counters__->rW_[0] += sign__ * ((mask__ & 0x8) >> 0x3);
+  counters__->rW_[1] += sign__ * ((mask__ & 0x4) && ((~mask__) & 0x8));
+  counters__->rW_[2] += sign__ * ((mask__ & 0x4) && (mask__ & 0x8));
+  counters__->rW_[3] += sign__ * ((mask__ & 0x2) && ((~mask__) & 0x4) && ((~mask__) & 0x8));
+  counters__->rW_[4] += sign__ * ((mask__ & 0x2) && (mask__ & 0x4) && ((~mask__) & 0x8));
+  counters__->rW_[5] += sign__ * ((mask__ & 0x2) && ((~mask__) & 0x4) && (mask__ & 0x8));
+  counters__->rW_[6] += sign__ * ((mask__ & 0x2) && (mask__ & 0x4) && (mask__ & 0x8));
+  counters__->rW_[7] += sign__ * ((mask__ & 0x1) && (mask__ & 0x2) && (mask__ & 0x4) && (mask__ & 0x8));
+
+  if (value != VALUE_$)
+    counters__->f_[value >> 0x1] += sign__ * (LineIdx) P__;
+}
+
+/*
+ * Add counter changes to all prefix counters of B+ tree node starting with given child.
+ *
+ * Header of the node (counters of whole subtree) is not changed.
+ *
+ * @param  node_ref__  Reference to the node.
+ * @param  idx__  Index of the changed child.
+ * @param  p__  Change of the number of lines.
+ * @param  delta__  Changes of all other counters.
+ */
+void graph_btree_prefix_add_(NodeRef node_ref__, uint32_t idx__, LinePos p__, const node_prefix* delta__) {
+  uint32_t i, j;
+
+  for (i = idx__; i < node_ref__->count_; i++) {
+    node_ref__->pre_p_[i] += p__;
+    node_ref__->prefix_[i].rL_ += delta__->rL_;
+    for (j = 0; j < 8; j++)
+      node_ref__->prefix_[i].rW_[j] += delta__->rW_[j];
+    for (j = 0; j < SYMBOL_COUNT; j++)
+      node_ref__->prefix_[i].f_[j] += delta__->f_[j];
+  }
+}
+
+/*
+ * Rebuild all counters of B+ tree node from headers of its children.
+ *
+ * @param  Graph__  Reference to Graph_Struct object.
+ * @param  node_ref__  Reference to the node.
+ */
+void graph_btree_recount_(GraphRef Graph__, NodeRef node_ref__) {
+  uint32_t i, j;
+  LinePos p;
+  node_prefix sum;
+  NodeRef child_ref;
+
+  UNUSED(Graph__);
+
+  p = 0;
+  memset(&sum, 0, sizeof(sum));
+#if defined(INTEGER_CONTEXT_SHORTENING)
+  node_ref__->min_csl_ = UINT8_MAX;
+#endif
+
+  for (i = 0; i < node_ref__->count_; i++) {
+    child_ref = MEMORY_GET_ANY(Graph__->mem_, node_ref__->children_[i]);
+
+    p += child_ref->p_;
+    sum.rL_ += child_ref->rL_;
+    for (j = 0; j < 8; j++)
+      sum.rW_[j] += GET_RVECTOR(child_ref, j);
+    for (j = 0; j < SYMBOL_COUNT; j++)
+      sum.f_[j] += child_ref->f_[j];
+
+    node_ref__->pre_p_[i] = p;
+    node_ref__->prefix_[i] = sum;
+
+#if defined(INTEGER_CONTEXT_SHORTENING)
+    node_ref__->child_csl_[i] = graph_min_csl_(Graph__, node_ref__->children_[i]);
+    if (node_ref__->child_csl_[i] < node_ref__->min_csl_)
+      node_ref__->min_csl_ = node_ref__->child_csl_[i];
+#endif
+  }
+
+  node_ref__->p_ = p;
+  node_ref__->rL_ = sum.rL_;
+  memcpy(node_ref__->rW_, sum.rW_, sizeof(node_ref__->rW_));
+  memcpy(node_ref__->f_, sum.f_, sizeof(node_ref__->f_));
+
+  MAKE_NODE(node_ref__);
+}
+
+/*
+ * Insert new right sibling of split child into the B+ tree.
+ *
+ * Parent of split child and all its ancestors must be on the stack (with child indexes). Full
+ * nodes are split in half all the way up and new root is created if necessary.
+ *
+ * @param  Graph__  Reference to Graph_Struct object.
+ * @param  left__  Child that was split.
+ * @param  right__  New right sibling of the split child.
+ */
+void graph_btree_insert_child_(GraphRef Graph__, MemPtr left__, MemPtr right__) {
+  uint32_t idx, half;
+  MemPtr current;
+  MemPtr sibling;
+  NodeRef node_ref;
+  NodeRef target_ref;
+  NodeRef sibling_ref;
 
-UWT_Struct uwt;
+  while ((current = STACK_TOP(Graph__->stack_)) != STACK_ERROR) {
+    idx = STACK_GET_INDEX(Graph__->stack_);
+    STACK_POP(Graph__->stack_);
+
+    node_ref = MEMORY_GET_NODE(Graph__->mem_, current);
+    target_ref = node_ref;
+    sibling_ref = NULL;
+
+#ifdef ENABLE_LOOKUP_CACHE
+    if (node_ref->count_ == BTREE_FANOUT)
+      finger_node_changed(Graph__->cache_, STACK_DEPTH(Graph__->stack_), current);
+    else
+      finger_child_inserted(Graph__->cache_, STACK_DEPTH(Graph__->stack_), current, idx);
+#endif
+
+    if (node_ref->count_ == BTREE_FANOUT) {
+      STRUCTURE_VERBOSE(
+        printf("[structure]: Node is full and will be split\n");
+      )
+
+      /* move upper half of children into new sibling node */
+      sibling = Memory_new_node(Graph__->mem_);
+      sibling_ref = MEMORY_GET_NODE(Graph__->mem_, sibling);
+      node_ref = MEMORY_GET_NODE(Graph__->mem_, current);
+
+      half = BTREE_FANOUT / 2;
+      memcpy(sibling_ref->children_, &(node_ref->children_[half]),
+             (BTREE_FANOUT - half) * sizeof(MemPtr));
+      sibling_ref->count_ = BTREE_FANOUT - half;
+      node_ref->count_ = half;
+
+      target_ref = node_ref;
+      if (idx >= half) {
+        target_ref = sibling_ref;
+        idx -= half;
+      }
+    }
+
+    /* insert new child right after the split one */
+    memmove(&(target_ref->children_[idx + 2]), &(target_ref->children_[idx + 1]),
+            (target_ref->count_ - idx - 1) * sizeof(MemPtr));
+    target_ref->children_[idx + 1] = right__;
+    target_ref->count_++;
+
+    graph_btree_recount_(Graph__, node_ref);
+    if (sibling_ref == NULL)
+      return;
+
+    graph_btree_recount_(Graph__, sibling_ref);
+    left__ = current;
+    right__ = sibling;
+  }
+
+  /* root was split, tree grows by one level */
+#ifdef ENABLE_LOOKUP_CACHE
+  reset_cache(Graph__->cache_);
+#endif
+
+  current = Memory_new_node(Graph__->mem_);
+  node_ref = MEMORY_GET_NODE(Graph__->mem_, current);
+
+  node_ref->children_[0] = left__;
+  node_ref->children_[1] = right__;
+  node_ref->count_ = 2;
+  graph_btree_recount_(Graph__, node_ref);
+
+  Graph__->root_ = current;
+}
+
+#endif  /* ENABLE_BTREE_NODES */
+
+/*
+ * Initialize memory object for graph with expected number of lines.
+ *
+ * @param  lines__  Expected number of lines (or 0 if unknown).
+ */
+static MemObj graph_memory_init_(LinePos lines__) {
+  LinePos leaves, nodes;
+
+  /* Leaves (and B+ tree nodes) are about two thirds full on average, binary
+   * tree has about the same number of internal nodes as leaves. */
+  leaves = lines__ / LEAF_SIZE * 3 / 2 + 1;
+#if defined(ENABLE_BTREE_NODES)
+  nodes = leaves / BTREE_FANOUT * 3 / 2 + 1;
+#else
+  nodes = leaves;
+#endif
+
+  return Memory_init(leaves, nodes);
+}
+
+void Graph_Init(GraphRef Graph__, LinePos lines__) {
+  Graph__->mem_ = graph_memory_init_(lines__);
+  Graph__->stack_ = (StackRef) malloc_(sizeof(stack_32b));
+  if (Graph__->stack_ == NULL)
+    FATAL("Cannot allocate graph stack");
+  STACK_CLEAN(Graph__->stack_);
+
+#ifdef ENABLE_LOOKUP_CACHE
+  Graph__->cache_ = (CacheRef) malloc_(sizeof(lookup_cache));
+  if (Graph__->cache_ == NULL)
+    FATAL("Cannot allocate lookup cache");
 #endif
 
-void Graph_Init(GraphRef Graph__) {
-  Graph__->mem_ = Memory_init();
   Graph__->root_ = Memory_new_leaf(Graph__->mem_);
 
   LeafRef leaf_ref = MEMORY_GET_LEAF(Graph__->mem_, Graph__->root_);
 
-  memset(&(leaf_ref->p_), 0, sizeof(leaf_32e));
+  MEMORY_CLEAR_LEAF(leaf_ref);
+#if defined(INTEGER_CONTEXT_SHORTENING)
+  leaf_ref->min_csl_ = UINT8_MAX;
+#endif
 
 #ifdef RAS_CONTEXT_SHORTENING
-  UWT_Init(&uwt, CONTEXT_LENGTH + 1);
+  UWT_Init(&(Graph__->uwt_), CONTEXT_LENGTH + 1);
 #endif
 
   /* this does nothing with indexed memory where
      is_leaf is explicitly stored in index value */
   MAKE_LEAF(leaf_ref);
 
+#if defined(ENABLE_GRAPH_COMPACTION)
+  Graph__->inserts_ = 0;
+#endif
+
 #ifdef ENABLE_LOOKUP_CACHE
-  reset_cache();
+  reset_cache(Graph__->cache_);
+#endif
+#ifdef ENABLE_CACHE_STATS
+  cache_stats_prep(Graph__->cache_);
 #endif
 }
 
 void Graph_Free(GraphRef Graph__) {
   Memory_free(&(Graph__->mem_));
+  free_(Graph__->stack_);
+
+#ifdef ENABLE_LOOKUP_CACHE
+  free_(Graph__->cache_);
+#endif
 
 #ifdef RAS_CONTEXT_SHORTENING
-  UWT_Free(&uwt);
+  UWT_Free(&(Graph__->uwt_));
+#endif
+}
+
+/*
+ * Set P value of given line in the leaf.
+ *
+ * With packed frequencies the whole leaf is moved to full width counters when
+ * the value doesn't fit into the narrow one.
+ *
+ * @param  leaf__  Reference to the leaf.
+ * @param  pos__  Position of the line in the leaf.
+ * @param  value__  New P value.
+ */
+static inline void graph_leaf_set_p_(LeafRef leaf__, uint32_t pos__, uint32_t value__) {
+  PayloadRef payload = LEAF_PAYLOAD(leaf__);
+#if defined(ENABLE_PACKED_FREQUENCY)
+  int32_t i;
+
+  if (payload->wideP_ == NULL) {
+    if (value__ <= LEAF_NARROW_P_MAX) {
+      payload->vectorP_[pos__] = (uint8_t) value__;
+      return;
+    }
+
+    payload->wideP_ = (uint32_t*) malloc_(LEAF_SIZE * sizeof(uint32_t));
+    for (i = 0; i < LEAF_SIZE; i++)
+      payload->wideP_[i] = payload->vectorP_[i];
+  }
+  payload->wideP_[pos__] = value__;
+#else
+  payload->vectorP_[pos__] = value__;
 #endif
 }
 
@@ -98,45 +600,366 @@ void Graph_Insert_Line_(LeafRef leaf__, uint32_t pos__, GLineRef line__) {
 
   /* move all later integers to next position and insert new one */
   if (pos__ < leaf__->p_) {
-    memmove(&(leaf__->vectorP_[pos__ + 1]), &(leaf__->vectorP_[pos__]),
-            (leaf__->p_ - pos__) * sizeof(int32_t));
+    PayloadRef payload = LEAF_PAYLOAD(leaf__);
+#if defined(ENABLE_PACKED_FREQUENCY)
+    if (payload->wideP_ != NULL)
+      memmove(&(payload->wideP_[pos__ + 1]), &(payload->wideP_[pos__]),
+              (leaf__->p_ - pos__) * sizeof(*payload->wideP_));
+    else
+#endif
+    memmove(&(payload->vectorP_[pos__ + 1]), &(payload->vectorP_[pos__]),
+            (leaf__->p_ - pos__) * sizeof(*payload->vectorP_));
 #if defined(INTEGER_CONTEXT_SHORTENING)
-    memmove(&(leaf__->context_[pos__ + 1]), &(leaf__->context_[pos__]),
-            (leaf__->p_ - pos__) * sizeof(*leaf__->context_));
+    graph_leaf_shift_csl_(leaf__, pos__);
 #endif
   }
-  leaf__->vectorP_[pos__] = line__->P_;
+  graph_leaf_set_p_(leaf__, pos__, line__->P_);
   leaf__->p_++;
+
+  if (line__->W_ != VALUE_$)
+    leaf__->f_[line__->W_ >> 0x1] += line__->P_;
+}
+
+/*
+ * Add (or remove) one line to counters of given node or leaf.
+ *
+ * @param  node_ref__  Reference to the node (or leaf).
+ * @param  line__  Reference to the line.
+ * @param  sign__  Whether the line is added (1) or removed (-1).
+ */
+static void graph_line_counters_(NodeRef node_ref__, GLineRef line__, int32_t sign__) {
+  int32_t mask = GET_MASK_FROM_VALUE(line__->W_);
+
+  node_ref__->p_ += sign__;
+  node_ref__->rL_ += sign__ * (LineIdx) line__->L_;
+
+  node_ref__->rW_[0] += sign__ * ((mask & 0x8) >> 0x3);
+  node_ref__->rW_[1] += sign__ * ((mask & 0x4) && ((~mask) & 0x8));
+  node_ref__->rW_[2] += sign__ * ((mask & 0x4) && (mask & 0x8));
+  node_ref__->rW_[3] += sign__ * ((mask & 0x2) && ((~mask) & 0x4) && ((~mask) & 0x8));
+  node_ref__->rW_[4] += sign__ * ((mask & 0x2) && (mask & 0x4) && ((~mask) & 0x8));
+  node_ref__->rW_[5] += sign__ * ((mask & 0x2) && ((~mask) & 0x4) && (mask & 0x8));
+  node_ref__->rW_[6] += sign__ * ((mask & 0x2) && (mask & 0x4) && (mask & 0x8));
+  node_ref__->rW_[7] += sign__ * ((mask & 0x1) && (mask & 0x2) && (mask & 0x4) && (mask & 0x8));
+
+  if (line__->W_ != VALUE_$)
+    node_ref__->f_[line__->W_ >> 0x1] += sign__ * (LineIdx) line__->P_;
+}
+
+/*
+ * Recalculate frequency counters of given leaf from its P vector.
+ *
+ * @param  leaf__  Reference to the leaf.
+ */
+void Graph_Leaf_frequency_(LeafRef leaf__) {
+  int32_t i, wavelet_mask;
+  Graph_value value;
+
+  memset(leaf__->f_, 0, sizeof(leaf__->f_));
+  for (i = 0; i < (int32_t) leaf__->p_; i++) {
+    wavelet_mask = LEAF_BIT(leaf__->vectorW_[3], i) |
+                   LEAF_BIT(leaf__->vectorW_[2], i) << 0x1 |
+                   LEAF_BIT(leaf__->vectorW_[1], i) << 0x2 |
+                   LEAF_BIT(leaf__->vectorW_[0], i) << 0x3;
+
+    value = GET_VALUE_FROM_MASK(wavelet_mask);
+    if (value != VALUE_$)
+      leaf__->f_[value >> 0x1] += LEAF_GET_P(leaf__, i);
+  }
+}
+
+#if !defined(ENABLE_BTREE_NODES)
+
+/*
+ * Build perfectly balanced subtree above given leaves.
+ *
+ * All leaves end up in the last two levels of the tree. When red black
+ * balancing is enabled, internal nodes just above the last level are red and
+ * all other nodes are black, so that every path contains the same number of
+ * black nodes.
+ *
+ * @param  Graph__  Reference to Graph_Struct object.
+ * @param  leaves__  Leaves of the subtree (in order).
+ * @param  count__  Number of leaves.
+ * @param  depth__  Depth of the subtree root.
+ * @param  height__  Height of the whole tree.
+ *
+ * @return  Root of the subtree.
+ */
+MemPtr graph_build_subtree_(GraphRef Graph__, MemPtr* leaves__, uint32_t count__,
+                            uint32_t depth__, uint32_t height__) {
+  int32_t i;
+  MemPtr left;
+  MemPtr right;
+  MemPtr node;
+  NodeRef node_ref;
+  NodeRef left_ref;
+  NodeRef right_ref;
+
+  if (count__ == 1)
+    return leaves__[0];
+
+  left = graph_build_subtree_(Graph__, leaves__, count__ / 2, depth__ + 1, height__);
+  right = graph_build_subtree_(Graph__, leaves__ + count__ / 2, count__ - count__ / 2, depth__ + 1, height__);
+
+  node = Memory_new_node(Graph__->mem_);
+  node_ref = MEMORY_GET_NODE(Graph__->mem_, node);
+  left_ref = MEMORY_GET_ANY(Graph__->mem_, left);
+  right_ref = MEMORY_GET_ANY(Graph__->mem_, right);
+
+  memset(node_ref, 0, sizeof(node_32e));
+
+  node_ref->left_ = left;
+  node_ref->right_ = right;
+
+  node_ref->p_ = left_ref->p_ + right_ref->p_;
+  node_ref->rL_ = left_ref->rL_ + right_ref->rL_;
+  for (i = 0; i < 8; i++)
+    node_ref->rW_[i] = GET_RVECTOR(left_ref, i) + GET_RVECTOR(right_ref, i);
+  for (i = 0; i < SYMBOL_COUNT; i++)
+    node_ref->f_[i] = left_ref->f_[i] + right_ref->f_[i];
+
+  MAKE_NODE(node_ref);
+  GRAPH_UPDATE_MIN_CSL(Graph__, node_ref);
+
+#ifdef ENABLE_RED_BLACK_BALANCING
+  if (depth__ && depth__ + 1 == height__)
+    MAKE_RED(node_ref);
+  else
+    MAKE_BLACK(node_ref);
+#else
+  UNUSED(height__);
+#endif
+
+  return node;
+}
+
+#endif  /* !defined(ENABLE_BTREE_NODES) */
+
+void Graph_Build(GraphRef Graph__, const Graph_Line* lines__, const int32_t* csl__, LinePos size__) {
+  uint32_t j, count, leaf_size;
+  LinePos i;
+  MemPtr* leaves;
+  LeafRef leaf_ref;
+  Graph_Line line;
+
+  STRUCTURE_VERBOSE(
+    printf("[structure]: Building graph from %" PRI_POS " lines\n", size__);
+  )
+
+  Graph_Init(Graph__, size__);
+  if (!size__) return;
+
+  leaves = (MemPtr*) malloc_((size__ / LEAF_HALF + 1) * sizeof(MemPtr));
+  if (leaves == NULL)
+    FATAL("Cannot allocate leaf array for graph build");
+
+  /* pack lines into full leaves */
+  count = 0;
+  for (i = 0; i < size__; i += leaf_size) {
+    leaf_size = (size__ - i < LEAF_SIZE) ? size__ - i : LEAF_SIZE;
+
+    /* same as clever splitting, try to end the leaf with set L bit */
+    if (leaf_size == LEAF_SIZE) {
+      for (j = LEAF_SIZE; j > LEAF_SIZE - 4 && !lines__[i + j - 1].L_; j--) {}
+      if (j > LEAF_SIZE - 4)
+        leaf_size = j;
+    }
+
+    /* first leaf is the one created during initialization */
+    leaves[count] = (count) ? Memory_new_leaf(Graph__->mem_) : Graph__->root_;
+    leaf_ref = MEMORY_GET_LEAF(Graph__->mem_, leaves[count]);
+
+    MEMORY_CLEAR_LEAF(leaf_ref);
+    MAKE_LEAF(leaf_ref);
+#if defined(INTEGER_CONTEXT_SHORTENING)
+    leaf_ref->min_csl_ = UINT8_MAX;
+#endif
+
+    for (j = 0; j < leaf_size; j++) {
+      line = lines__[i + j];
+      Graph_Insert_Line_(leaf_ref, j, &line);
+#if defined(INTEGER_CONTEXT_SHORTENING)
+      graph_leaf_set_csl_(leaf_ref, j, (csl__) ? csl__[i + j] : 0);
+#endif
+    }
+    count++;
+  }
+
+#if defined(RAS_CONTEXT_SHORTENING)
+  for (i = 0; i < size__; i++)
+    UWT_Insert(&(Graph__->uwt_), i, (csl__) ? csl__[i] : 0);
+#elif !defined(INTEGER_CONTEXT_SHORTENING)
+  UNUSED(csl__);
+#endif
+
+#if defined(ENABLE_BTREE_NODES)
+  uint32_t k, n, nodes;
+  NodeRef node_ref;
+
+  /* build the tree level by level with children evenly distributed */
+  while (count > 1) {
+    nodes = (count + BTREE_FANOUT - 1) / BTREE_FANOUT;
+
+    for (n = 0, k = 0; n < nodes; n++) {
+      MemPtr node = Memory_new_node(Graph__->mem_);
+      node_ref = MEMORY_GET_NODE(Graph__->mem_, node);
+      memset(node_ref, 0, sizeof(node_32e));
+
+      node_ref->count_ = count / nodes + ((n < count % nodes) ? 1 : 0);
+      memcpy(node_ref->children_, &(leaves[k]), node_ref->count_ * sizeof(MemPtr));
+      k += node_ref->count_;
+
+      graph_btree_recount_(Graph__, node_ref);
+      leaves[n] = node;
+    }
+    count = nodes;
+  }
+  Graph__->root_ = leaves[0];
+#else
+  uint32_t height = 0;
+  while ((1u << height) < count)
+    height++;
+
+  Graph__->root_ = graph_build_subtree_(Graph__, leaves, count, 0, height);
+#endif
+
+  free_(leaves);
+
+#ifdef ENABLE_LOOKUP_CACHE
+  reset_cache(Graph__->cache_);
+#endif
+}
+
+/*
+ * Copy given subtree into new memory in depth first order.
+ *
+ * Full width P vectors are moved to the new leaves (old leaves don't own
+ * them anymore).
+ *
+ * @param  Graph__  Reference to Graph_Struct object.
+ * @param  mem__  New memory object.
+ * @param  current__  Root of the subtree in the old memory.
+ *
+ * @return  Root of the subtree in the new memory.
+ */
+static MemPtr graph_compact_subtree_(GraphRef Graph__, MemObj mem__, MemPtr current__) {
+  MemPtr copy;
+
+  if (IS_LEAF(current__)) {
+    LeafRef leaf_ref = MEMORY_GET_LEAF(Graph__->mem_, current__);
+
+    copy = Memory_new_leaf(mem__);
+    LeafRef copy_ref = MEMORY_GET_LEAF(mem__, copy);
+
+#if defined(ENABLE_SPLIT_LEAVES)
+    PayloadRef payload = copy_ref->payload_;
+
+    *payload = *(leaf_ref->payload_);
+    *copy_ref = *leaf_ref;
+    copy_ref->payload_ = payload;
+#else
+    *copy_ref = *leaf_ref;
+#endif
+
+#if defined(ENABLE_PACKED_FREQUENCY)
+    LEAF_PAYLOAD(leaf_ref)->wideP_ = NULL;
+#endif
+    return copy;
+  }
+
+  /* parent is placed before its children */
+  NodeRef node_ref = MEMORY_GET_NODE(Graph__->mem_, current__);
+
+  copy = Memory_new_node(mem__);
+  NodeRef copy_ref = MEMORY_GET_NODE(mem__, copy);
+
+  *copy_ref = *node_ref;
+
+#if defined(ENABLE_BTREE_NODES)
+  uint32_t i;
+
+  for (i = 0; i < node_ref->count_; i++)
+    copy_ref->children_[i] = graph_compact_subtree_(Graph__, mem__, node_ref->children_[i]);
+#else
+  copy_ref->left_ = graph_compact_subtree_(Graph__, mem__, node_ref->left_);
+  copy_ref->right_ = graph_compact_subtree_(Graph__, mem__, node_ref->right_);
+#endif
+
+  return copy;
+}
+
+void Graph_Compact(GraphRef Graph__) {
+  MemObj mem;
+  LinePos lines = MEMORY_GET_ANY(Graph__->mem_, Graph__->root_)->p_;
+
+  STRUCTURE_VERBOSE(
+    printf("[structure]: Compacting graph with %" PRI_POS " lines\n", lines);
+  )
+
+  mem = graph_memory_init_(lines);
+  Graph__->root_ = graph_compact_subtree_(Graph__, mem, Graph__->root_);
+
+  Memory_free(&(Graph__->mem_));
+  Graph__->mem_ = mem;
+
+#if defined(ENABLE_GRAPH_COMPACTION)
+  Graph__->inserts_ = 0;
+#endif
+
+#ifdef ENABLE_LOOKUP_CACHE
+  reset_cache(Graph__->cache_);
+#endif
 }
 
-void GLine_Insert(GraphRef Graph__, uint32_t pos__, GLineRef line__) {
-  int32_t split_mask, split_offset;
+void GLine_Insert(GraphRef Graph__, LinePos pos__, GLineRef line__) {
+  int32_t split_offset;
+  LeafVector split_mask;
   int32_t mask;
   MemPtr current;
-  uint32_t temp;
+  LinePos temp;
 
   assert(pos__ <= MEMORY_GET_ANY(Graph__->mem_, Graph__->root_)->p_);
 
+#if defined(ENABLE_GRAPH_COMPACTION)
+  if (++Graph__->inserts_ >= COMPACT_INTERVAL)
+    Graph_Compact(Graph__);
+#endif
+
+#if defined(INTEGER_CONTEXT_SHORTENING)
+  uint8_t csl;
+  bool append = (pos__ == MEMORY_GET_ANY(Graph__->mem_, Graph__->root_)->p_);
+#endif
+
 #ifdef ENABLE_LOOKUP_CACHE
-  reset_cache();
+  LinePos cache_pos = pos__;
 #endif
 
-  STACK_CLEAN();
+  STACK_CLEAN(Graph__->stack_);
 
   STRUCTURE_VERBOSE(
-    printf("[structure]: Inserting new line on position %u\n", pos__);
+    printf("[structure]: Inserting new line on position %" PRI_POS "\n", pos__);
   )
 
 #if defined(RAS_CONTEXT_SHORTENING)
-  UWT_Insert(&uwt, pos__, 0);
+  UWT_Insert(&(Graph__->uwt_), pos__, 0);
 #endif
 
   /* traverse the tree and enter correct leaf */
   mask = GET_MASK_FROM_VALUE(line__->W_);
   current = Graph__->root_;
 
+#if defined(ENABLE_BTREE_NODES)
+  uint32_t idx;
+  node_prefix delta;
+
+  memset(&delta, 0, sizeof(delta));
+  delta.rL_ = line__->L_;
+  graph_btree_line_counters_(&delta, mask, line__->P_, 1);
+#endif
+
   while (!IS_LEAF(current)) {
-    STACK_PUSH(current);
+    STACK_PUSH(Graph__->stack_, current);
     /* update p and r counters as we are traversing the structure */
     node_32e* node = MEMORY_GET_NODE(Graph__->mem_, current);
     node->p_ += 1;
@@ -152,6 +975,28 @@ void GLine_Insert(GraphRef Graph__, uint32_t pos__, GLineRef line__) {
     node->rW_[6] += ((mask & 0x2) && (mask & 0x4) && (mask & 0x8));
     node->rW_[7] += ((mask & 0x1) && (mask & 0x2) && (mask & 0x4) && (mask & 0x8));
 
+    if (line__->W_ != VALUE_$)
+      node->f_[line__->W_ >> 0x1] += line__->P_;
+
+#if defined(INTEGER_CONTEXT_SHORTENING)
+    /* line appended to the end has zero csl until it is set */
+    if (append)
+      node->min_csl_ = 0;
+#endif
+
+#if defined(ENABLE_BTREE_NODES)
+    UNUSED(temp);
+    BTREE_CHILD_BY_POS(node, pos__, idx);
+    STACK_SET_INDEX(Graph__->stack_, idx);
+    graph_btree_prefix_add_(node, idx, 1, &delta);
+
+#if defined(INTEGER_CONTEXT_SHORTENING)
+    if (append)
+      node->child_csl_[idx] = 0;
+#endif
+
+    current = node->children_[idx];
+#else
     temp = MEMORY_GET_ANY(Graph__->mem_, node->left_)->p_;
     if (temp > pos__) {
       current = node->left_;
@@ -159,12 +1004,26 @@ void GLine_Insert(GraphRef Graph__, uint32_t pos__, GLineRef line__) {
       pos__ -= temp;
       current = node->right_;
     }
+#endif
   }
 
   LeafRef current_ref = MEMORY_GET_LEAF(Graph__->mem_, current);
 
-  if (current_ref->p_ < 32) {
+#if defined(INTEGER_CONTEXT_SHORTENING)
+  /* New line takes csl of the line it moves (which is in the same subtree and thus no minimal
+   * csl changes) until it is explicitly set. There is no such line at the end of the graph. */
+  csl = (append) ? 0 : LEAF_GET_CSL(current_ref, pos__);
+#endif
+
+#ifdef ENABLE_LOOKUP_CACHE
+  finger_line_inserted(Graph__->cache_, Graph__->stack_, cache_pos, current);
+#endif
+
+  if (current_ref->p_ < LEAF_SIZE) {
     Graph_Insert_Line_(current_ref, pos__, line__);
+#if defined(INTEGER_CONTEXT_SHORTENING)
+    graph_leaf_set_csl_(current_ref, pos__, csl);
+#endif
 
   } else {
     /* current leaf is full and we have to split it */
@@ -172,10 +1031,19 @@ void GLine_Insert(GraphRef Graph__, uint32_t pos__, GLineRef line__) {
       printf("[structure]: Leaf is and will be split\n");
     )
 
+#ifdef ENABLE_LOOKUP_CACHE
+    finger_node_changed(Graph__->cache_, STACK_DEPTH(Graph__->stack_), current);
+#endif
+
+#if defined(ENABLE_BTREE_NODES)
+    /* allocate new right leaf and reuse current as left leaf */
+    MemPtr right = Memory_new_leaf(Graph__->mem_);
+    LeafRef right_ref = MEMORY_GET_LEAF(Graph__->mem_, right);
+#else
     MemPtr node = Memory_new_node(Graph__->mem_);
     NodeRef node_ref = MEMORY_GET_NODE(Graph__->mem_, node);
 
-    node_ref->p_ = 33;
+    node_ref->p_ = LEAF_SIZE + 1;
     node_ref->rL_ = current_ref->rL_ + line__->L_;
 
     node_ref->rW_[0] = GET_RVECTOR(current_ref, 0) + ((mask & 0x8) >> 0x3);
@@ -187,51 +1055,67 @@ void GLine_Insert(GraphRef Graph__, uint32_t pos__, GLineRef line__) {
     node_ref->rW_[6] = GET_RVECTOR(current_ref, 6) + ((mask & 0x2) && (mask & 0x4) && (mask & 0x8));
     node_ref->rW_[7] = GET_RVECTOR(current_ref, 7) + ((mask & 0x1) && (mask & 0x2) && (mask & 0x4) && (mask & 0x8));
 
+    memcpy(node_ref->f_, current_ref->f_, sizeof(node_ref->f_));
+    if (line__->W_ != VALUE_$)
+      node_ref->f_[line__->W_ >> 0x1] += line__->P_;
+
     /* allocate new right leaf and reuse current as left leaf */
     node_ref->right_ = Memory_new_leaf(Graph__->mem_);
     node_ref->left_ = current;
 
     MAKE_NODE(node_ref);
 
-    STACK_PUSH(node);
+    STACK_PUSH(Graph__->stack_, node);
+#endif
 
-    /* find a position for clever splitting */
-    split_mask = 0xFFFF;
+    /* find a position for clever splitting (so that left leaf ends with set L bit) */
     split_offset = 0;
 
-    if ((current_ref->vectorL_ >> 16) & 0x1) {
+    if (LEAF_BIT(current_ref->vectorL_, LEAF_HALF - 1)) {
       /* do nothing */
-    } else if ((current_ref->vectorL_ >> 15) & 0x1) {
-      split_mask = 0x7FFF;
+    } else if (LEAF_BIT(current_ref->vectorL_, LEAF_HALF)) {
       split_offset = 1;
-    } else if ((current_ref->vectorL_ >> 17) & 0x1) {
-      split_mask = 0x1FFFF;
+    } else if (LEAF_BIT(current_ref->vectorL_, LEAF_HALF - 2)) {
       split_offset = -1;
-    } else if ((current_ref->vectorL_ >> 14) & 0x1) {
-      split_mask = 0x3FFF;
+    } else if (LEAF_BIT(current_ref->vectorL_, LEAF_HALF + 1)) {
       split_offset = 2;
     } else {
       /* FATAL("Node split unsuccessful, structure is corrupted."); */
     }
+    split_mask = LEAF_SUFFIX(LEAF_HALF + split_offset);
 
     /* initialize new right node */
+#if !defined(ENABLE_BTREE_NODES)
     LeafRef right_ref = MEMORY_GET_LEAF(Graph__->mem_, node_ref->right_);
-    right_ref->vectorL_ = 0x0 | ((current_ref->vectorL_ & (split_mask)) << (16 + split_offset));
-
-    right_ref->vectorW_[0] = 0x0 | ((current_ref->vectorW_[0] & (split_mask)) << (16 + split_offset));
-    right_ref->vectorW_[1] = 0x0 | ((current_ref->vectorW_[1] & (split_mask)) << (16 + split_offset));
-    right_ref->vectorW_[2] = 0x0 | ((current_ref->vectorW_[2] & (split_mask)) << (16 + split_offset));
-    right_ref->vectorW_[3] = 0x0 | ((current_ref->vectorW_[3] & (split_mask)) << (16 + split_offset));
-
-    memcpy(right_ref->vectorP_, current_ref->vectorP_ + 16 + split_offset,
-           (16 - split_offset) * sizeof(uint32_t));
+#endif
+    right_ref->vectorL_ = 0x0 | ((current_ref->vectorL_ & (split_mask)) << (LEAF_HALF + split_offset));
+
+    right_ref->vectorW_[0] = 0x0 | ((current_ref->vectorW_[0] & (split_mask)) << (LEAF_HALF + split_offset));
+    right_ref->vectorW_[1] = 0x0 | ((current_ref->vectorW_[1] & (split_mask)) << (LEAF_HALF + split_offset));
+    right_ref->vectorW_[2] = 0x0 | ((current_ref->vectorW_[2] & (split_mask)) << (LEAF_HALF + split_offset));
+    right_ref->vectorW_[3] = 0x0 | ((current_ref->vectorW_[3] & (split_mask)) << (LEAF_HALF + split_offset));
+
+#if defined(ENABLE_PACKED_FREQUENCY)
+    /* right leaf gets full width counters only if its own values need them */
+    int32_t i;
+
+    LEAF_PAYLOAD(right_ref)->wideP_ = NULL;
+    for (i = 0; i < LEAF_HALF - split_offset; i++)
+      graph_leaf_set_p_(right_ref, i, LEAF_GET_P(current_ref, LEAF_HALF + split_offset + i));
+#else
+    memcpy(LEAF_PAYLOAD(right_ref)->vectorP_,
+           LEAF_PAYLOAD(current_ref)->vectorP_ + LEAF_HALF + split_offset,
+           (LEAF_HALF - split_offset) * sizeof(uint32_t));
+#endif
 
 #ifdef INTEGER_CONTEXT_SHORTENING
-    memcpy(right_ref->context_, current_ref->context_ + 16 + split_offset,
-           (16 - split_offset) * sizeof(*current_ref->context_));
+    graph_leaf_copy_csl_(right_ref, current_ref, LEAF_HALF + split_offset);
 #endif
 
-    right_ref->p_ = 16 - split_offset;
+    right_ref->p_ = LEAF_HALF - split_offset;
+#ifdef INTEGER_CONTEXT_SHORTENING
+    graph_leaf_update_min_csl_(right_ref);
+#endif
 
     /* calculate rank on newly created leaf */
     right_ref->rL_ = RANK(right_ref->vectorL_);
@@ -243,6 +1127,7 @@ void GLine_Insert(GraphRef Graph__, uint32_t pos__, GLineRef line__) {
     right_ref->rW_[5] = RANK((right_ref->vectorW_[0]) & (~(right_ref->vectorW_[1])) & (right_ref->vectorW_[2]));
     right_ref->rW_[6] = RANK((right_ref->vectorW_[0]) & (right_ref->vectorW_[1]) & (right_ref->vectorW_[2]));
     right_ref->rW_[7] = RANK((right_ref->vectorW_[0]) & (right_ref->vectorW_[1]) & (right_ref->vectorW_[2]) & (right_ref->vectorW_[3]));
+    Graph_Leaf_frequency_(right_ref);
 
     MAKE_LEAF(right_ref);
 
@@ -254,7 +1139,10 @@ void GLine_Insert(GraphRef Graph__, uint32_t pos__, GLineRef line__) {
     current_ref->vectorW_[2] = current_ref->vectorW_[2] & (~split_mask);
     current_ref->vectorW_[3] = current_ref->vectorW_[3] & (~split_mask);
 
-    current_ref->p_ = 16 + split_offset;
+    current_ref->p_ = LEAF_HALF + split_offset;
+#ifdef INTEGER_CONTEXT_SHORTENING
+    graph_leaf_update_min_csl_(current_ref);
+#endif
 
     /* recalculate rank on old shrinked leaf */
     current_ref->rL_ = RANK(current_ref->vectorL_);
@@ -267,21 +1155,33 @@ void GLine_Insert(GraphRef Graph__, uint32_t pos__, GLineRef line__) {
     current_ref->rW_[5] = RANK((current_ref->vectorW_[0]) & (~(current_ref->vectorW_[1])) & (current_ref->vectorW_[2]));
     current_ref->rW_[6] = RANK((current_ref->vectorW_[0]) & (current_ref->vectorW_[1]) & (current_ref->vectorW_[2]));
     current_ref->rW_[7] = RANK((current_ref->vectorW_[0]) & (current_ref->vectorW_[1]) & (current_ref->vectorW_[2]) & (current_ref->vectorW_[3]));
+    Graph_Leaf_frequency_(current_ref);
 
     MAKE_LEAF(current_ref);
 
     /* now insert bit into correct leaf */
-    if (pos__ < (uint32_t)(16 + split_offset)) {
+    if (pos__ < (LinePos)(LEAF_HALF + split_offset)) {
       Graph_Insert_Line_(current_ref, pos__, line__);
+#if defined(INTEGER_CONTEXT_SHORTENING)
+      graph_leaf_set_csl_(current_ref, pos__, csl);
+#endif
     } else {
-      Graph_Insert_Line_(right_ref, pos__ - (16 + split_offset), line__);
+      Graph_Insert_Line_(right_ref, pos__ - (LEAF_HALF + split_offset), line__);
+#if defined(INTEGER_CONTEXT_SHORTENING)
+      graph_leaf_set_csl_(right_ref, pos__ - (LEAF_HALF + split_offset), csl);
+#endif
     }
 
+#if defined(ENABLE_BTREE_NODES)
+    graph_btree_insert_child_(Graph__, current, right);
+#else
+    GRAPH_UPDATE_MIN_CSL(Graph__, node_ref);
+
     /* finally exchange pointers to new node */
-    if (STACK_GET_PARENT() == STACK_ERROR) {
+    if (STACK_GET_PARENT(Graph__->stack_) == STACK_ERROR) {
       Graph__->root_ = node;
     } else {
-      NodeRef parent = MEMORY_GET_NODE(Graph__->mem_, STACK_GET_PARENT());
+      NodeRef parent = MEMORY_GET_NODE(Graph__->mem_, STACK_GET_PARENT(Graph__->stack_));
       if (parent->left_ == current)
         parent->left_ = node;
       else
@@ -301,25 +1201,25 @@ void GLine_Insert(GraphRef Graph__, uint32_t pos__, GLineRef line__) {
 
     do {
       /* current node is the root - change it to black and end */
-      if (STACK_GET_PARENT() == STACK_ERROR) {
+      if (STACK_GET_PARENT(Graph__->stack_) == STACK_ERROR) {
         MAKE_BLACK(node_ref);
         return;
       }
 
-      MemPtr parent_idx = STACK_GET_PARENT();
+      MemPtr parent_idx = STACK_GET_PARENT(Graph__->stack_);
       NodeRef parent = MEMORY_GET_NODE(Graph__->mem_, parent_idx);
       /* parent node is a black node - do nothing */
       if (!IS_RED(parent)) {
         return;
       }
 
-      MemPtr grandparent_idx = STACK_GET_GRANDPARENT();
+      MemPtr grandparent_idx = STACK_GET_GRANDPARENT(Graph__->stack_);
       NodeRef grandparent = MEMORY_GET_NODE(Graph__->mem_, grandparent_idx);
 
       /* get uncle */
       MemPtr uncle_idx = grandparent->left_;
       grandparent_left = false;
-      if (grandparent->left_ == STACK_GET_PARENT()) {
+      if (grandparent->left_ == STACK_GET_PARENT(Graph__->stack_)) {
         uncle_idx = grandparent->right_;
         grandparent_left = true;
       }
@@ -334,12 +1234,15 @@ void GLine_Insert(GraphRef Graph__, uint32_t pos__, GLineRef line__) {
 
         node = grandparent_idx;
         node_ref = grandparent;
-        STACK_POP();
-        STACK_POP();
+        STACK_POP(Graph__->stack_);
+        STACK_POP(Graph__->stack_);
         continue;
       }
 
       /* uncle is black - time for rotations */
+#ifdef ENABLE_LOOKUP_CACHE
+      finger_node_changed(Graph__->cache_, STACK_DEPTH(Graph__->stack_) - 3, grandparent_idx);
+#endif
       parent_left = true;
       if (node == parent->right_) {
         parent_left = false;
@@ -356,6 +1259,9 @@ void GLine_Insert(GraphRef Graph__, uint32_t pos__, GLineRef line__) {
         MAKE_RED(grandparent);
         MAKE_BLACK(parent);
 
+        GRAPH_UPDATE_MIN_CSL(Graph__, grandparent);
+        GRAPH_UPDATE_MIN_CSL(Graph__, parent);
+
         newroot = parent_idx;
       } else if (!parent_left && !grandparent_left) {
         grandparent->right_ = parent->left_;
@@ -367,6 +1273,9 @@ void GLine_Insert(GraphRef Graph__, uint32_t pos__, GLineRef line__) {
         MAKE_RED(grandparent);
         MAKE_BLACK(parent);
 
+        GRAPH_UPDATE_MIN_CSL(Graph__, grandparent);
+        GRAPH_UPDATE_MIN_CSL(Graph__, parent);
+
         newroot = parent_idx;
       } else if (!parent_left && grandparent_left) {
         grandparent->left_ = node_ref->right_;
@@ -384,6 +1293,10 @@ void GLine_Insert(GraphRef Graph__, uint32_t pos__, GLineRef line__) {
         MAKE_RED(grandparent);
         MAKE_BLACK(node_ref);
 
+        GRAPH_UPDATE_MIN_CSL(Graph__, parent);
+        GRAPH_UPDATE_MIN_CSL(Graph__, grandparent);
+        GRAPH_UPDATE_MIN_CSL(Graph__, node_ref);
+
         newroot = node;
       } else if (parent_left && !grandparent_left) {
         grandparent->right_ = node_ref->left_;
@@ -401,14 +1314,18 @@ void GLine_Insert(GraphRef Graph__, uint32_t pos__, GLineRef line__) {
         MAKE_RED(grandparent);
         MAKE_BLACK(node_ref);
 
+        GRAPH_UPDATE_MIN_CSL(Graph__, parent);
+        GRAPH_UPDATE_MIN_CSL(Graph__, grandparent);
+        GRAPH_UPDATE_MIN_CSL(Graph__, node_ref);
+
         newroot = node;
       }
 
       /* finally exchange pointers to new node */
-      if (STACK_GET_GRANDGRANDPARENT() == STACK_ERROR) {
+      if (STACK_GET_GRANDGRANDPARENT(Graph__->stack_) == STACK_ERROR) {
         Graph__->root_ = newroot;
       } else {
-        NodeRef grandgrandparent = MEMORY_GET_NODE(Graph__->mem_, STACK_GET_GRANDGRANDPARENT());
+        NodeRef grandgrandparent = MEMORY_GET_NODE(Graph__->mem_, STACK_GET_GRANDGRANDPARENT(Graph__->stack_));
         if (grandgrandparent->left_ == grandparent_idx)
           grandgrandparent->left_ = newroot;
         else
@@ -418,6 +1335,7 @@ void GLine_Insert(GraphRef Graph__, uint32_t pos__, GLineRef line__) {
     } while (true);
 
 #endif  /* ENABLE_RED_BLACK_BALANCING */
+#endif  /* ENABLE_BTREE_NODES */
   }
 }
 
@@ -436,79 +1354,675 @@ void GLine_Explode(GLineRef line__, Graph_value* L__, Graph_value* W__, uint32_t
 }
 
 void Graph_Print(GraphRef Graph__) {
-  int32_t i, size;
+  Graph_Iterator iter;
   Graph_Line line;
 
   printf("  L  W   P\n-----------------\n");
 
-  size = Graph_Size(Graph__);
-  for (i = 0; i < size; i++) {
-    printf("%3d: ", i);
-    GLine_Get(Graph__, i, &line);
+  if (!Graph_Size(Graph__)) return;
+
+  Graph_Iterator_Init(&iter, Graph__, 0);
+  do {
+    printf("%3" PRI_POS ": ", Graph_Iterator_Position(&iter));
+    Graph_Iterator_Get(&iter, &line);
     printf("%d  %d   %d\n", line.L_, line.W_, line.P_);
-  }
+  } while (Graph_Iterator_Next(&iter));
 }
 
-void GLine_Get(GraphRef Graph__, uint32_t pos__, GLineRef line__) {
+/*
+ * Get one line from given leaf.
+ *
+ * @param  leaf_ref__  Reference to the leaf.
+ * @param  pos__  Position within the leaf.
+ * @param  line__  [Out] Reference to Graph_Line object.
+ */
+void graph_leaf_get_line_(LeafRef leaf_ref__, uint32_t pos__, GLineRef line__) {
   int32_t wavelet_mask;
+
+  wavelet_mask = LEAF_BIT(leaf_ref__->vectorW_[3], pos__) |
+                 LEAF_BIT(leaf_ref__->vectorW_[2], pos__) << 0x1 |
+                 LEAF_BIT(leaf_ref__->vectorW_[1], pos__) << 0x2 |
+                 LEAF_BIT(leaf_ref__->vectorW_[0], pos__) << 0x3;
+
+  line__->L_ = LEAF_BIT(leaf_ref__->vectorL_, pos__);
+  line__->W_ = GET_VALUE_FROM_MASK(wavelet_mask);
+  line__->P_ = LEAF_GET_P(leaf_ref__, pos__);
+}
+
+void GLine_Get(GraphRef Graph__, LinePos pos__, GLineRef line__) {
   MemPtr current;
   LeafRef leaf_ref;
 
   STRUCTURE_VERBOSE(
-    printf("[structure]: Getting line at position %u\n", pos__);
+    printf("[structure]: Getting line at position %" PRI_POS "\n", pos__);
   )
 
-  GET_TARGET_LEAF(Graph__, pos__, current, leaf_ref, WITHOUT_STACK);
-
-  wavelet_mask = (leaf_ref->vectorW_[3] >> (31 - pos__) & 0x1) |
-                 (leaf_ref->vectorW_[2] >> (31 - pos__) & 0x1) << 0x1 |
-                 (leaf_ref->vectorW_[1] >> (31 - pos__) & 0x1) << 0x2 |
-                 (leaf_ref->vectorW_[0] >> (31 - pos__) & 0x1) << 0x3;
-
-  line__->L_ = leaf_ref->vectorL_ >> (31 - pos__) & 0x1;
-  line__->W_ = GET_VALUE_FROM_MASK(wavelet_mask);
-  line__->P_ = leaf_ref->vectorP_[pos__];
+  GET_TARGET_LEAF(Graph__, pos__, current, leaf_ref, WITHOUT_STACK, CACHE_GET);
+  graph_leaf_get_line_(leaf_ref, pos__, line__);
 }
 
-int32_t Graph_Size(GraphRef Graph__) {
+/*
+ * Remove one line from the leaf.
+ *
+ * @param  leaf__  Reference to the leaf.
+ * @param  pos__  Position of the removed line.
+ * @param  line__  [Out] Reference to Graph_Line object for the removed line.
+ */
+static void graph_delete_line_(LeafRef leaf__, uint32_t pos__, GLineRef line__) {
+  int32_t i;
+  LeafVector mask = LEAF_PREFIX(pos__);
+  PayloadRef payload = LEAF_PAYLOAD(leaf__);
+#if defined(INTEGER_CONTEXT_SHORTENING)
+  int32_t csl = LEAF_GET_CSL(leaf__, pos__);
+#endif
+
+  graph_leaf_get_line_(leaf__, pos__, line__);
+
+  /* all later bits are moved one position back */
+  leaf__->vectorL_ = (leaf__->vectorL_ & mask) | ((leaf__->vectorL_ << 1) & ~mask);
+  for (i = 0; i < 4; i++)
+    leaf__->vectorW_[i] = (leaf__->vectorW_[i] & mask) | ((leaf__->vectorW_[i] << 1) & ~mask);
+
+#if defined(ENABLE_PACKED_FREQUENCY)
+  if (payload->wideP_ != NULL)
+    memmove(&(payload->wideP_[pos__]), &(payload->wideP_[pos__ + 1]),
+            (leaf__->p_ - pos__ - 1) * sizeof(*payload->wideP_));
+  else
+#endif
+  memmove(&(payload->vectorP_[pos__]), &(payload->vectorP_[pos__ + 1]),
+          (leaf__->p_ - pos__ - 1) * sizeof(*payload->vectorP_));
+#if defined(INTEGER_CONTEXT_SHORTENING)
+  graph_leaf_unshift_csl_(leaf__, pos__);
+#endif
+
+  graph_line_counters_((NodeRef) leaf__, line__, -1);
+
+#if defined(INTEGER_CONTEXT_SHORTENING)
+  if (csl == leaf__->min_csl_)
+    graph_leaf_update_min_csl_(leaf__);
+#endif
+}
+
+/*
+ * Move all lines of one leaf to the end of its left neighbor.
+ *
+ * @param  dst__  Reference to the left leaf.
+ * @param  src__  Reference to the right leaf (its content is not changed).
+ */
+static void graph_leaf_append_(LeafRef dst__, LeafRef src__) {
+  uint32_t i;
+  Graph_Line line;
+
+  assert(dst__->p_ + src__->p_ <= LEAF_SIZE);
+
+  for (i = 0; i < src__->p_; i++) {
+    graph_leaf_get_line_(src__, i, &line);
+    Graph_Insert_Line_(dst__, dst__->p_, &line);
+#if defined(INTEGER_CONTEXT_SHORTENING)
+    graph_leaf_set_csl_(dst__, dst__->p_ - 1, LEAF_GET_CSL(src__, i));
+#endif
+  }
+}
+
+#if defined(ENABLE_BTREE_NODES)
+
+/*
+ * Remove child from B+ tree node (its counters are not changed).
+ *
+ * @param  node_ref__  Reference to the node.
+ * @param  idx__  Index of the removed child.
+ */
+static void graph_btree_remove_child_(NodeRef node_ref__, uint32_t idx__) {
+  memmove(&(node_ref__->children_[idx__]), &(node_ref__->children_[idx__ + 1]),
+          (node_ref__->count_ - idx__ - 1) * sizeof(MemPtr));
+  node_ref__->count_--;
+}
+
+/*
+ * Merge leaf with its neighbor or remove it if it is empty.
+ *
+ * Path to the leaf must be in the stack (with child indexes). Nodes left
+ * without children are removed as well and the root with only one child is
+ * replaced by it, so that all leaves stay on the same level.
+ *
+ * @param  Graph__  Reference to Graph_Struct object.
+ * @param  leaf__  Leaf one line was removed from.
+ *
+ * @return  Whether the tree was changed.
+ */
+static bool graph_btree_merge_leaf_(GraphRef Graph__, MemPtr leaf__) {
+  int32_t level = STACK_DEPTH(Graph__->stack_) - 1;
+  uint32_t idx;
+  MemPtr removed;
+  NodeRef node_ref;
+  LeafRef leaf_ref = MEMORY_GET_LEAF(Graph__->mem_, leaf__);
+  LeafRef sibling_ref;
+
+  if (level < 0)
+    return false;
+
+  node_ref = MEMORY_GET_NODE(Graph__->mem_, Graph__->stack_->stack_[level]);
+  idx = Graph__->stack_->index_[level];
+
+  /* find the child to remove */
+  if (leaf_ref->p_ == 0) {
+    removed = leaf__;
+  } else if (idx + 1 < node_ref->count_ &&
+             (sibling_ref = MEMORY_GET_LEAF(Graph__->mem_, node_ref->children_[idx + 1]))->p_ +
+                 leaf_ref->p_ <= LEAF_MERGE_SIZE) {
+    graph_leaf_append_(leaf_ref, sibling_ref);
+    removed = node_ref->children_[++idx];
+  } else if (idx > 0 &&
+             (sibling_ref = MEMORY_GET_LEAF(Graph__->mem_, node_ref->children_[idx - 1]))->p_ +
+                 leaf_ref->p_ <= LEAF_MERGE_SIZE) {
+    graph_leaf_append_(sibling_ref, leaf_ref);
+    removed = leaf__;
+  } else {
+    return false;
+  }
+
+  STRUCTURE_VERBOSE(
+    printf("[structure]: Removing leaf from the tree\n");
+  )
+
+  Memory_free_leaf(Graph__->mem_, removed);
+  graph_btree_remove_child_(node_ref, idx);
+
+  /* empty nodes are removed from their parents */
+  while (node_ref->count_ == 0 && level > 0) {
+    Memory_free_node(Graph__->mem_, Graph__->stack_->stack_[level]);
+    level--;
+
+    node_ref = MEMORY_GET_NODE(Graph__->mem_, Graph__->stack_->stack_[level]);
+    graph_btree_remove_child_(node_ref, Graph__->stack_->index_[level]);
+  }
+  graph_btree_recount_(Graph__, node_ref);
+
+  /* tree gets one level lower */
+  while (!IS_LEAF(Graph__->root_) &&
+         MEMORY_GET_NODE(Graph__->mem_, Graph__->root_)->count_ == 1) {
+    removed = Graph__->root_;
+    Graph__->root_ = MEMORY_GET_NODE(Graph__->mem_, removed)->children_[0];
+    Memory_free_node(Graph__->mem_, removed);
+  }
+  return true;
+}
+
+#else  /* defined(ENABLE_BTREE_NODES) */
+
+/* Whether given node is red (leaves are always black). */
+#define GRAPH_IS_RED(Graph__, ptr__) \
+  (!IS_LEAF(ptr__) && IS_RED(MEMORY_GET_NODE((Graph__)->mem_, ptr__)))
+
+/*
+ * Replace child of the node on the top of the stack (or the root).
+ *
+ * @param  Graph__  Reference to Graph_Struct object.
+ * @param  old__  Replaced child.
+ * @param  new__  New child.
+ */
+static void graph_replace_child_(GraphRef Graph__, MemPtr old__, MemPtr new__) {
+  NodeRef parent;
+
+  if (STACK_TOP(Graph__->stack_) == STACK_ERROR) {
+    Graph__->root_ = new__;
+    return;
+  }
+
+  parent = MEMORY_GET_NODE(Graph__->mem_, STACK_TOP(Graph__->stack_));
+  if (parent->left_ == old__)
+    parent->left_ = new__;
+  else
+    parent->right_ = new__;
+}
+
+#ifdef ENABLE_RED_BLACK_BALANCING
+
+/*
+ * Recalculate all counters of the node from its children.
+ *
+ * Color of the node is lost with embedded flags and it must be set again.
+ *
+ * @param  Graph__  Reference to Graph_Struct object.
+ * @param  node_ref__  Reference to the node.
+ */
+static void graph_node_recount_(GraphRef Graph__, NodeRef node_ref__) {
+  NodeRef left = MEMORY_GET_ANY(Graph__->mem_, node_ref__->left_);
+  NodeRef right = MEMORY_GET_ANY(Graph__->mem_, node_ref__->right_);
+
+  UNUSED(Graph__);
+
+  NODE_OPERATION_3(node_ref__, left, right, +);
+  GRAPH_UPDATE_MIN_CSL(Graph__, node_ref__);
+}
+
+/*
+ * Rotate the node so that one of its children takes its place.
+ *
+ * The child gets color of the node and the node becomes red. Parent of the
+ * node must be on the top of the stack.
+ *
+ * @param  Graph__  Reference to Graph_Struct object.
+ * @param  node__  Rotated node.
+ * @param  left__  Whether the right child goes up (left rotation) or the left one.
+ *
+ * @return  Child which took place of the node.
+ */
+static MemPtr graph_rotate_(GraphRef Graph__, MemPtr node__, bool left__) {
+  NodeRef node_ref = MEMORY_GET_NODE(Graph__->mem_, node__);
+  MemPtr child = (left__) ? node_ref->right_ : node_ref->left_;
+  NodeRef child_ref = MEMORY_GET_NODE(Graph__->mem_, child);
+  bool red = IS_RED(node_ref) != 0;
+
+  if (left__) {
+    node_ref->right_ = child_ref->left_;
+    child_ref->left_ = node__;
+  } else {
+    node_ref->left_ = child_ref->right_;
+    child_ref->right_ = node__;
+  }
+
+  graph_node_recount_(Graph__, node_ref);
+  graph_node_recount_(Graph__, child_ref);
+  graph_replace_child_(Graph__, node__, child);
+
+  MAKE_RED(node_ref);
+  if (red)
+    MAKE_RED(child_ref);
+  else
+    MAKE_BLACK(child_ref);
+  return child;
+}
+
+/*
+ * Rebalance the tree after one black node was removed from all paths going
+ * through given node.
+ *
+ * Path to the parent of the node must be in the stack (and it is destroyed).
+ *
+ * @param  Graph__  Reference to Graph_Struct object.
+ * @param  node__  Root of the subtree with lower black height.
+ */
+static void graph_delete_fixup_(GraphRef Graph__, MemPtr node__) {
+  bool left;
+  MemPtr far;
+  MemPtr parent;
+  MemPtr sibling;
+  NodeRef parent_ref;
+  NodeRef sibling_ref;
+
+  while (STACK_TOP(Graph__->stack_) != STACK_ERROR && !GRAPH_IS_RED(Graph__, node__)) {
+    parent = STACK_TOP(Graph__->stack_);
+    parent_ref = MEMORY_GET_NODE(Graph__->mem_, parent);
+    left = (parent_ref->left_ == node__);
+
+    /* sibling subtree has higher black height and thus it is never a leaf */
+    sibling = (left) ? parent_ref->right_ : parent_ref->left_;
+
+    /* red sibling - move it above the parent and continue with the new black one */
+    if (GRAPH_IS_RED(Graph__, sibling)) {
+      STACK_POP(Graph__->stack_);
+      graph_rotate_(Graph__, parent, left);
+      STACK_PUSH(Graph__->stack_, sibling);
+      STACK_PUSH(Graph__->stack_, parent);
+      sibling = (left) ? parent_ref->right_ : parent_ref->left_;
+    }
+    sibling_ref = MEMORY_GET_NODE(Graph__->mem_, sibling);
+
+    /* both children of sibling are black - move the problem one level up */
+    if (!GRAPH_IS_RED(Graph__, sibling_ref->left_) && !GRAPH_IS_RED(Graph__, sibling_ref->right_)) {
+      MAKE_RED(sibling_ref);
+      node__ = STACK_POP(Graph__->stack_);
+      continue;
+    }
+
+    /* near child of sibling is red - move it above the sibling */
+    far = (left) ? sibling_ref->right_ : sibling_ref->left_;
+    if (!GRAPH_IS_RED(Graph__, far)) {
+      sibling = graph_rotate_(Graph__, sibling, !left);
+      sibling_ref = MEMORY_GET_NODE(Graph__->mem_, sibling);
+      far = (left) ? sibling_ref->right_ : sibling_ref->left_;
+    }
+
+    /* far child of sibling is red - move sibling above the parent */
+    STACK_POP(Graph__->stack_);
+    graph_rotate_(Graph__, parent, left);
+    MAKE_BLACK(parent_ref);
+    MAKE_BLACK(MEMORY_GET_NODE(Graph__->mem_, far));
+    return;
+  }
+
+  /* red node (or the root) absorbs the missing black */
+  if (!IS_LEAF(node__))
+    MAKE_BLACK(MEMORY_GET_NODE(Graph__->mem_, node__));
+}
+
+#endif  /* ENABLE_RED_BLACK_BALANCING */
+
+/*
+ * Merge leaf with its sibling or remove it if it is empty.
+ *
+ * Parent of the leaf is removed together with one of the leaves and the
+ * other child takes its place. Path to the parent must be in the stack (and
+ * it is destroyed).
+ *
+ * @param  Graph__  Reference to Graph_Struct object.
+ * @param  leaf__  Leaf one line was removed from.
+ *
+ * @return  Whether the tree was changed.
+ */
+static bool graph_merge_leaf_(GraphRef Graph__, MemPtr leaf__) {
+  MemPtr parent;
+  MemPtr removed;
+  MemPtr sibling;
+  NodeRef parent_ref;
+  LeafRef leaf_ref = MEMORY_GET_LEAF(Graph__->mem_, leaf__);
+
+  if ((parent = STACK_TOP(Graph__->stack_)) == STACK_ERROR)
+    return false;
+
+  parent_ref = MEMORY_GET_NODE(Graph__->mem_, parent);
+  sibling = (parent_ref->left_ == leaf__) ? parent_ref->right_ : parent_ref->left_;
+
+  if (leaf_ref->p_ == 0) {
+    removed = leaf__;
+  } else if (IS_LEAF(sibling) &&
+             MEMORY_GET_LEAF(Graph__->mem_, sibling)->p_ + leaf_ref->p_ <= LEAF_MERGE_SIZE) {
+    graph_leaf_append_(MEMORY_GET_LEAF(Graph__->mem_, parent_ref->left_),
+                       MEMORY_GET_LEAF(Graph__->mem_, parent_ref->right_));
+    removed = parent_ref->right_;
+    sibling = parent_ref->left_;
+  } else {
+    return false;
+  }
+
+  STRUCTURE_VERBOSE(
+    printf("[structure]: Removing leaf from the tree\n");
+  )
+
+  bool red = IS_RED(parent_ref) != 0;
+
+  STACK_POP(Graph__->stack_);
+  graph_replace_child_(Graph__, parent, sibling);
+  Memory_free_node(Graph__->mem_, parent);
+  Memory_free_leaf(Graph__->mem_, removed);
+
+#ifdef ENABLE_RED_BLACK_BALANCING
+  /* removed black node is missing on all paths to the sibling */
+  if (!red)
+    graph_delete_fixup_(Graph__, sibling);
+#else
+  UNUSED(red);
+#endif
+  return true;
+}
+
+#endif  /* defined(ENABLE_BTREE_NODES) */
+
+void GLine_Delete(GraphRef Graph__, LinePos pos__) {
+  int32_t i;
+  bool changed;
+  MemPtr current;
+  LeafRef leaf_ref;
+  Graph_Line line;
+
+#if defined(ENABLE_LOOKUP_CACHE) || defined(RAS_CONTEXT_SHORTENING)
+  LinePos global_pos = pos__;
+#endif
+
+  STRUCTURE_VERBOSE(
+    printf("[structure]: Deleting line on position %" PRI_POS "\n", pos__);
+  )
+
+#if defined(RAS_CONTEXT_SHORTENING)
+  UWT_Delete(&(Graph__->uwt_), global_pos);
+#endif
+
+  GET_TARGET_LEAF(Graph__, pos__, current, leaf_ref, WITH_STACK, CACHE_GET)
+  graph_delete_line_(leaf_ref, pos__, &line);
+
+  /* update counters on the whole path */
+#if defined(ENABLE_BTREE_NODES)
+  node_prefix delta;
+
+  memset(&delta, 0, sizeof(delta));
+  delta.rL_ = -(LineIdx) line.L_;
+  graph_btree_line_counters_(&delta, GET_MASK_FROM_VALUE(line.W_), line.P_, -1);
+
+  for (i = STACK_DEPTH(Graph__->stack_) - 1; i >= 0; i--) {
+    NodeRef node_ref = MEMORY_GET_NODE(Graph__->mem_, Graph__->stack_->stack_[i]);
+    graph_line_counters_(node_ref, &line, -1);
+    graph_btree_prefix_add_(node_ref, Graph__->stack_->index_[i], -1, &delta);
+#if defined(INTEGER_CONTEXT_SHORTENING)
+    graph_btree_update_min_csl_(Graph__, node_ref, Graph__->stack_->index_[i]);
+#endif
+  }
+#else
+  for (i = STACK_DEPTH(Graph__->stack_) - 1; i >= 0; i--) {
+    NodeRef node_ref = MEMORY_GET_NODE(Graph__->mem_, Graph__->stack_->stack_[i]);
+    graph_line_counters_(node_ref, &line, -1);
+    GRAPH_UPDATE_MIN_CSL(Graph__, node_ref);
+  }
+#endif
+
+#ifdef ENABLE_LOOKUP_CACHE
+  finger_line_deleted(Graph__->cache_, Graph__->stack_, global_pos, current);
+#endif
+
+  /* leaves which got too small are merged with their neighbors */
+#if defined(ENABLE_BTREE_NODES)
+  changed = graph_btree_merge_leaf_(Graph__, current);
+#else
+  changed = graph_merge_leaf_(Graph__, current);
+#endif
+
+#ifdef ENABLE_LOOKUP_CACHE
+  if (changed)
+    reset_cache(Graph__->cache_);
+#else
+  UNUSED(changed);
+#endif
+}
+
+/*
+ * Descend from current iterator position to the first (or last) line of the subtree.
+ *
+ * @param  iter__  Reference to Graph_Iterator object.
+ * @param  first__  Whether first or last line should be entered.
+ */
+void graph_iterator_descend_(GIterRef iter__, bool first__) {
+  NodeRef node_ref;
+
+  while (!IS_LEAF(iter__->current_)) {
+    if (iter__->depth_ >= MAX_STACK_SIZE)
+      FATAL("Stack overflow");
+    iter__->path_[iter__->depth_] = iter__->current_;
+
+    node_ref = MEMORY_GET_NODE(iter__->Graph_->mem_, iter__->current_);
+#if defined(ENABLE_BTREE_NODES)
+    iter__->index_[iter__->depth_] = (first__) ? 0 : node_ref->count_ - 1;
+    iter__->current_ = node_ref->children_[iter__->index_[iter__->depth_]];
+#else
+    iter__->current_ = (first__) ? node_ref->left_ : node_ref->right_;
+#endif
+    iter__->depth_++;
+  }
+  iter__->leaf_ = MEMORY_GET_LEAF(iter__->Graph_->mem_, iter__->current_);
+  iter__->pos_ = (first__) ? 0 : iter__->leaf_->p_ - 1;
+}
+
+/*
+ * Move iterator into the neighbouring leaf.
+ *
+ * @param  iter__  Reference to Graph_Iterator object.
+ * @param  next__  Whether next or previous leaf should be entered.
+ *
+ * @return  False if there is no such leaf (iterator is not moved).
+ */
+bool graph_iterator_step_leaf_(GIterRef iter__, bool next__) {
+  int32_t depth;
+  MemPtr child;
+  NodeRef node_ref;
+
+  /* climb up until current subtree is not the last (or first) child */
+#if defined(ENABLE_BTREE_NODES)
+  UNUSED(child);
+  for (depth = iter__->depth_ - 1; depth >= 0; depth--) {
+    node_ref = MEMORY_GET_NODE(iter__->Graph_->mem_, iter__->path_[depth]);
+    if (next__ && iter__->index_[depth] + 1 < node_ref->count_) break;
+    if (!next__ && iter__->index_[depth] > 0) break;
+  }
+
+  if (depth < 0)
+    return false;
+
+  iter__->index_[depth] += (next__) ? 1 : -1;
+  iter__->depth_ = depth + 1;
+  iter__->current_ = node_ref->children_[iter__->index_[depth]];
+#else
+  child = iter__->current_;
+  for (depth = iter__->depth_ - 1; depth >= 0; depth--) {
+    node_ref = MEMORY_GET_NODE(iter__->Graph_->mem_, iter__->path_[depth]);
+    if (next__ && node_ref->left_ == child) break;
+    if (!next__ && node_ref->right_ == child) break;
+    child = iter__->path_[depth];
+  }
+
+  if (depth < 0)
+    return false;
+
+  iter__->depth_ = depth + 1;
+  iter__->current_ = (next__) ? node_ref->right_ : node_ref->left_;
+#endif
+  graph_iterator_descend_(iter__, next__);
+  return true;
+}
+
+void Graph_Iterator_Init(GIterRef iter__, GraphRef Graph__, LinePos pos__) {
+  LinePos temp;
+  NodeRef node_ref;
+
+  STRUCTURE_VERBOSE(
+    printf("[structure]: Initializing iterator at position %" PRI_POS "\n", pos__);
+  )
+
+  assert(pos__ < MEMORY_GET_ANY(Graph__->mem_, Graph__->root_)->p_);
+
+  iter__->Graph_ = Graph__;
+  iter__->idx_ = pos__;
+  iter__->depth_ = 0;
+  iter__->current_ = Graph__->root_;
+
+  while (!IS_LEAF(iter__->current_)) {
+    if (iter__->depth_ >= MAX_STACK_SIZE)
+      FATAL("Stack overflow");
+    iter__->path_[iter__->depth_] = iter__->current_;
+
+    node_ref = MEMORY_GET_NODE(Graph__->mem_, iter__->current_);
+#if defined(ENABLE_BTREE_NODES)
+    UNUSED(temp);
+    BTREE_CHILD_BY_POS(node_ref, pos__, iter__->index_[iter__->depth_]);
+    iter__->current_ = node_ref->children_[iter__->index_[iter__->depth_]];
+#else
+    temp = MEMORY_GET_ANY(Graph__->mem_, node_ref->left_)->p_;
+    if (temp > pos__) {
+      iter__->current_ = node_ref->left_;
+    } else {
+      pos__ -= temp;
+      iter__->current_ = node_ref->right_;
+    }
+#endif
+    iter__->depth_++;
+  }
+  iter__->leaf_ = MEMORY_GET_LEAF(Graph__->mem_, iter__->current_);
+  iter__->pos_ = pos__;
+}
+
+bool Graph_Iterator_Next(GIterRef iter__) {
+  if (iter__->pos_ + 1 < iter__->leaf_->p_) {
+    iter__->pos_++;
+  } else if (!graph_iterator_step_leaf_(iter__, true)) {
+    return false;
+  }
+  iter__->idx_++;
+  return true;
+}
+
+bool Graph_Iterator_Prev(GIterRef iter__) {
+  if (iter__->pos_ > 0) {
+    iter__->pos_--;
+  } else if (!graph_iterator_step_leaf_(iter__, false)) {
+    return false;
+  }
+  iter__->idx_--;
+  return true;
+}
+
+void Graph_Iterator_Get(GIterRef iter__, GLineRef line__) {
+  graph_leaf_get_line_(iter__->leaf_, iter__->pos_, line__);
+}
+
+LineIdx Graph_Size(GraphRef Graph__) {
   NodeRef node_ref = MEMORY_GET_ANY(Graph__->mem_, Graph__->root_);
   return node_ref->p_;
 }
 
-void Graph_Change_symbol(GraphRef Graph__, uint32_t pos__, Graph_value val__) {
+void Graph_Change_symbol(GraphRef Graph__, LinePos pos__, Graph_value val__) {
   int32_t nchar_mask, ochar_mask;
+  Graph_value nchar_value, ochar_value;
+  uint32_t freq;
   MemPtr current;
 
   NodeRef node_ref;
   LeafRef leaf_ref;
 
   STRUCTURE_VERBOSE(
-    printf("[structure]: Changing symbol at position %u to %d\n", pos__, val__);
+    printf("[structure]: Changing symbol at position %" PRI_POS " to %d\n", pos__, val__);
   )
 
-  GET_TARGET_LEAF(Graph__, pos__, current, leaf_ref, WITH_STACK);
+  GET_TARGET_LEAF(Graph__, pos__, current, leaf_ref, WITH_STACK, CACHE_CHANGE_SYMBOL);
 
   /* get masks for both characters */
   nchar_mask = GET_MASK_FROM_VALUE(val__);
-  ochar_mask = (leaf_ref->vectorW_[3] >> (31 - pos__) & 0x1) |
-               (leaf_ref->vectorW_[2] >> (31 - pos__) & 0x1) << 0x1 |
-               (leaf_ref->vectorW_[1] >> (31 - pos__) & 0x1) << 0x2 |
-               (leaf_ref->vectorW_[0] >> (31 - pos__) & 0x1) << 0x3;
+  ochar_mask = LEAF_BIT(leaf_ref->vectorW_[3], pos__) |
+               LEAF_BIT(leaf_ref->vectorW_[2], pos__) << 0x1 |
+               LEAF_BIT(leaf_ref->vectorW_[1], pos__) << 0x2 |
+               LEAF_BIT(leaf_ref->vectorW_[0], pos__) << 0x3;
+
+  /* frequency of the line moves from old symbol to the new one */
+  freq = LEAF_GET_P(leaf_ref, pos__);
+  nchar_value = GET_VALUE_FROM_MASK(nchar_mask);
+  ochar_value = GET_VALUE_FROM_MASK(ochar_mask);
 
   /* change old character to the new one */
 
   leaf_ref->vectorW_[0] ^=
-      (-(unsigned) (!!(nchar_mask & 0x8)) ^ leaf_ref->vectorW_[0]) & (0x1 << (31 - pos__));
+      (-(LeafVector) (!!(nchar_mask & 0x8)) ^ leaf_ref->vectorW_[0]) & LEAF_LINE(pos__);
   leaf_ref->vectorW_[1] ^=
-      (-(unsigned) (!!(nchar_mask & 0x4)) ^ leaf_ref->vectorW_[1]) & (0x1 << (31 - pos__));
+      (-(LeafVector) (!!(nchar_mask & 0x4)) ^ leaf_ref->vectorW_[1]) & LEAF_LINE(pos__);
   leaf_ref->vectorW_[2] ^=
-      (-(unsigned) (!!(nchar_mask & 0x2)) ^ leaf_ref->vectorW_[2]) & (0x1 << (31 - pos__));
+      (-(LeafVector) (!!(nchar_mask & 0x2)) ^ leaf_ref->vectorW_[2]) & LEAF_LINE(pos__);
   leaf_ref->vectorW_[3] ^=
-      (-(unsigned) (!!(nchar_mask & 0x1)) ^ leaf_ref->vectorW_[3]) & (0x1 << (31 - pos__));
+      (-(LeafVector) (!!(nchar_mask & 0x1)) ^ leaf_ref->vectorW_[3]) & LEAF_LINE(pos__);
+
+#if defined(ENABLE_BTREE_NODES)
+  int32_t idx = -1;
+  node_prefix delta;
+
+  memset(&delta, 0, sizeof(delta));
+  graph_btree_line_counters_(&delta, ochar_mask, freq, -1);
+  graph_btree_line_counters_(&delta, nchar_mask, freq, 1);
+#endif
 
   do {
     node_ref = MEMORY_GET_ANY(Graph__->mem_, current);
 
+#if defined(ENABLE_BTREE_NODES)
+    if (idx >= 0)
+      graph_btree_prefix_add_(node_ref, idx, 0, &delta);
+    idx = STACK_GET_INDEX(Graph__->stack_);
+#endif
+
     /* decrease counters */
     if (ochar_mask & 0x8) node_ref->rW_[0] -= 1;
     if ((ochar_mask & 0x4) && ((~ochar_mask) & 0x8)) node_ref->rW_[1] -= 1;
@@ -529,54 +2043,144 @@ void Graph_Change_symbol(GraphRef Graph__, uint32_t pos__, Graph_value val__) {
     if ((nchar_mask & 0x2) && (nchar_mask & 0x4) && (nchar_mask & 0x8)) node_ref->rW_[6] += 1;
     if ((nchar_mask & 0x1) && (nchar_mask & 0x2) && (nchar_mask & 0x4) && (nchar_mask & 0x8)) node_ref->rW_[7] += 1;
 
-    current = STACK_POP();
+    /* move frequency */
+    if (ochar_value != VALUE_$) node_ref->f_[ochar_value >> 0x1] -= freq;
+    if (nchar_value != VALUE_$) node_ref->f_[nchar_value >> 0x1] += freq;
+
+    current = STACK_POP(Graph__->stack_);
   } while (current != STACK_ERROR);
 }
 
-void Graph_Increase_frequency(GraphRef Graph__, uint32_t pos__, uint32_t amount__) {
+void Graph_Increase_frequency(GraphRef Graph__, LinePos pos__, uint32_t amount__) {
+  int32_t wavelet_mask;
+  Graph_value value;
   MemPtr current;
   LeafRef leaf_ref;
 
   STRUCTURE_VERBOSE(
-    printf("[structure]: Increasing frequency of transition at position %u\n", pos__);
+    printf("[structure]: Increasing frequency of transition at position %" PRI_POS "\n", pos__);
   )
 
-  GET_TARGET_LEAF(Graph__, pos__, current, leaf_ref, WITHOUT_STACK)
-  leaf_ref->vectorP_[pos__] += amount__;
+  GET_TARGET_LEAF(Graph__, pos__, current, leaf_ref, WITH_STACK, CACHE_INCREASE_FREQUENCY)
+  graph_leaf_set_p_(leaf_ref, pos__, LEAF_GET_P(leaf_ref, pos__) + amount__);
+
+  wavelet_mask = LEAF_BIT(leaf_ref->vectorW_[3], pos__) |
+                 LEAF_BIT(leaf_ref->vectorW_[2], pos__) << 0x1 |
+                 LEAF_BIT(leaf_ref->vectorW_[1], pos__) << 0x2 |
+                 LEAF_BIT(leaf_ref->vectorW_[0], pos__) << 0x3;
+
+  /* dollar lines are not part of any frequency counter */
+  value = GET_VALUE_FROM_MASK(wavelet_mask);
+  if (value == VALUE_$) return;
+
+#if defined(ENABLE_BTREE_NODES)
+  node_prefix delta;
+
+  memset(&delta, 0, sizeof(delta));
+  delta.f_[value >> 0x1] = amount__;
+  leaf_ref->f_[value >> 0x1] += amount__;
+
+  /* update frequency counters on the whole path */
+  while ((current = STACK_TOP(Graph__->stack_)) != STACK_ERROR) {
+    NodeRef node_ref = MEMORY_GET_NODE(Graph__->mem_, current);
+    node_ref->f_[value >> 0x1] += amount__;
+    graph_btree_prefix_add_(node_ref, STACK_GET_INDEX(Graph__->stack_), 0, &delta);
+    STACK_POP(Graph__->stack_);
+  }
+#else
+  /* update frequency counters on the whole path */
+  do {
+    MEMORY_GET_ANY(Graph__->mem_, current)->f_[value >> 0x1] += amount__;
+    current = STACK_POP(Graph__->stack_);
+  } while (current != STACK_ERROR);
+#endif
 }
 
-void Graph_Get_symbol_frequency(GraphRef Graph__, uint32_t pos__, cfreq* freq__) {
+/*
+ * Get symbol frequencies of node spanning over more leaves.
+ *
+ * This is slower version of Graph_Get_symbol_frequency using graph iterator.
+ *
+ * @param  Graph__  Reference to Graph_Struct object.
+ * @param  pos__  Edge index (line) in deBruijn graph.
+ * @param  freq__  [Out] Frequency count structure.
+ */
+void graph_symbol_frequency_iter_(GraphRef Graph__, LinePos pos__, cfreq* freq__) {
+  int32_t cnt;
+  Graph_Iterator iter;
+  Graph_Line line;
+
+  Graph_Iterator_Init(&iter, Graph__, pos__);
+
+  /* get to the beginning of this node */
+  while (Graph_Iterator_Prev(&iter)) {
+    Graph_Iterator_Get(&iter, &line);
+    if (line.L_) {
+      Graph_Iterator_Next(&iter);
+      break;
+    }
+  }
+
+  /* clear freq structure */
+  cnt = 0;
+  memset(freq__, 0, sizeof(*freq__));
+
+  /* go through all transitions in this node */
+  do {
+    Graph_Iterator_Get(&iter, &line);
+    if (line.W_ == VALUE_$) {
+      return;
+    }
+    cnt++;
+
+    freq__->symbol_[line.W_ >> 0x1] = line.P_;
+    freq__->total_ += line.P_;
+  } while (!line.L_ && Graph_Iterator_Next(&iter));
+
+  freq__->symbol_[VALUE_ESC >> 0x1] = cnt;
+  freq__->total_ += cnt;
+}
+
+void Graph_Get_symbol_frequency(GraphRef Graph__, LinePos pos__, cfreq* freq__) {
   MemPtr current;
   Graph_value value;
   LeafRef leaf_ref;
   int32_t l_bit, ochar_mask, cnt;
 
   STRUCTURE_VERBOSE(
-    printf("[structure]: Getting symbol frequency at position %u\n", pos__);
+    printf("[structure]: Getting symbol frequency at position %" PRI_POS "\n", pos__);
   )
 
-  GET_TARGET_LEAF(Graph__, pos__, current, leaf_ref, WITHOUT_STACK)
+  LinePos idx = pos__;
+  GET_TARGET_LEAF(Graph__, pos__, current, leaf_ref, WITHOUT_STACK, CACHE_SYMBOL_FREQUENCY)
 
   /* get to the beginning of this node */
   int32_t pos = (int32_t) pos__;
   pos--;
   while (pos >= 0) {
-    l_bit = leaf_ref->vectorL_ >> (31 - pos) & 0x1;
+    l_bit = LEAF_BIT(leaf_ref->vectorL_, pos);
     if (l_bit) break;
     pos--;
   }
   pos++;
 
+  /* node starts in some previous leaf or it ends in some next one */
+  LeafVector mask = LEAF_SUFFIX(pos) & LEAF_PREFIX(leaf_ref->p_);
+  if ((pos == 0 && idx != pos__) || !(leaf_ref->vectorL_ & mask)) {
+    graph_symbol_frequency_iter_(Graph__, idx, freq__);
+    return;
+  }
+
   /* clear freq structure */
   cnt = 0;
   memset(freq__, 0, sizeof(*freq__));
 
   /* go through all transitions in this node */
   do {
-    ochar_mask = (leaf_ref->vectorW_[3] >> (31 - pos) & 0x1) |
-                 (leaf_ref->vectorW_[2] >> (31 - pos) & 0x1) << 0x1 |
-                 (leaf_ref->vectorW_[1] >> (31 - pos) & 0x1) << 0x2 |
-                 (leaf_ref->vectorW_[0] >> (31 - pos) & 0x1) << 0x3;
+    ochar_mask = LEAF_BIT(leaf_ref->vectorW_[3], pos) |
+                 LEAF_BIT(leaf_ref->vectorW_[2], pos) << 0x1 |
+                 LEAF_BIT(leaf_ref->vectorW_[1], pos) << 0x2 |
+                 LEAF_BIT(leaf_ref->vectorW_[0], pos) << 0x3;
 
     value = GET_VALUE_FROM_MASK(ochar_mask);
     if (value == VALUE_$) {
@@ -584,10 +2188,10 @@ void Graph_Get_symbol_frequency(GraphRef Graph__, uint32_t pos__, cfreq* freq__)
     }
     cnt++;
 
-    freq__->symbol_[value >> 0x1] = leaf_ref->vectorP_[pos];
-    freq__->total_ += leaf_ref->vectorP_[pos];
+    freq__->symbol_[value >> 0x1] = LEAF_GET_P(leaf_ref, pos);
+    freq__->total_ += freq__->symbol_[value >> 0x1];
 
-    l_bit = leaf_ref->vectorL_ >> (31 - pos++) & 0x1;
+    l_bit = LEAF_BIT(leaf_ref->vectorL_, pos++);
     if (l_bit) break;
   } while (1);
 
@@ -595,23 +2199,115 @@ void Graph_Get_symbol_frequency(GraphRef Graph__, uint32_t pos__, cfreq* freq__)
   freq__->total_ += cnt;
 }
 
-int32_t Graph_Find_Edge(GraphRef Graph__, uint32_t pos__, Graph_value val__) {
+/*
+ * Sum symbol frequencies of all lines before given position.
+ *
+ * @param  Graph__  Reference to Graph_Struct object.
+ * @param  pos__  Query position.
+ * @param  freq__  [Out] Frequency sums for each symbol.
+ */
+void graph_frequency_prefix_(GraphRef Graph__, LinePos pos__, LinePos freq__[SYMBOL_COUNT]) {
+  int32_t i, wavelet_mask;
+  Graph_value value;
+  MemPtr current;
+  NodeRef node_ref;
+  NodeRef left_child;
+  LeafRef leaf_ref;
+
+  memset(freq__, 0, SYMBOL_COUNT * sizeof(*freq__));
+
+  /* whole structure is requested */
+  node_ref = MEMORY_GET_ANY(Graph__->mem_, Graph__->root_);
+  if (pos__ >= node_ref->p_) {
+    memcpy(freq__, node_ref->f_, SYMBOL_COUNT * sizeof(*freq__));
+    return;
+  }
+
+  /* traverse the tree and sum counters of all subtrees left of the path */
+  current = Graph__->root_;
+#if defined(ENABLE_BTREE_NODES)
+  uint32_t idx;
+  UNUSED(left_child);
+
+  while (!IS_LEAF(current)) {
+    node_ref = MEMORY_GET_NODE(Graph__->mem_, current);
+
+    BTREE_CHILD_BY_POS(node_ref, pos__, idx);
+    if (idx)
+      for (i = 0; i < SYMBOL_COUNT; i++)
+        freq__[i] += node_ref->prefix_[idx - 1].f_[i];
+    current = node_ref->children_[idx];
+  }
+#else
+  while (!IS_LEAF(current)) {
+    node_ref = MEMORY_GET_NODE(Graph__->mem_, current);
+    left_child = MEMORY_GET_ANY(Graph__->mem_, node_ref->left_);
+
+    if (left_child->p_ > pos__) {
+      current = node_ref->left_;
+    } else {
+      pos__ -= left_child->p_;
+      current = node_ref->right_;
+
+      for (i = 0; i < SYMBOL_COUNT; i++)
+        freq__[i] += left_child->f_[i];
+    }
+  }
+#endif
+  leaf_ref = MEMORY_GET_LEAF(Graph__->mem_, current);
+
+  /* handle last leaf of this query */
+  for (i = 0; i < (int32_t) pos__; i++) {
+    wavelet_mask = LEAF_BIT(leaf_ref->vectorW_[3], i) |
+                   LEAF_BIT(leaf_ref->vectorW_[2], i) << 0x1 |
+                   LEAF_BIT(leaf_ref->vectorW_[1], i) << 0x2 |
+                   LEAF_BIT(leaf_ref->vectorW_[0], i) << 0x3;
+
+    value = GET_VALUE_FROM_MASK(wavelet_mask);
+    if (value != VALUE_$)
+      freq__[value >> 0x1] += LEAF_GET_P(leaf_ref, i);
+  }
+}
+
+void Graph_Get_symbol_frequency_range(GraphRef Graph__, LinePos lo__, LinePos up__, cfreq* freq__) {
+  int32_t i;
+  LinePos lower[SYMBOL_COUNT];
+  LinePos upper[SYMBOL_COUNT];
+
+  STRUCTURE_VERBOSE(
+    printf("[structure]: Getting symbol frequency in range %" PRI_POS " - %" PRI_POS "\n", lo__, up__);
+  )
+
+  memset(freq__, 0, sizeof(*freq__));
+  if (up__ < lo__) return;
+
+  graph_frequency_prefix_(Graph__, lo__, lower);
+  graph_frequency_prefix_(Graph__, up__ + 1, upper);
+
+  for (i = 0; i < SYMBOL_COUNT; i++) {
+    freq__->symbol_[i] = upper[i] - lower[i];
+    freq__->total_ += freq__->symbol_[i];
+  }
+}
+
+LineIdx Graph_Find_Edge(GraphRef Graph__, LinePos pos__, Graph_value val__) {
   MemPtr current;
   Graph_value value;
   LeafRef leaf_ref;
-  int32_t l_bit, ochar_mask, backup = (int32_t) pos__;
+  int32_t l_bit, ochar_mask;
+  LineIdx backup = (LineIdx) pos__;
 
   STRUCTURE_VERBOSE(
-    printf("[structure]: Looking for transition for symbol %d at position %u\n", val__, pos__);
+    printf("[structure]: Looking for transition for symbol %d at position %" PRI_POS "\n", val__, pos__);
   )
 
-  GET_TARGET_LEAF(Graph__, pos__, current, leaf_ref, WITHOUT_STACK)
+  GET_TARGET_LEAF(Graph__, pos__, current, leaf_ref, WITHOUT_STACK, CACHE_FIND_EDGE)
 
   /* get to the beginning of this node */
   int32_t pos = (int32_t) pos__;
   pos--;
   while (pos >= 0) {
-    l_bit = leaf_ref->vectorL_ >> (31 - pos) & 0x1;
+    l_bit = LEAF_BIT(leaf_ref->vectorL_, pos);
     if (l_bit) break;
     pos--;
   }
@@ -619,60 +2315,350 @@ int32_t Graph_Find_Edge(GraphRef Graph__, uint32_t pos__, Graph_value val__) {
 
   /* go through all transitions in this node */
   do {
-    ochar_mask = (leaf_ref->vectorW_[3] >> (31 - pos) & 0x1) |
-                 (leaf_ref->vectorW_[2] >> (31 - pos) & 0x1) << 0x1 |
-                 (leaf_ref->vectorW_[1] >> (31 - pos) & 0x1) << 0x2 |
-                 (leaf_ref->vectorW_[0] >> (31 - pos) & 0x1) << 0x3;
+    ochar_mask = LEAF_BIT(leaf_ref->vectorW_[3], pos) |
+                 LEAF_BIT(leaf_ref->vectorW_[2], pos) << 0x1 |
+                 LEAF_BIT(leaf_ref->vectorW_[1], pos) << 0x2 |
+                 LEAF_BIT(leaf_ref->vectorW_[0], pos) << 0x3;
 
     value = GET_VALUE_FROM_MASK(ochar_mask);
     if ((value & 0xE) == (val__ & 0xE)) {
       return backup + (pos - (int32_t) pos__);
     }
 
-    l_bit = leaf_ref->vectorL_ >> (31 - pos++) & 0x1;
+    l_bit = LEAF_BIT(leaf_ref->vectorL_, pos++);
     if (l_bit) break;
   } while (1);
 
   return -1;
 }
 
+LineIdx Graph_Forward(GraphRef Graph__, LinePos pos__, const LineIdx F__[SYMBOL_COUNT]) {
+  LinePos ranks[VALUE_$ + 1];
+  Graph_value value;
+
+  STRUCTURE_VERBOSE(
+    printf("[structure]: Following transition at position %" PRI_POS "\n", pos__);
+  )
+
+  /* find edge label of given edge and its rank in the W array */
+  value = graph_rank_W_access_(*Graph__, pos__, ranks);
+
+  /* if edge label is dollar, there is nowhere to go */
+  if (value == VALUE_$) return -1;
+
+  /* get index of the last edge of the node pointed to by given edge */
+  return graph_Lselect_from_(*Graph__, F__[value >> 0x1], ranks[value & 0xE]) - 1;
+}
+
 #if defined(INTEGER_CONTEXT_SHORTENING) || defined(RAS_CONTEXT_SHORTENING)
 
-void Graph_Set_csl(GraphRef Graph__, uint32_t pos__, int32_t csl__) {
+void Graph_Set_csl(GraphRef Graph__, LinePos pos__, int32_t csl__) {
   STRUCTURE_VERBOSE(
-    printf("[structure]: Setting common suffix len at position %u\n", pos__);
+    printf("[structure]: Setting common suffix len at position %" PRI_POS "\n", pos__);
   )
 
 #if defined(INTEGER_CONTEXT_SHORTENING)
   MemPtr current;
   LeafRef leaf_ref;
 
-  GET_TARGET_LEAF(Graph__, pos__, current, leaf_ref, WITHOUT_STACK)
-  leaf_ref->context_[pos__] = csl__;
+  GET_TARGET_LEAF(Graph__, pos__, current, leaf_ref, WITH_STACK, CACHE_CSL)
+  graph_leaf_set_csl_(leaf_ref, pos__, csl__);
+
+  /* update minimal csl values on the whole path */
+#if defined(ENABLE_BTREE_NODES)
+  while ((current = STACK_TOP(Graph__->stack_)) != STACK_ERROR) {
+    NodeRef node_ref = MEMORY_GET_NODE(Graph__->mem_, current);
+    graph_btree_update_min_csl_(Graph__, node_ref, STACK_GET_INDEX(Graph__->stack_));
+    STACK_POP(Graph__->stack_);
+  }
+#else
+  while ((current = STACK_POP(Graph__->stack_)) != STACK_ERROR) {
+    NodeRef node_ref = MEMORY_GET_NODE(Graph__->mem_, current);
+    GRAPH_UPDATE_MIN_CSL(Graph__, node_ref);
+  }
+#endif
 #elif defined(RAS_CONTEXT_SHORTENING)
   UNUSED(Graph__);
 
-  UWT_Delete(&uwt, pos__);
-  UWT_Insert(&uwt, pos__, csl__);
+  UWT_Delete(&(Graph__->uwt_), pos__);
+  UWT_Insert(&(Graph__->uwt_), pos__, csl__);
 #endif
 }
 
-int32_t Graph_Get_csl(GraphRef Graph__, uint32_t pos__) {
+int32_t Graph_Get_csl(GraphRef Graph__, LinePos pos__) {
   STRUCTURE_VERBOSE(
-    printf("[structure]: Getting common suffix len at position %u\n", pos__);
+    printf("[structure]: Getting common suffix len at position %" PRI_POS "\n", pos__);
   )
 
 #if defined(INTEGER_CONTEXT_SHORTENING)
   MemPtr current;
   LeafRef leaf_ref;
 
-  GET_TARGET_LEAF(Graph__, pos__, current, leaf_ref, WITHOUT_STACK)
-  return leaf_ref->context_[pos__];
+  GET_TARGET_LEAF(Graph__, pos__, current, leaf_ref, WITHOUT_STACK, CACHE_CSL)
+  return LEAF_GET_CSL(leaf_ref, pos__);
 #elif defined(RAS_CONTEXT_SHORTENING)
-  UNUSED(Graph__);
+  return UWT_Get(&(Graph__->uwt_), pos__);
+#endif
+}
+
+#if defined(INTEGER_CONTEXT_SHORTENING) || defined(RAS_CONTEXT_SHORTENING)
+
+int32_t Graph_Iterator_Get_csl(GIterRef iter__) {
+#if defined(INTEGER_CONTEXT_SHORTENING)
+  return LEAF_GET_CSL(iter__->leaf_, iter__->pos_);
+#elif defined(RAS_CONTEXT_SHORTENING)
+  return UWT_Get(&(iter__->Graph_->uwt_), iter__->idx_);
+#endif
+}
+
+#endif
+
+#if defined(INTEGER_CONTEXT_SHORTENING)
+
+LineIdx Graph_Find_csl_lower(GraphRef Graph__, LinePos pos__, int32_t csl__) {
+  int32_t i;
+  LinePos start;
+  MemPtr current;
+  MemPtr child;
+  NodeRef node_ref;
+  LeafRef leaf_ref;
+
+  STRUCTURE_VERBOSE(
+    printf("[structure]: Looking for csl lower than %d above position %" PRI_POS "\n", csl__, pos__);
+  )
+
+  assert(pos__ < MEMORY_GET_ANY(Graph__->mem_, Graph__->root_)->p_);
+
+  STACK_CLEAN(Graph__->stack_);
+  current = Graph__->root_;
+  start = 0;
 
-  return UWT_Get(&uwt, pos__);
+  /* traverse the tree to the leaf holding starting position */
+#if defined(ENABLE_BTREE_NODES)
+  int32_t idx;
+  UNUSED(child);
+
+  while (!IS_LEAF(current)) {
+    node_ref = MEMORY_GET_NODE(Graph__->mem_, current);
+    BTREE_CHILD_BY_POS(node_ref, pos__, idx);
+    start += BTREE_PREFIX_P(node_ref, idx);
+
+    STACK_PUSH(Graph__->stack_, current);
+    STACK_SET_INDEX(Graph__->stack_, idx);
+    current = node_ref->children_[idx];
+  }
+#else
+  while (!IS_LEAF(current)) {
+    STACK_PUSH(Graph__->stack_, current);
+    node_ref = MEMORY_GET_NODE(Graph__->mem_, current);
+
+    LinePos temp = MEMORY_GET_ANY(Graph__->mem_, node_ref->left_)->p_;
+    if (temp > pos__) {
+      current = node_ref->left_;
+    } else {
+      pos__ -= temp;
+      start += temp;
+      current = node_ref->right_;
+    }
+  }
+#endif
+
+  leaf_ref = MEMORY_GET_LEAF(Graph__->mem_, current);
+  i = graph_leaf_csl_lower_(leaf_ref, pos__, csl__);
+  if (i >= 0)
+    return start + i;
+
+  /* climb up until left sibling subtree contains small enough csl */
+#if defined(ENABLE_BTREE_NODES)
+  while ((current = STACK_TOP(Graph__->stack_)) != STACK_ERROR) {
+    idx = STACK_GET_INDEX(Graph__->stack_);
+    STACK_POP(Graph__->stack_);
+
+    node_ref = MEMORY_GET_NODE(Graph__->mem_, current);
+    start -= BTREE_PREFIX_P(node_ref, idx);
+    for (idx--; idx >= 0 && node_ref->child_csl_[idx] >= csl__; idx--) {}
+
+    if (idx >= 0)
+      break;
+  }
+
+  if (current == STACK_ERROR)
+    return -1;
+
+  /* descend into the left sibling subtree and find the last such line */
+  start += BTREE_PREFIX_P(node_ref, idx);
+  current = node_ref->children_[idx];
+  while (!IS_LEAF(current)) {
+    node_ref = MEMORY_GET_NODE(Graph__->mem_, current);
+
+    for (idx = node_ref->count_ - 1; node_ref->child_csl_[idx] >= csl__; idx--) {}
+    start += BTREE_PREFIX_P(node_ref, idx);
+    current = node_ref->children_[idx];
+  }
+#else
+  child = current;
+  while ((current = STACK_POP(Graph__->stack_)) != STACK_ERROR) {
+    node_ref = MEMORY_GET_NODE(Graph__->mem_, current);
+
+    if (node_ref->right_ == child) {
+      start -= MEMORY_GET_ANY(Graph__->mem_, node_ref->left_)->p_;
+      if (graph_min_csl_(Graph__, node_ref->left_) < csl__)
+        break;
+    }
+    child = current;
+  }
+
+  if (current == STACK_ERROR)
+    return -1;
+
+  /* descend into the left sibling subtree and find the last such line */
+  current = node_ref->left_;
+  while (!IS_LEAF(current)) {
+    node_ref = MEMORY_GET_NODE(Graph__->mem_, current);
+
+    if (graph_min_csl_(Graph__, node_ref->right_) < csl__) {
+      start += MEMORY_GET_ANY(Graph__->mem_, node_ref->left_)->p_;
+      current = node_ref->right_;
+    } else {
+      current = node_ref->left_;
+    }
+  }
+#endif
+
+  leaf_ref = MEMORY_GET_LEAF(Graph__->mem_, current);
+  i = graph_leaf_csl_lower_(leaf_ref, leaf_ref->p_ - 1, csl__);
+  if (i >= 0)
+    return start + i;
+
+  UNREACHABLE;
+  return -1;
+}
+
+LineIdx Graph_Find_csl_upper(GraphRef Graph__, LinePos pos__, int32_t csl__) {
+  uint32_t i;
+  LinePos start;
+  MemPtr current;
+  MemPtr child;
+  NodeRef node_ref;
+  LeafRef leaf_ref;
+
+  STRUCTURE_VERBOSE(
+    printf("[structure]: Looking for csl lower than %d bellow position %" PRI_POS "\n", csl__, pos__);
+  )
+
+  node_ref = MEMORY_GET_ANY(Graph__->mem_, Graph__->root_);
+  if (pos__ >= node_ref->p_)
+    return node_ref->p_;
+
+  STACK_CLEAN(Graph__->stack_);
+  current = Graph__->root_;
+  start = 0;
+
+  /* traverse the tree to the leaf holding starting position */
+#if defined(ENABLE_BTREE_NODES)
+  int32_t idx;
+  UNUSED(child);
+
+  while (!IS_LEAF(current)) {
+    node_ref = MEMORY_GET_NODE(Graph__->mem_, current);
+    BTREE_CHILD_BY_POS(node_ref, pos__, idx);
+    start += BTREE_PREFIX_P(node_ref, idx);
+
+    STACK_PUSH(Graph__->stack_, current);
+    STACK_SET_INDEX(Graph__->stack_, idx);
+    current = node_ref->children_[idx];
+  }
+#else
+  while (!IS_LEAF(current)) {
+    STACK_PUSH(Graph__->stack_, current);
+    node_ref = MEMORY_GET_NODE(Graph__->mem_, current);
+
+    LinePos temp = MEMORY_GET_ANY(Graph__->mem_, node_ref->left_)->p_;
+    if (temp > pos__) {
+      current = node_ref->left_;
+    } else {
+      pos__ -= temp;
+      start += temp;
+      current = node_ref->right_;
+    }
+  }
 #endif
+
+  leaf_ref = MEMORY_GET_LEAF(Graph__->mem_, current);
+  i = graph_leaf_csl_upper_(leaf_ref, pos__, csl__);
+  if (i < leaf_ref->p_)
+    return start + i;
+
+  /* climb up until right sibling subtree contains small enough csl */
+#if defined(ENABLE_BTREE_NODES)
+  while ((current = STACK_TOP(Graph__->stack_)) != STACK_ERROR) {
+    idx = STACK_GET_INDEX(Graph__->stack_);
+    STACK_POP(Graph__->stack_);
+
+    node_ref = MEMORY_GET_NODE(Graph__->mem_, current);
+    start -= BTREE_PREFIX_P(node_ref, idx);
+    for (idx++; (uint32_t) idx < node_ref->count_ && node_ref->child_csl_[idx] >= csl__; idx++) {}
+
+    if ((uint32_t) idx < node_ref->count_)
+      break;
+  }
+
+  if (current == STACK_ERROR)
+    return MEMORY_GET_ANY(Graph__->mem_, Graph__->root_)->p_;
+
+  /* descend into the right sibling subtree and find the first such line */
+  start += BTREE_PREFIX_P(node_ref, idx);
+  current = node_ref->children_[idx];
+  while (!IS_LEAF(current)) {
+    node_ref = MEMORY_GET_NODE(Graph__->mem_, current);
+
+    for (idx = 0; node_ref->child_csl_[idx] >= csl__; idx++) {}
+    start += BTREE_PREFIX_P(node_ref, idx);
+    current = node_ref->children_[idx];
+  }
+#else
+  child = current;
+  while ((current = STACK_POP(Graph__->stack_)) != STACK_ERROR) {
+    node_ref = MEMORY_GET_NODE(Graph__->mem_, current);
+
+    LinePos temp = MEMORY_GET_ANY(Graph__->mem_, node_ref->left_)->p_;
+    if (node_ref->left_ == child) {
+      if (graph_min_csl_(Graph__, node_ref->right_) < csl__) {
+        start += temp;
+        break;
+      }
+    } else {
+      start -= temp;
+    }
+    child = current;
+  }
+
+  if (current == STACK_ERROR)
+    return MEMORY_GET_ANY(Graph__->mem_, Graph__->root_)->p_;
+
+  /* descend into the right sibling subtree and find the first such line */
+  current = node_ref->right_;
+  while (!IS_LEAF(current)) {
+    node_ref = MEMORY_GET_NODE(Graph__->mem_, current);
+
+    if (graph_min_csl_(Graph__, node_ref->left_) < csl__) {
+      current = node_ref->left_;
+    } else {
+      start += MEMORY_GET_ANY(Graph__->mem_, node_ref->left_)->p_;
+      current = node_ref->right_;
+    }
+  }
+#endif
+
+  leaf_ref = MEMORY_GET_LEAF(Graph__->mem_, current);
+  i = graph_leaf_csl_upper_(leaf_ref, 0, csl__);
+  if (i < leaf_ref->p_)
+    return start + i;
+
+  UNREACHABLE;
+  return -1;
 }
 
 #endif  /* INTEGER_CONTEXT_SHORTENING */
+
+#endif  /* defined(INTEGER_CONTEXT_SHORTENING) || defined(RAS_CONTEXT_SHORTENING) */
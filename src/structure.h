@@ -7,6 +7,10 @@
 #include "stack.h"
 #include "utils.h"
 
+#if defined(RAS_CONTEXT_SHORTENING)
+#include "universal.h"
+#endif
+
 #define STRUCTURE_VERBOSE(func) \
   if (STRUCTURE_VERBOSE_) {     \
     func                        \
@@ -35,22 +39,70 @@
     : ((mask__) == 12) ? VALUE_T    \
     : ((mask__) == 14) ? VALUE_Tx : VALUE_$)
 
-#define INSERT_BIT(vector, counter, pos, value) {                        \
-    assert(pos < 32);                                                    \
-    uint32_t mask = ((pos) == 0) ? 0 : (uint32_t)(~(0)) << (32 - (pos)); \
-    uint32_t temp = 0;                                                   \
-                                                                         \
-    temp |= (*vector) & mask;                                            \
-    temp |= (((*vector) & ~(mask))) >> 1;                                \
-    *(vector) = temp;                                                    \
-                                                                         \
-    if (value) {                                                         \
-      *(vector) |= 0x1 << (31 - (pos));                                  \
-      (*(counter))++;                                                    \
-    }                                                                    \
+/* All bits of leaf vector set. */
+#define LEAF_ONES ((LeafVector) ~((LeafVector) 0))
+
+/* Get bit of given line from leaf vector (first line is the most significant bit). */
+#define LEAF_BIT(vector, pos) (((vector) >> (LEAF_SIZE - 1 - (pos))) & 0x1)
+
+/* Leaf vector with only bit of given line set. */
+#define LEAF_LINE(pos) ((LeafVector) 0x1 << (LEAF_SIZE - 1 - (pos)))
+
+/* Leaf vector with bits of all lines before given position set (pos <= LEAF_SIZE). */
+#define LEAF_PREFIX(pos) (((pos) == 0) ? (LeafVector) 0 : LEAF_ONES << (LEAF_SIZE - (pos)))
+
+/* Leaf vector with bits of given line and all lines after it set (pos < LEAF_SIZE). */
+#define LEAF_SUFFIX(pos) (LEAF_ONES >> (pos))
+
+/* Neighboring leaves are merged when they have at most this many lines together
+ * (merged leaf must not be split again by the next insertion). */
+#define LEAF_MERGE_SIZE (LEAF_SIZE - LEAF_SIZE / 4)
+
+/* Get P value of given line from the leaf. */
+#if defined(ENABLE_PACKED_FREQUENCY)
+  #define LEAF_NARROW_P_MAX UINT8_MAX
+  #define LEAF_GET_P(leaf, pos)                                             \
+    ((LEAF_PAYLOAD(leaf)->wideP_ != NULL) ? LEAF_PAYLOAD(leaf)->wideP_[pos] \
+                                          : (uint32_t) LEAF_PAYLOAD(leaf)->vectorP_[pos])
+#else
+  #define LEAF_GET_P(leaf, pos) (LEAF_PAYLOAD(leaf)->vectorP_[pos])
+#endif
+
+#if defined(INTEGER_CONTEXT_SHORTENING)
+/* Number of csl fields in one leaf vector and the highest csl they can hold. */
+#define LEAF_CSL_LANES (LEAF_SIZE / LEAF_CSL_BITS)
+#define LEAF_CSL_MAX ((1 << LEAF_CSL_BITS) - 1)
+
+/* Get csl of given line from the leaf (first line is in the lowest field of first vector). */
+#define LEAF_GET_CSL(leaf, pos)                                                                \
+  ((int32_t) ((LEAF_PAYLOAD(leaf)->context_[(pos) / LEAF_CSL_LANES] >>                         \
+               (((pos) % LEAF_CSL_LANES) * LEAF_CSL_BITS)) & LEAF_CSL_MAX))
+#endif
+
+#define INSERT_BIT(vector, counter, pos, value) { \
+    assert(pos < LEAF_SIZE);                      \
+    LeafVector mask = LEAF_PREFIX(pos);           \
+    LeafVector temp = 0;                          \
+                                                  \
+    temp |= (*vector) & mask;                     \
+    temp |= (((*vector) & ~(mask))) >> 1;         \
+    *(vector) = temp;                             \
+                                                  \
+    if (value) {                                  \
+      *(vector) |= LEAF_LINE(pos);                \
+      (*(counter))++;                             \
+    }                                             \
   }
 
-#define RANK(vector) __builtin_popcount((vector))
+#if defined(ENABLE_LEAF_64)
+  #define RANK(vector) __builtin_popcountll((vector))
+  #define LEAF_CLZ(vector) __builtin_clzll((vector))
+  #define LEAF_CTZ(vector) __builtin_ctzll((vector))
+#else
+  #define RANK(vector) __builtin_popcount((vector))
+  #define LEAF_CLZ(vector) __builtin_clz((vector))
+  #define LEAF_CTZ(vector) __builtin_ctz((vector))
+#endif
 
 #define NODE_OPERATION_2(r1, r2, op) { \
     r1->p_ op r2->p_;                  \
@@ -63,6 +115,10 @@
     r1->rW_[5] op GET_RVECTOR(r2, 5);  \
     r1->rW_[6] op GET_RVECTOR(r2, 6);  \
     r1->rW_[7] op GET_RVECTOR(r2, 7);  \
+    r1->f_[0] op r2->f_[0];            \
+    r1->f_[1] op r2->f_[1];            \
+    r1->f_[2] op r2->f_[2];            \
+    r1->f_[3] op r2->f_[3];            \
   }
 
 #define NODE_OPERATION_3(r1, r2, r3, op) {                  \
@@ -76,6 +132,10 @@
     r1->rW_[5] = GET_RVECTOR(r2, 5) op GET_RVECTOR(r3, 5);  \
     r1->rW_[6] = GET_RVECTOR(r2, 6) op GET_RVECTOR(r3, 6);  \
     r1->rW_[7] = GET_RVECTOR(r2, 7) op GET_RVECTOR(r3, 7);  \
+    r1->f_[0] = r2->f_[0] op r3->f_[0];                     \
+    r1->f_[1] = r2->f_[1] op r3->f_[1];                     \
+    r1->f_[2] = r2->f_[2] op r3->f_[2];                     \
+    r1->f_[3] = r2->f_[3] op r3->f_[3];                     \
   }
 
 typedef enum { VECTOR_L, VECTOR_W } Graph_vector;
@@ -104,6 +164,16 @@ typedef enum {
 typedef struct {
   MemPtr root_;
   MemObj mem_;
+  StackRef stack_; /* traversal stack of this graph */
+#if defined(ENABLE_LOOKUP_CACHE)
+  CacheRef cache_;
+#endif
+#if defined(RAS_CONTEXT_SHORTENING)
+  UWT_Struct uwt_; /* csl values of all lines */
+#endif
+#if defined(ENABLE_GRAPH_COMPACTION)
+  uint32_t inserts_; /* number of lines inserted since the last compaction */
+#endif
 } Graph_Struct;
 
 typedef struct {
@@ -117,8 +187,29 @@ typedef struct {
   uint32_t total_;
 } cfreq;
 
+/*
+ * Sequential iterator over Graph_Struct lines.
+ *
+ * Iterator keeps its own root to leaf path (graph stack is not used) so it
+ * is possible to call other graph queries between the steps. Graph must not
+ * be modified while the iterator is in use.
+ */
+typedef struct {
+  Graph_Struct* Graph_;
+  MemPtr path_[MAX_STACK_SIZE]; /* all internal nodes above current leaf */
+#if defined(ENABLE_BTREE_NODES)
+  uint32_t index_[MAX_STACK_SIZE]; /* index of child the path continues to */
+#endif
+  int32_t depth_;
+  MemPtr current_;
+  LeafRef leaf_;
+  uint32_t pos_; /* position within current leaf */
+  LinePos idx_;  /* position within whole graph */
+} Graph_Iterator;
+
 #define GraphRef Graph_Struct*
 #define GLineRef Graph_Line*
+#define GIterRef Graph_Iterator*
 
 /* Defines for structure vector selection */
 #define VECTOR_L 0
@@ -131,32 +222,131 @@ typedef struct {
 #define VECTOR_W6 7
 #define VECTOR_W7 8
 
+/*
+ * Number of lines in the masked W vector of given type in a (sub)tree.
+ *
+ * @param  p__  Number of lines in the (sub)tree.
+ * @param  r__  All eight rW_ counters of the (sub)tree.
+ * @param  type__  Masked vector type (VECTOR_W1 - VECTOR_W7).
+ */
+#define GRAPH_MASKED_P(p__, r__, type__)                \
+      (((type__) == VECTOR_W1) ? (p__) - (r__)[0]        \
+    : ((type__) == VECTOR_W2) ? (r__)[0]                 \
+    : ((type__) == VECTOR_W3) ? (p__) - (r__)[0] - (r__)[1] \
+    : ((type__) == VECTOR_W4) ? (r__)[1]                 \
+    : ((type__) == VECTOR_W5) ? (r__)[0] - (r__)[2]      \
+    : ((type__) == VECTOR_W6) ? (r__)[2] : (r__)[6])
+
+/* Number of set bits in the masked W vector of given type in a (sub)tree. */
+#define GRAPH_MASKED_ONES(r__, type__) ((r__)[(type__) - 1])
+
+#if defined(ENABLE_BTREE_NODES)
+
+/* Counters of all children of B+ tree node before the given one. */
+#define BTREE_PREFIX_P(node_ref__, idx__) \
+  ((idx__) ? (node_ref__)->pre_p_[(idx__) - 1] : 0)
+#define BTREE_PREFIX(node_ref__, idx__, counter__) \
+  ((idx__) ? (node_ref__)->prefix_[(idx__) - 1].counter__ : 0)
+
+/*
+ * Find child of B+ tree node containing given position.
+ *
+ * Position equal to the number of lines in the node belongs to the last child.
+ *
+ * @param  node_ref__  [In] Reference to the node.
+ * @param  pos__  [In/Out] Query position -> position within the child.
+ * @param  idx__  [Out] Index of the child.
+ */
+#define BTREE_CHILD_BY_POS(node_ref__, pos__, idx__) {                                     \
+    for (idx__ = 0; (uint32_t) idx__ + 1 < (node_ref__)->count_ &&                         \
+                    (node_ref__)->pre_p_[idx__] <= pos__; idx__++) {}                       \
+    pos__ -= BTREE_PREFIX_P(node_ref__, idx__);                                             \
+  }
+
+#endif  /* defined(ENABLE_BTREE_NODES) */
+
+#if defined(ENABLE_LOOKUP_CACHE)
+
 /*
  * Macro that contains whole tree search loop.
  *
+ * Search starts from the closest finger of the lookup cache.
+ *
  * @param  Graph__  [In] Reference to graph structure.
  * @param  pos__  [In/Out] Query position -> position within the leaf.
  * @param  current  [Out] MemPtr set to correct leaf.
  * @param  leaf_ref  [Out] Actual LeafRef set to correct leaf.
  * @param  with_stack  If stack should be used (filled) during the query
+ * @param  op  Operation the query is done for [enum: cache_operation].
  */
-#define GET_TARGET_LEAF(Graph__, pos__, current, leaf_ref, with_stack) { \
-  if (with_stack) STACK_CLEAN();                                         \
-  uint32_t Xtemp;                                                        \
+#define GET_TARGET_LEAF(Graph__, pos__, current, leaf_ref, with_stack, op) {               \
+  finger_search(Graph__->cache_, Graph__->stack_, Graph__->mem_, Graph__->root_, &(pos__), \
+                &(current), with_stack, op);                                               \
+  leaf_ref = MEMORY_GET_LEAF(Graph__->mem_, current);                                      \
+}
+
+#elif defined(ENABLE_BTREE_NODES)
+
+/*
+ * Macro that contains whole tree search loop.
+ *
+ * @param  Graph__  [In] Reference to graph structure.
+ * @param  pos__  [In/Out] Query position -> position within the leaf.
+ * @param  current  [Out] MemPtr set to correct leaf.
+ * @param  leaf_ref  [Out] Actual LeafRef set to correct leaf.
+ * @param  with_stack  If stack should be used (filled) during the query
+ * @param  op  Operation the query is done for [enum: cache_operation].
+ */
+#define GET_TARGET_LEAF(Graph__, pos__, current, leaf_ref, with_stack, op) { \
+  if (with_stack) STACK_CLEAN(Graph__->stack_);                          \
+  uint32_t Xidx;                                                         \
   current = Graph__->root_;                                              \
-  uint32_t backup = pos__;                                               \
-  if (with_stack || !lookup_cache(&pos__, &leaf_ref)) {                  \
+  {                                                                      \
     NodeRef Xnode_ref = MEMORY_GET_ANY(Graph__->mem_, current);          \
     assert(pos__ < Xnode_ref->p_);                                       \
                                                                          \
     /* traverse the tree and enter correct leaf */                       \
     while (!IS_LEAF(current)) {                                          \
-      if (with_stack) STACK_PUSH(current);                               \
+      Xnode_ref = MEMORY_GET_NODE(Graph__->mem_, current);               \
+      BTREE_CHILD_BY_POS(Xnode_ref, pos__, Xidx);                        \
+      if (with_stack) {                                                  \
+        STACK_PUSH(Graph__->stack_, current);                            \
+        STACK_SET_INDEX(Graph__->stack_, Xidx);                          \
+      }                                                                  \
+      current = Xnode_ref->children_[Xidx];                              \
+    }                                                                    \
+    leaf_ref = MEMORY_GET_LEAF(Graph__->mem_, current);                  \
+  }                                                                      \
+}
+
+#else
+
+/*
+ * Macro that contains whole tree search loop.
+ *
+ * @param  Graph__  [In] Reference to graph structure.
+ * @param  pos__  [In/Out] Query position -> position within the leaf.
+ * @param  current  [Out] MemPtr set to correct leaf.
+ * @param  leaf_ref  [Out] Actual LeafRef set to correct leaf.
+ * @param  with_stack  If stack should be used (filled) during the query
+ * @param  op  Operation the query is done for [enum: cache_operation].
+ */
+#define GET_TARGET_LEAF(Graph__, pos__, current, leaf_ref, with_stack, op) { \
+  if (with_stack) STACK_CLEAN(Graph__->stack_);                          \
+  LinePos Xtemp;                                                         \
+  current = Graph__->root_;                                              \
+  {                                                                      \
+    NodeRef Xnode_ref = MEMORY_GET_ANY(Graph__->mem_, current);          \
+    assert(pos__ < Xnode_ref->p_);                                       \
+                                                                         \
+    /* traverse the tree and enter correct leaf */                       \
+    while (!IS_LEAF(current)) {                                          \
+      if (with_stack) STACK_PUSH(Graph__->stack_, current);              \
       Xnode_ref = MEMORY_GET_NODE(Graph__->mem_, current);               \
                                                                          \
       /* get p_ counter of left child and act accordingly */             \
       Xtemp = MEMORY_GET_ANY(Graph__->mem_, Xnode_ref->left_)->p_;       \
-      if ((uint32_t)Xtemp > pos__) {                                     \
+      if (Xtemp > pos__) {                                               \
         current = Xnode_ref->left_;                                      \
       } else {                                                           \
         pos__ -= Xtemp;                                                  \
@@ -164,10 +354,11 @@ typedef struct {
       }                                                                  \
     }                                                                    \
     leaf_ref = MEMORY_GET_LEAF(Graph__->mem_, current);                  \
-    add_to_cache(backup, pos__, leaf_ref);                               \
   }                                                                      \
 }
 
+#endif  /* defined(ENABLE_LOOKUP_CACHE) */
+
 #define WITH_STACK true
 #define WITHOUT_STACK false
 
@@ -175,8 +366,9 @@ typedef struct {
  * Initialize Graph_Struct object given as argument.
  *
  * @param  Graph__  Reference to Graph_Struct object.
+ * @param  lines__  Expected number of lines (or 0 if unknown).
  */
-void Graph_Init(GraphRef Graph__);
+void Graph_Init(GraphRef Graph__, LinePos lines__);
 
 /*
  * Free all memory associated with MS object.
@@ -185,6 +377,34 @@ void Graph_Init(GraphRef Graph__);
  */
 void Graph_Free(GraphRef Graph__);
 
+/*
+ * Initialize Graph_Struct object and fill it with given lines.
+ *
+ * Lines are packed into full leaves and perfectly balanced tree is built
+ * above them in a single linear pass. This is much faster than inserting
+ * lines one by one and it is intended for loading of existing models.
+ *
+ * @param  Graph__  Reference to Graph_Struct object.
+ * @param  lines__  Array of lines (in order).
+ * @param  csl__  Common suffix lengths of lines (or NULL for all zeros).
+ * @param  size__  Number of lines.
+ */
+void Graph_Build(GraphRef Graph__, const Graph_Line* lines__, const int32_t* csl__, LinePos size__);
+
+/*
+ * Move the whole tree into new memory in depth first order.
+ *
+ * Nodes and leaves are otherwise stored in the order of their allocation and
+ * after many random inserts each root to leaf path is scattered over the whole
+ * memory. After the compaction each path goes through mostly neighboring
+ * nodes and leaves are stored in the order of lines. Old memory is freed.
+ *
+ * All MemPtr references into the graph (including iterators) are invalidated.
+ *
+ * @param  Graph__  Reference to Graph_Struct object.
+ */
+void Graph_Compact(GraphRef Graph__);
+
 /*
  * Insert whole one line into the given Graph_Struct object.
  *
@@ -192,7 +412,18 @@ void Graph_Free(GraphRef Graph__);
  * @param  pos__  Index of newly inserted line.
  * @param  line__  Reference to Graph_Line object.
  */
-void GLine_Insert(GraphRef Graph__, uint32_t pos__, GLineRef line__);
+void GLine_Insert(GraphRef Graph__, LinePos pos__, GLineRef line__);
+
+/*
+ * Delete one line from the given Graph_Struct object.
+ *
+ * Leaves which get too small are merged with their neighbors and the tree
+ * is rebalanced. Released nodes and leaves are reused by later insertions.
+ *
+ * @param  Graph__  Reference to Graph_Struct object.
+ * @param  pos__  Index of deleted line.
+ */
+void GLine_Delete(GraphRef Graph__, LinePos pos__);
 
 /*
  * Fill Graph_Line struct with given information.
@@ -223,14 +454,14 @@ void GLine_Explode(GLineRef line__, Graph_value* L__, Graph_value* W__, uint32_t
  * @param  pos__  Index of requested line.
  * @param  line__  [Out] Reference to Graph_Line object.
  */
-void GLine_Get(GraphRef Graph__, uint32_t pos__, GLineRef line__);
+void GLine_Get(GraphRef Graph__, LinePos pos__, GLineRef line__);
 
 /*
  * Get number of elements saved in the Graph_Struct.
  *
  * @param  Graph__  Reference to Graph_Struct object.
  */
-int32_t Graph_Size(GraphRef Graph__);
+LineIdx Graph_Size(GraphRef Graph__);
 
 /*
  * Print whole graph structure.
@@ -239,6 +470,58 @@ int32_t Graph_Size(GraphRef Graph__);
  */
 void Graph_Print(GraphRef Graph__);
 
+/*
+ * Initialize iterator on the given position.
+ *
+ * @param  iter__  [Out] Reference to Graph_Iterator object.
+ * @param  Graph__  Reference to Graph_Struct object.
+ * @param  pos__  Starting position.
+ */
+void Graph_Iterator_Init(GIterRef iter__, GraphRef Graph__, LinePos pos__);
+
+/*
+ * Move iterator to the next line.
+ *
+ * Iterator climbs only as high as needed to get into the next leaf and
+ * therefore this costs amortized O(1).
+ *
+ * @param  iter__  Reference to Graph_Iterator object.
+ *
+ * @return  False if iterator is already on the last line (it is not moved).
+ */
+bool Graph_Iterator_Next(GIterRef iter__);
+
+/*
+ * Move iterator to the previous line.
+ *
+ * @param  iter__  Reference to Graph_Iterator object.
+ *
+ * @return  False if iterator is already on the first line (it is not moved).
+ */
+bool Graph_Iterator_Prev(GIterRef iter__);
+
+/*
+ * Get line iterator is pointing to.
+ *
+ * @param  iter__  Reference to Graph_Iterator object.
+ * @param  line__  [Out] Reference to Graph_Line object.
+ */
+void Graph_Iterator_Get(GIterRef iter__, GLineRef line__);
+
+#if defined(INTEGER_CONTEXT_SHORTENING) || defined(RAS_CONTEXT_SHORTENING)
+
+/*
+ * Get common suffix length of line iterator is pointing to.
+ *
+ * @param  iter__  Reference to Graph_Iterator object.
+ */
+int32_t Graph_Iterator_Get_csl(GIterRef iter__);
+
+#endif
+
+/* Get position of line iterator is pointing to. */
+#define Graph_Iterator_Position(iter__) ((iter__)->idx_)
+
 /*
  * Rank Graph_struct.
  *
@@ -257,7 +540,7 @@ void Graph_Print(GraphRef Graph__);
       : (graph_Lrank_(*Graph__, pos__))           \
     : Graph_Rank_W(Graph__, pos__, val__))
 
-int32_t graph_Lrank_(Graph_Struct Graph__, uint32_t pos__);
+LineIdx graph_Lrank_(Graph_Struct Graph__, LinePos pos__);
 
 /*
  * Rank L vector of given Graph_struct.
@@ -269,7 +552,7 @@ int32_t graph_Lrank_(Graph_Struct Graph__, uint32_t pos__);
  * @param  pos__  Query position.
  * @param  val__  Query value [enum: Graph_value].
  */
-int32_t Graph_Rank_L(GraphRef Graph__, uint32_t pos__, Graph_value val__);
+LineIdx Graph_Rank_L(GraphRef Graph__, LinePos pos__, Graph_value val__);
 
 /*
  * Rank W vector of given Graph_struct.
@@ -280,7 +563,20 @@ int32_t Graph_Rank_L(GraphRef Graph__, uint32_t pos__, Graph_value val__);
  * @param  pos__  Query position.
  * @param  val__  Query value [enum: Graph_value].
  */
-int32_t Graph_Rank_W(GraphRef Graph__, uint32_t pos__, Graph_value val__);
+LineIdx Graph_Rank_W(GraphRef Graph__, LinePos pos__, Graph_value val__);
+
+/*
+ * Rank W vector of given Graph_struct for all W values at once.
+ *
+ * All ranks are computed in a single tree traversal, which is much cheaper
+ * than calling Graph_Rank_W for each value separately.
+ *
+ * @param  Graph__  Reference to Graph_Struct object.
+ * @param  pos__  Query position.
+ * @param  ranks__  [Out] Ranks of W values VALUE_A to VALUE_Tx (indexed by
+ *   Graph_value).
+ */
+void Graph_Rank_W_all(GraphRef Graph__, LinePos pos__, LinePos ranks__[VALUE_$]);
 
 /*
  * Select Graph_struct.
@@ -300,7 +596,7 @@ int32_t Graph_Rank_W(GraphRef Graph__, uint32_t pos__, Graph_value val__);
       : (graph_Lselect_(*Graph__, pos__, false))    \
     : Graph_Select_W(Graph__, pos__, val__))
 
-int32_t graph_Lselect_(Graph_Struct Graph__, uint32_t num__, bool zero__);
+LineIdx graph_Lselect_(Graph_Struct Graph__, LinePos num__, bool zero__);
 
 /*
  * Select L vector of given Graph_struct.
@@ -312,7 +608,7 @@ int32_t graph_Lselect_(Graph_Struct Graph__, uint32_t num__, bool zero__);
  * @param  pos__  Query position.
  * @param  val__  Query value [enum: Graph_value].
  */
-int32_t Graph_Select_L(GraphRef Graph__, uint32_t pos__, Graph_value val__);
+LineIdx Graph_Select_L(GraphRef Graph__, LinePos pos__, Graph_value val__);
 
 /*
  * Select W vector of given Graph_struct.
@@ -323,7 +619,45 @@ int32_t Graph_Select_L(GraphRef Graph__, uint32_t pos__, Graph_value val__);
  * @param  pos__  Query position.
  * @param  val__  Query value [enum: Graph_value].
  */
-int32_t Graph_Select_W(GraphRef Graph__, uint32_t pos__, Graph_value val__);
+LineIdx Graph_Select_W(GraphRef Graph__, LinePos pos__, Graph_value val__);
+
+/*
+ * Get W value of given line together with ranks of all W values.
+ *
+ * This is done in a single tree traversal and it is used by Graph_Forward.
+ *
+ * @param  Graph__  Graph_Struct object.
+ * @param  pos__  Query position.
+ * @param  ranks__  [Out] Ranks of all W values (indexed by Graph_value) up to
+ *   and including given line.
+ *
+ * @return  W value of given line.
+ */
+Graph_value graph_rank_W_access_(Graph_Struct Graph__, LinePos pos__, LinePos ranks__[VALUE_$ + 1]);
+
+/*
+ * Select num__-th set bit in L vector which is on the given position or after it.
+ *
+ * Result is the same as select of (rank(pos__) + num__) but it is computed by
+ * going up from the leaf with given position rather than with two traversals.
+ *
+ * @param  Graph__  Graph_Struct object.
+ * @param  pos__  Starting position.
+ * @param  num__  Select query number.
+ */
+LineIdx graph_Lselect_from_(Graph_Struct Graph__, LinePos pos__, LinePos num__);
+
+/*
+ * Find num__-th set bit in one leaf vector.
+ *
+ * Uses PDEP and TZCNT instructions when BMI2 is available.
+ *
+ * @param  vector__  Leaf vector.
+ * @param  num__  Select query number (must be between 1 and number of set bits).
+ *
+ * @return  Line (position within the leaf) of that bit.
+ */
+uint32_t graph_leaf_select_(LeafVector vector__, uint32_t num__);
 
 /*
  * Update value in W vector of Graph_struct.
@@ -332,7 +666,7 @@ int32_t Graph_Select_W(GraphRef Graph__, uint32_t pos__, Graph_value val__);
  * @param  pos__  Update position.
  * @param  val__  New symbol [enum: Graph_value].
  */
-void Graph_Change_symbol(GraphRef Graph__, uint32_t pos__, Graph_value val__);
+void Graph_Change_symbol(GraphRef Graph__, LinePos pos__, Graph_value val__);
 
 /*
  * Increase frequency in P vector of Graph_struct.
@@ -341,7 +675,7 @@ void Graph_Change_symbol(GraphRef Graph__, uint32_t pos__, Graph_value val__);
  * @param  pos__  Update position.
  * @param  amount__  Frequency increase size.
  */
-void Graph_Increase_frequency(GraphRef Graph__, uint32_t pos__, uint32_t amount__);
+void Graph_Increase_frequency(GraphRef Graph__, LinePos pos__, uint32_t amount__);
 
 /*
  * Get symbol frequencies from node pointed to by given index.
@@ -350,7 +684,21 @@ void Graph_Increase_frequency(GraphRef Graph__, uint32_t pos__, uint32_t amount_
  * @param  pos__  Edge index (line) in deBruijn graph.
  * @param  freq__  [Out] Frequency count structure.
  */
-void Graph_Get_symbol_frequency(GraphRef Graph__, uint32_t pos__, cfreq* freq__);
+void Graph_Get_symbol_frequency(GraphRef Graph__, LinePos pos__, cfreq* freq__);
+
+/*
+ * Get symbol frequencies summed over all lines in given range.
+ *
+ * Sums are taken from per node frequency counters and thus the whole query
+ * costs two tree traversals regardless of the range size. Escape symbol
+ * frequency is not filled in.
+ *
+ * @param  Graph__  Reference to Graph_Struct object.
+ * @param  lo__  Lower bound of given range.
+ * @param  up__  Upper bound of given range (inclusive).
+ * @param  freq__  [Out] Frequency count structure.
+ */
+void Graph_Get_symbol_frequency_range(GraphRef Graph__, LinePos lo__, LinePos up__, cfreq* freq__);
 
 /*
  * Get position of given edge symbol in given node.
@@ -361,7 +709,22 @@ void Graph_Get_symbol_frequency(GraphRef Graph__, uint32_t pos__, cfreq* freq__)
  *
  * @return  Index of edge in given node.
  */
-int32_t Graph_Find_Edge(GraphRef Graph__, uint32_t pos__, Graph_value val__);
+LineIdx Graph_Find_Edge(GraphRef Graph__, LinePos pos__, Graph_value val__);
+
+/*
+ * Follow edge given by its index to the next node.
+ *
+ * Fused version of deBruijn Forward operation. W value and its rank are
+ * obtained in one traversal and L rank and select in another one.
+ *
+ * @param  Graph__  Reference to Graph_Struct object.
+ * @param  pos__  Edge index (line) in deBruijn graph.
+ * @param  F__  Base positions of all symbols.
+ *
+ * @return  Index of last edge of the node pointed to by given edge or -1 if
+ * there is no such node.
+ */
+LineIdx Graph_Forward(GraphRef Graph__, LinePos pos__, const LineIdx F__[SYMBOL_COUNT]);
 
 #if defined(INTEGER_CONTEXT_SHORTENING) || defined(RAS_CONTEXT_SHORTENING)
 
@@ -372,7 +735,7 @@ int32_t Graph_Find_Edge(GraphRef Graph__, uint32_t pos__, Graph_value val__);
  * @param  pos__  Edge index (line) in deBruijn graph.
  * @param  csl__  Size of the csl (integer to save).
  */
-void Graph_Set_csl(GraphRef Graph__, uint32_t pos__, int32_t csl__);
+void Graph_Set_csl(GraphRef Graph__, LinePos pos__, int32_t csl__);
 
 /*
  * Get common suffix length with the upper neighbour.
@@ -382,8 +745,37 @@ void Graph_Set_csl(GraphRef Graph__, uint32_t pos__, int32_t csl__);
  *
  * @return  Common suffix length.
  */
-int32_t Graph_Get_csl(GraphRef Graph__, uint32_t pos__);
+int32_t Graph_Get_csl(GraphRef Graph__, LinePos pos__);
 
 #endif  /* defined(INTEGER_CONTEXT_SHORTENING) || defined(RAS_CONTEXT_SHORTENING) */
 
+#if defined(INTEGER_CONTEXT_SHORTENING)
+
+/*
+ * Find nearest line on given position or above it with csl lower than given.
+ *
+ * Internal nodes keep minimal csl of their subtrees and therefore this needs
+ * only a single pass up and down the tree.
+ *
+ * @param  Graph__  Reference to Graph_Struct object.
+ * @param  pos__  Starting edge index (line) in deBruijn graph.
+ * @param  csl__  Common suffix length limit.
+ *
+ * @return  Index of found line or -1 if there is no such line.
+ */
+LineIdx Graph_Find_csl_lower(GraphRef Graph__, LinePos pos__, int32_t csl__);
+
+/*
+ * Find nearest line on given position or bellow it with csl lower than given.
+ *
+ * @param  Graph__  Reference to Graph_Struct object.
+ * @param  pos__  Starting edge index (line) in deBruijn graph.
+ * @param  csl__  Common suffix length limit.
+ *
+ * @return  Index of found line or size of the structure if there is no such line.
+ */
+LineIdx Graph_Find_csl_upper(GraphRef Graph__, LinePos pos__, int32_t csl__);
+
+#endif  /* INTEGER_CONTEXT_SHORTENING */
+
 #endif
@@ -8,6 +8,7 @@ static void RunAllTests(void) {
 
   RUN_TEST_GROUP(Compressor_deBruijn);
   RUN_TEST_GROUP(Compressor_main);
+  RUN_TEST_GROUP(Compressor_container);
 }
 
 int main(int argc, const char* argv[]) {
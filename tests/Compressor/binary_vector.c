@@ -21,7 +21,7 @@ Graph_Struct Graph;
 Graph_Line line;
 
 TEST_SETUP(Compressor_binary_vector) {
-  Graph_Init(&Graph);
+  Graph_Init(&Graph, 0);
   sequence = bit_sequence_generate_random(TEST_SEQENCE_LEN);
 }
 
@@ -161,12 +161,18 @@ void test_node_split_(MemPtr ptr__) {
 
   if (IS_LEAF(ptr__)) {
     leaf = MEMORY_GET_LEAF(Graph.mem_, ptr__);
-    TEST_ASSERT_TRUE((leaf->vectorL_ >> (32 - leaf->p_) & 0x1))
+    TEST_ASSERT_TRUE(LEAF_BIT(leaf->vectorL_, leaf->p_ - 1))
 
   } else {
     node = MEMORY_GET_NODE(Graph.mem_, ptr__);
+#if defined(ENABLE_BTREE_NODES)
+    uint32_t i;
+    for (i = 0; i < node->count_; i++)
+      test_node_split_(node->children_[i]);
+#else
     test_node_split_(node->left_);
     test_node_split_(node->right_);
+#endif
   }
 }
 
@@ -195,6 +201,61 @@ TEST(Compressor_binary_vector, clever_node_split) {
   test_node_split_(Graph.root_);
 }
 
+TEST(Compressor_binary_vector, leaf_select) {
+  int32_t i, j;
+  uint32_t num, pos;
+  LeafVector vector;
+
+  for (i = 0; i < TEST_SEQENCE_LEN; i++) {
+    vector = 0;
+    for (j = 0; j < LEAF_SIZE; j++)
+      vector |= (rand() % 3) ? 0 : LEAF_LINE(j);
+
+    /* compare with bit by bit search */
+    num = 0;
+    for (pos = 0; pos < LEAF_SIZE; pos++) {
+      if (LEAF_BIT(vector, pos)) {
+        num++;
+        TEST_ASSERT_EQUAL_UINT32(pos, graph_leaf_select_(vector, num));
+      }
+    }
+  }
+}
+
+TEST(Compressor_binary_vector, deletion) {
+  int8_t bit;
+  int32_t i, pos, size;
+  uint8_t extra[2 * TEST_SEQENCE_LEN];
+
+  for (i = 0; i < TEST_SEQENCE_LEN; i++) {
+    bit = (sequence[i / BitSeqSize] >> ((BitSeqSize - 1) - (i % BitSeqSize))) & 0x1;
+
+    GLine_Fill(&line, bit, VAR_IGNORE, VAR_IGNORE);
+    GLine_Insert(&Graph, i, &line);
+    extra[i] = false;
+  }
+
+  /* insert extra lines on random positions and delete them in random order */
+  for (size = TEST_SEQENCE_LEN; size < 2 * TEST_SEQENCE_LEN; size++) {
+    pos = rand() % (size + 1);
+    memmove(&(extra[pos + 1]), &(extra[pos]), size - pos);
+    extra[pos] = true;
+
+    GLine_Fill(&line, rand() % 2, VAR_IGNORE, VAR_IGNORE);
+    GLine_Insert(&Graph, pos, &line);
+  }
+
+  for (; size > TEST_SEQENCE_LEN; size--) {
+    do {
+      pos = rand() % size;
+    } while (!extra[pos]);
+    memmove(&(extra[pos]), &(extra[pos + 1]), size - pos - 1);
+
+    GLine_Delete(&Graph, pos);
+  }
+  _test_binary_vector(&Graph, sequence);
+}
+
 TEST_GROUP_RUNNER(Compressor_binary_vector) {
   RUN_TEST_CASE(Compressor_binary_vector, front_insertion);
   RUN_TEST_CASE(Compressor_binary_vector, rear_insertion);
@@ -202,4 +263,6 @@ TEST_GROUP_RUNNER(Compressor_binary_vector) {
   RUN_TEST_CASE(Compressor_binary_vector, rear_front_insertion);
   RUN_TEST_CASE(Compressor_binary_vector, mixed_insertion);
   RUN_TEST_CASE(Compressor_binary_vector, clever_node_split);
+  RUN_TEST_CASE(Compressor_binary_vector, leaf_select);
+  RUN_TEST_CASE(Compressor_binary_vector, deletion);
 }
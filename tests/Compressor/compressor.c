@@ -1,7 +1,14 @@
+/* named pipes and fork are not part of C99 */
+#define _DEFAULT_SOURCE
+
 #include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 #include <time.h>
+#include <unistd.h>
 
 #include "compressor.h"
+#include "container.h"
 #include "unity_fixture.h"
 
 TEST_GROUP(Compressor_main);
@@ -9,6 +16,11 @@ TEST_GROUP(Compressor_main);
 #define COMPRESSOR_LABEL_TEST_SIZE 1000
 #define COMPRESSOR_RANDOM_TEST_MAX_SEQ_SIZE 300
 #define COMPRESSOR_RANDOM_TEST_POOL_SIZE 300
+#define COMPRESSOR_BUDGET_TEST_SIZE 20000
+#define COMPRESSOR_BUDGET_TEST_LIMIT (2 * 1024)
+#define COMPRESSOR_INTERLEAVED_TEST_SIZE 5000
+#define COMPRESSOR_PIPE_TEST_SIZE 5000
+#define COMPRESSOR_PIPE_TEST_FILE "tmp/pipe_test.fifo"
 
 #define _(symb__) GET_VALUE_FROM_SYMBOL(symb__)
 
@@ -22,8 +34,8 @@ void start_compressor(const char* filename__) {
     fprintf(stderr, "Can't open file %s!\n", filename__);
     exit(1);
   }
-  Process_Init(&C);
-  Compression_Start(ofp);
+  Process_Init(&C, 0);
+  Compression_Start(&C, ofp);
 }
 void start_decompressor(const char* filename__) {
   ifp = fopen(filename__, "rb");
@@ -31,18 +43,18 @@ void start_decompressor(const char* filename__) {
     fprintf(stderr, "Can't open file %s!\n", filename__);
     exit(1);
   }
-  Process_Init(&C);
-  Decompression_Start(ifp);
+  Process_Init(&C, 0);
+  Decompression_Start(&C, ifp);
 }
 
 void end_compressor() {
   Process_Free(&C);
-  Compression_Finalize();
+  Compression_Finalize(&C);
   fclose(ofp);
 }
 void end_decompressor() {
   Process_Free(&C);
-  Decompression_Finalize();
+  Decompression_Finalize(&C);
   fclose(ifp);
 }
 
@@ -162,8 +174,143 @@ TEST(Compressor_main, RandomTest) {
   }
 }
 
+#if !defined(SIMPLE_MEMORY)
+TEST(Compressor_main, BudgetTest) {
+  int32_t i;
+  uint32_t restarts;
+  Graph_value val;
+  char* dna;
+
+  srand(time(NULL));
+  dna = generate_dna_string(COMPRESSOR_BUDGET_TEST_SIZE);
+
+  start_compressor("tmp/budget_test.bin");
+  Process_Set_budget(&C, COMPRESSOR_BUDGET_TEST_LIMIT);
+  for (i = 0; i < COMPRESSOR_BUDGET_TEST_SIZE; i++)
+    Compressor_Compress_symbol(&C, dna[i]);
+  restarts = C.restarts_;
+  TEST_ASSERT_TRUE(restarts > 0);
+  end_compressor();
+
+  /* decompressor must restart at the same places */
+  start_decompressor("tmp/budget_test.bin");
+  Process_Set_budget(&C, COMPRESSOR_BUDGET_TEST_LIMIT);
+  for (i = 0; i < COMPRESSOR_BUDGET_TEST_SIZE; i++) {
+    Decompressor_Decompress_symbol(&C, &val);
+    TEST_ASSERT_EQUAL_INT32(dna[i], val);
+  }
+  TEST_ASSERT_EQUAL_UINT32(restarts, C.restarts_);
+  end_decompressor();
+
+  free(dna);
+}
+#endif
+
+TEST(Compressor_main, InterleavedTest) {
+  int32_t i, j;
+  compressor Cs[2];
+  FILE* fps[2];
+  Graph_value val;
+  char* dna[2];
+  const char* filenames[2] = {"tmp/interleaved_test_0.bin", "tmp/interleaved_test_1.bin"};
+
+  srand(time(NULL));
+
+  /* two independent compressors must not share any state */
+  for (j = 0; j < 2; j++) {
+    dna[j] = generate_dna_string(COMPRESSOR_INTERLEAVED_TEST_SIZE);
+    fps[j] = fopen(filenames[j], "wb");
+    TEST_ASSERT_TRUE(fps[j] != NULL);
+    Process_Init(&(Cs[j]), 0);
+    Compression_Start(&(Cs[j]), fps[j]);
+  }
+  for (i = 0; i < COMPRESSOR_INTERLEAVED_TEST_SIZE; i++) {
+    for (j = 0; j < 2; j++)
+      Compressor_Compress_symbol(&(Cs[j]), dna[j][i]);
+  }
+  for (j = 0; j < 2; j++) {
+    Compression_Finalize(&(Cs[j]));
+    Process_Free(&(Cs[j]));
+    fclose(fps[j]);
+  }
+
+  for (j = 0; j < 2; j++) {
+    fps[j] = fopen(filenames[j], "rb");
+    TEST_ASSERT_TRUE(fps[j] != NULL);
+    Process_Init(&(Cs[j]), 0);
+    Decompression_Start(&(Cs[j]), fps[j]);
+  }
+  for (i = 0; i < COMPRESSOR_INTERLEAVED_TEST_SIZE; i++) {
+    for (j = 0; j < 2; j++) {
+      Decompressor_Decompress_symbol(&(Cs[j]), &val);
+      TEST_ASSERT_EQUAL_INT32(dna[j][i], val);
+    }
+  }
+  for (j = 0; j < 2; j++) {
+    Decompression_Finalize(&(Cs[j]));
+    Process_Free(&(Cs[j]));
+    fclose(fps[j]);
+    free(dna[j]);
+  }
+}
+
+TEST(Compressor_main, PipeTest) {
+  int32_t i, status, ret;
+  Graph_value val;
+  char* dna;
+  pid_t pid, done;
+  bool seekable;
+
+  srand(time(NULL));
+  dna = generate_dna_string(COMPRESSOR_PIPE_TEST_SIZE);
+
+  unlink(COMPRESSOR_PIPE_TEST_FILE);
+  ret = mkfifo(COMPRESSOR_PIPE_TEST_FILE, 0600);
+  TEST_ASSERT_EQUAL_INT32(0, ret);
+
+  /* named output which is a pipe is written without seeking by another process */
+  pid = fork();
+  TEST_ASSERT_TRUE(pid >= 0);
+  if (pid == 0) {
+    start_compressor(COMPRESSOR_PIPE_TEST_FILE);
+    seekable = Container_Seekable(ofp);
+    for (i = 0; i < COMPRESSOR_PIPE_TEST_SIZE; i++)
+      Compressor_Compress_symbol(&C, dna[i]);
+    end_compressor();
+    _exit(seekable ? EXIT_FAILURE : EXIT_SUCCESS);
+  }
+
+  start_decompressor(COMPRESSOR_PIPE_TEST_FILE);
+  seekable = Container_Seekable(ifp);
+  TEST_ASSERT_FALSE(seekable);
+  for (i = 0; i < COMPRESSOR_PIPE_TEST_SIZE; i++) {
+    Decompressor_Decompress_symbol(&C, &val);
+    TEST_ASSERT_EQUAL_INT32(dna[i], val);
+  }
+  end_decompressor();
+
+  done = waitpid(pid, &status, 0);
+  TEST_ASSERT_EQUAL_INT32(pid, done);
+  TEST_ASSERT_TRUE(WIFEXITED(status));
+  TEST_ASSERT_EQUAL_INT32(EXIT_SUCCESS, WEXITSTATUS(status));
+
+  /* regular files can be seeked */
+  start_compressor("tmp/pipe_test.bin");
+  seekable = Container_Seekable(ofp);
+  TEST_ASSERT_TRUE(seekable);
+  end_compressor();
+
+  unlink(COMPRESSOR_PIPE_TEST_FILE);
+  free(dna);
+}
+
 TEST_GROUP_RUNNER(Compressor_main) {
   RUN_TEST_CASE(Compressor_main, LabelTest);
   RUN_TEST_CASE(Compressor_main, StaticTest);
   RUN_TEST_CASE(Compressor_main, RandomTest);
+  RUN_TEST_CASE(Compressor_main, InterleavedTest);
+  RUN_TEST_CASE(Compressor_main, PipeTest);
+#if !defined(SIMPLE_MEMORY)
+  RUN_TEST_CASE(Compressor_main, BudgetTest);
+#endif
 }
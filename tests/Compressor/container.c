@@ -0,0 +1,132 @@
+#include "container.h"
+#include "unity_fixture.h"
+
+TEST_GROUP(Compressor_container);
+
+#define CONTAINER_TEST_FILE "tmp/container_test.bin"
+#define CONTAINER_TEST_BLOCKS 10
+
+FILE* fp;
+
+TEST_SETUP(Compressor_container) {
+  fp = fopen(CONTAINER_TEST_FILE, "w+b");
+  TEST_ASSERT_TRUE(fp != NULL);
+}
+
+TEST_TEAR_DOWN(Compressor_container) {
+  fclose(fp);
+}
+
+TEST(Compressor_container, header) {
+  container_header header, read;
+  container_status status;
+
+  Container_Header_Init(&header, CONTAINER_FLAG_BLOCK_TABLE, 1234);
+  Container_Header_Write(&header, fp);
+  TEST_ASSERT_EQUAL_INT32(CONTAINER_HEADER_SIZE, ftell(fp));
+
+  rewind(fp);
+  status = Container_Header_Read(&read, fp);
+  TEST_ASSERT_EQUAL_INT32(CONTAINER_OK, status);
+  TEST_ASSERT_EQUAL_UINT8(CONTAINER_VERSION, read.version_);
+  TEST_ASSERT_EQUAL_UINT8(CONTAINER_FLAG_BLOCK_TABLE, read.flags_);
+  TEST_ASSERT_EQUAL_UINT8(CONTEXT_LENGTH, read.context_length_);
+  TEST_ASSERT_EQUAL_UINT32(1234, read.budget_);
+}
+
+TEST(Compressor_container, header_mismatch) {
+  container_header header, read;
+  container_status status;
+
+  /* not a compressed file at all */
+  fwrite("ACGTACGTACGTACGT", sizeof(char), CONTAINER_HEADER_SIZE, fp);
+  rewind(fp);
+  status = Container_Header_Read(&read, fp);
+  TEST_ASSERT_EQUAL_INT32(CONTAINER_BAD_MAGIC, status);
+
+  /* compressed with different context length */
+  rewind(fp);
+  Container_Header_Init(&header, CONTAINER_FLAG_BLOCK_TABLE, 0);
+  header.context_length_++;
+  Container_Header_Write(&header, fp);
+  rewind(fp);
+  status = Container_Header_Read(&read, fp);
+  TEST_ASSERT_EQUAL_INT32(CONTAINER_BAD_MODEL, status);
+
+  /* newer version of the format */
+  rewind(fp);
+  Container_Header_Init(&header, CONTAINER_FLAG_BLOCK_TABLE, 0);
+  header.version_++;
+  Container_Header_Write(&header, fp);
+  rewind(fp);
+  status = Container_Header_Read(&read, fp);
+  TEST_ASSERT_EQUAL_INT32(CONTAINER_BAD_VERSION, status);
+
+  /* truncated file */
+  fclose(fp);
+  fp = fopen(CONTAINER_TEST_FILE, "w+b");
+  fwrite(CONTAINER_MAGIC, sizeof(char), 4, fp);
+  rewind(fp);
+  status = Container_Header_Read(&read, fp);
+  TEST_ASSERT_EQUAL_INT32(CONTAINER_READ_ERROR, status);
+}
+
+TEST(Compressor_container, block_table) {
+  uint32_t i, count;
+  block_entry table[CONTAINER_TEST_BLOCKS];
+  block_entry* read;
+
+  for (i = 0; i < CONTAINER_TEST_BLOCKS; i++) {
+    table[i].size_ = ((uint64_t) i << 40) + rand();
+    table[i].symbols_ = ((uint64_t) i << 33) + rand();
+  }
+
+  /* table is read from the end of the file */
+  fwrite("data", sizeof(char), 4, fp);
+  Container_Table_Write(table, CONTAINER_TEST_BLOCKS, fp);
+
+  read = Container_Table_Read(&count, fp);
+  TEST_ASSERT_EQUAL_UINT32(CONTAINER_TEST_BLOCKS, count);
+  for (i = 0; i < CONTAINER_TEST_BLOCKS; i++) {
+    TEST_ASSERT_TRUE(table[i].size_ == read[i].size_);
+    TEST_ASSERT_TRUE(table[i].symbols_ == read[i].symbols_);
+  }
+  free_(read);
+}
+
+TEST(Compressor_container, frames) {
+  uint32_t i;
+  bool ok;
+  block_entry frame, read;
+
+  for (i = 1; i <= CONTAINER_TEST_BLOCKS; i++) {
+    frame.size_ = i;
+    frame.symbols_ = (uint64_t) i << 32;
+    Container_Frame_Write(&frame, fp);
+    fwrite("data", sizeof(char), 4, fp);
+  }
+  frame.size_ = frame.symbols_ = 0;
+  Container_Frame_Write(&frame, fp);
+
+  /* frames are read one after another until the empty one */
+  rewind(fp);
+  for (i = 1; i <= CONTAINER_TEST_BLOCKS; i++) {
+    ok = Container_Frame_Read(&read, fp);
+    TEST_ASSERT_TRUE(ok);
+    TEST_ASSERT_TRUE(read.size_ == i);
+    TEST_ASSERT_TRUE(read.symbols_ == (uint64_t) i << 32);
+    fseek(fp, 4, SEEK_CUR);
+  }
+  ok = Container_Frame_Read(&read, fp);
+  TEST_ASSERT_TRUE(ok);
+  TEST_ASSERT_TRUE(read.symbols_ == 0);
+  ok = Container_Frame_Read(&read, fp);
+  TEST_ASSERT_FALSE(ok);
+}
+
+TEST_GROUP_RUNNER(Compressor_container) {
+  RUN_TEST_CASE(Compressor_container, header);
+  RUN_TEST_CASE(Compressor_container, header_mismatch);
+  RUN_TEST_CASE(Compressor_container, block_table);
+  RUN_TEST_CASE(Compressor_container, frames);
+}
@@ -23,7 +23,7 @@ deBruijn_graph dB;
 Graph_Line line;
 
 TEST_SETUP(Compressor_deBruijn) {
-  deBruijn_Init(&dB);
+  deBruijn_Init(&dB, 0);
 }
 
 TEST_TEAR_DOWN(Compressor_deBruijn) {
@@ -87,7 +87,37 @@ TEST(Compressor_deBruijn, cummulative_frequency) {
   }
 }
 
+TEST(Compressor_deBruijn, range_frequency) {
+  cfreq freq;
+  int32_t lo, up, i, expected[SYMBOL_COUNT];
+
+  const Graph_value L[] = {0, 0, 0, 1, 1, 1, 0, 1, 0, 0, 1, 0, 0, 1, 1, 1};
+  const Graph_value W[] = {_('A'), _('C'), _('G'), _('T'), _('$'), _('G'), _('C'), _('G'),
+                           _('A'), _('C'), _('G'), _('A'), _('G'), _('T'), _('A'), _('C')};
+  const int32_t P[] = {12, 3, 3, 5, 0, 8, 1, 2, 5, 4, 6, 6, 1, 4, 5, 0};
+  const int32_t F[] = {1, 2, 4, 8};  /* not important for this test */
+
+  deBruijn_Free(&dB);
+  deBruijn_Insert_test_data(&dB, L, W, P, F, 16);
+
+  for (lo = 0; lo < 16; lo++) {
+    for (up = lo; up < 16; up++) {
+      memset(expected, 0, sizeof(expected));
+      for (i = lo; i <= up; i++)
+        if (W[i] != VALUE_$) expected[W[i] >> 0x1] += P[i];
+
+      deBruijn_Get_symbol_frequency_range(&dB, lo, up, &freq);
+
+      TEST_ASSERT_EQUAL_INT32(expected[VALUE_A >> 0x1], freq.symbol_[VALUE_A >> 0x1]);
+      TEST_ASSERT_EQUAL_INT32(expected[VALUE_C >> 0x1], freq.symbol_[VALUE_C >> 0x1]);
+      TEST_ASSERT_EQUAL_INT32(expected[VALUE_G >> 0x1], freq.symbol_[VALUE_G >> 0x1]);
+      TEST_ASSERT_EQUAL_INT32(expected[VALUE_T >> 0x1], freq.symbol_[VALUE_T >> 0x1]);
+    }
+  }
+}
+
 TEST_GROUP_RUNNER(Compressor_deBruijn) {
   RUN_TEST_CASE(Compressor_deBruijn, static_test);
   RUN_TEST_CASE(Compressor_deBruijn, cummulative_frequency);
+  RUN_TEST_CASE(Compressor_deBruijn, range_frequency);
 }
@@ -17,7 +17,7 @@ Graph_Struct Graph;
 Graph_Line line;
 
 TEST_SETUP(Compressor_int_vector) {
-  Graph_Init(&Graph);
+  Graph_Init(&Graph, 0);
 }
 
 TEST_TEAR_DOWN(Compressor_int_vector) {
@@ -80,8 +80,132 @@ TEST(Compressor_int_vector, frequency_increase) {
   }
 }
 
+TEST(Compressor_int_vector, frequency_overflow) {
+  int32_t i, pos, sequence[TEST_SEQENCE_LEN];
+
+  /* small values interleaved with inserts and increases past the narrow counter size */
+  for (i = 0; i < TEST_SEQENCE_LEN; i++) {
+    pos = rand() % (i + 1);
+    memmove(&(sequence[pos + 1]), &(sequence[pos]), (i - pos) * sizeof(int32_t));
+    sequence[pos] = rand() % 16;
+
+    GLine_Fill(&line, VAR_IGNORE, VAR_IGNORE, sequence[pos]);
+    GLine_Insert(&Graph, pos, &line);
+
+    if (i % 50 == 49) {
+      pos = rand() % (i + 1);
+      sequence[pos] += 300;
+      Graph_Increase_frequency(&Graph, pos, 300);
+    }
+  }
+
+  for (i = 0; i < TEST_SEQENCE_LEN; i++) {
+    GLine_Get(&Graph, i, &line);
+    TEST_ASSERT_EQUAL_UINT32(sequence[i], line.P_);
+  }
+}
+
+TEST(Compressor_int_vector, iterator) {
+  int32_t i, sequence[TEST_SEQENCE_LEN];
+  Graph_Iterator iter;
+  bool moved;
+
+  for (i = 0; i < TEST_SEQENCE_LEN; i++) {
+    sequence[i] = rand();
+
+    GLine_Fill(&line, VAR_IGNORE, VAR_IGNORE, sequence[i]);
+    GLine_Insert(&Graph, i, &line);
+  }
+
+  Graph_Iterator_Init(&iter, &Graph, 0);
+  for (i = 0; i < TEST_SEQENCE_LEN; i++) {
+    TEST_ASSERT_EQUAL_UINT32(i, Graph_Iterator_Position(&iter));
+    Graph_Iterator_Get(&iter, &line);
+    TEST_ASSERT_EQUAL_UINT32(sequence[i], line.P_);
+    moved = Graph_Iterator_Next(&iter);
+    TEST_ASSERT_TRUE(moved == (i != TEST_SEQENCE_LEN - 1));
+  }
+
+  Graph_Iterator_Init(&iter, &Graph, TEST_SEQENCE_LEN / 2);
+  for (i = TEST_SEQENCE_LEN / 2; i >= 0; i--) {
+    TEST_ASSERT_EQUAL_UINT32(i, Graph_Iterator_Position(&iter));
+    Graph_Iterator_Get(&iter, &line);
+    TEST_ASSERT_EQUAL_UINT32(sequence[i], line.P_);
+    moved = Graph_Iterator_Prev(&iter);
+    TEST_ASSERT_TRUE(moved == (i != 0));
+  }
+}
+
+TEST(Compressor_int_vector, deletion) {
+  int32_t i, pos, size, sequence[2 * TEST_SEQENCE_LEN];
+
+  for (i = 0; i < 2 * TEST_SEQENCE_LEN; i++) {
+    sequence[i] = rand() % 1000;
+
+    GLine_Fill(&line, VAR_IGNORE, VAR_IGNORE, sequence[i]);
+    GLine_Insert(&Graph, i, &line);
+  }
+
+  /* delete random lines until the graph is empty, check it now and then */
+  for (size = 2 * TEST_SEQENCE_LEN; size > 0; size--) {
+    pos = rand() % size;
+    memmove(&(sequence[pos]), &(sequence[pos + 1]), (size - pos - 1) * sizeof(int32_t));
+    GLine_Delete(&Graph, pos);
+
+    TEST_ASSERT_EQUAL_INT32(size - 1, Graph_Size(&Graph));
+    if (size % 50 == 0) {
+      for (i = 0; i < size - 1; i++) {
+        GLine_Get(&Graph, i, &line);
+        TEST_ASSERT_EQUAL_UINT32(sequence[i], line.P_);
+      }
+    }
+  }
+
+  /* graph is usable again */
+  for (i = 0; i < TEST_SEQENCE_LEN; i++) {
+    GLine_Fill(&line, VAR_IGNORE, VAR_IGNORE, i);
+    GLine_Insert(&Graph, i, &line);
+  }
+  for (i = 0; i < TEST_SEQENCE_LEN; i++) {
+    GLine_Get(&Graph, i, &line);
+    TEST_ASSERT_EQUAL_UINT32(i, line.P_);
+  }
+}
+
+#if defined(INTEGER_CONTEXT_SHORTENING)
+TEST(Compressor_int_vector, csl_search) {
+  int32_t i, j, k, csl[TEST_SEQENCE_LEN];
+
+  for (i = 0; i < TEST_SEQENCE_LEN; i++) {
+    GLine_Fill(&line, VAR_IGNORE, VAR_IGNORE, VAR_IGNORE);
+    GLine_Insert(&Graph, rand() % (i + 1), &line);
+  }
+
+  for (i = 0; i < TEST_SEQENCE_LEN; i++) {
+    csl[i] = rand() % (LEAF_CSL_MAX + 1);
+    Graph_Set_csl(&Graph, i, csl[i]);
+  }
+
+  for (k = 0; k <= LEAF_CSL_MAX + 1; k++) {
+    for (i = 0; i < TEST_SEQENCE_LEN; i++) {
+      for (j = i; j >= 0 && csl[j] >= k; j--) {}
+      TEST_ASSERT_EQUAL_INT32(j, Graph_Find_csl_lower(&Graph, i, k));
+
+      for (j = i; j < TEST_SEQENCE_LEN && csl[j] >= k; j++) {}
+      TEST_ASSERT_EQUAL_INT32(j, Graph_Find_csl_upper(&Graph, i, k));
+    }
+  }
+}
+#endif
+
 TEST_GROUP_RUNNER(Compressor_int_vector) {
   RUN_TEST_CASE(Compressor_int_vector, front_insertion);
   RUN_TEST_CASE(Compressor_int_vector, rear_insertion);
   RUN_TEST_CASE(Compressor_int_vector, frequency_increase);
+  RUN_TEST_CASE(Compressor_int_vector, frequency_overflow);
+  RUN_TEST_CASE(Compressor_int_vector, iterator);
+  RUN_TEST_CASE(Compressor_int_vector, deletion);
+#if defined(INTEGER_CONTEXT_SHORTENING)
+  RUN_TEST_CASE(Compressor_int_vector, csl_search);
+#endif
 }
@@ -8,7 +8,7 @@ TEST_GROUP(Compressor_memory);
 MemObj mem;
 
 TEST_SETUP(Compressor_memory) {
-  mem = Memory_init();
+  mem = Memory_init(0, 0);
 }
 
 TEST_TEAR_DOWN(Compressor_memory) {
@@ -37,6 +37,35 @@ TEST(Compressor_memory, CorrectLeafNodeMapping) {
   }
 }
 
+TEST(Compressor_memory, SizeHint) {
+  int32_t i;
+  MemObj hinted;
+  NodeRef node_ref;
+  LeafRef leaf_ref;
+  MemPtr nodes[MEMORY_SAMPLE_SIZE_];
+  MemPtr leafs[MEMORY_SAMPLE_SIZE_];
+
+  /* elements must stay accessible when they don't fit into the first blocks */
+  hinted = Memory_init(MEMORY_SAMPLE_SIZE_ / 3, MEMORY_SAMPLE_SIZE_ / 7);
+  for (i = 0; i < MEMORY_SAMPLE_SIZE_; i++) {
+    nodes[i] = Memory_new_node(hinted);
+    node_ref = MEMORY_GET_NODE(hinted, nodes[i]);
+    node_ref->p_ = i;
+
+    leafs[i] = Memory_new_leaf(hinted);
+    leaf_ref = MEMORY_GET_LEAF(hinted, leafs[i]);
+    leaf_ref->p_ = MEMORY_SAMPLE_SIZE_ - i;
+  }
+
+  for (i = 0; i < MEMORY_SAMPLE_SIZE_; i++) {
+    TEST_ASSERT_EQUAL(i, MEMORY_GET_ANY(hinted, nodes[i])->p_);
+    TEST_ASSERT_EQUAL(MEMORY_SAMPLE_SIZE_ - i, MEMORY_GET_ANY(hinted, leafs[i])->p_);
+    TEST_ASSERT_TRUE(IS_LEAF(leafs[i]));
+  }
+  Memory_free(&hinted);
+}
+
 TEST_GROUP_RUNNER(Compressor_memory) {
   RUN_TEST_CASE(Compressor_memory, CorrectLeafNodeMapping);
+  RUN_TEST_CASE(Compressor_memory, SizeHint);
 }
@@ -22,7 +22,7 @@ Graph_Line line;
 
 TEST_SETUP(Compressor_wavelet_tree) {
   sequence = int_sequence_generate_random(TEST_SEQENCE_LEN, 9);
-  Graph_Init(&Graph);
+  Graph_Init(&Graph, 0);
 }
 
 TEST_TEAR_DOWN(Compressor_wavelet_tree) {
@@ -32,6 +32,7 @@ TEST_TEAR_DOWN(Compressor_wavelet_tree) {
 
 static void _test_wavelet_tree(GraphRef Graph__, uint8_t* sequence) {
   int32_t i;
+  LinePos ranks[VALUE_$];
   Graph_value g;
 
   if (TEST_PRINT_SEQUENCES) {
@@ -50,6 +51,11 @@ static void _test_wavelet_tree(GraphRef Graph__, uint8_t* sequence) {
                               Graph_Rank(Graph__, i, VECTOR_W, g));
     }
 
+    Graph_Rank_W_all(Graph__, i, ranks);
+    for (g = VALUE_A; g < VALUE_$; g++) {
+      TEST_ASSERT_EQUAL_INT32(int_sequence_rank(sequence, TEST_SEQENCE_LEN, i, g), ranks[g]);
+    }
+
     for (g = VALUE_A; g <= VALUE_$; g++) {
       TEST_ASSERT_EQUAL_INT32(int_sequence_select(sequence, TEST_SEQENCE_LEN, i, g),
                               Graph_Select(Graph__, i, VECTOR_W, g));
@@ -119,8 +125,84 @@ TEST(Compressor_wavelet_tree, symbol_change) {
   _test_wavelet_tree(&Graph, sequence);
 }
 
+TEST(Compressor_wavelet_tree, bulk_build) {
+  int32_t i;
+  Graph_Line lines[TEST_SEQENCE_LEN];
+
+  for (i = 0; i < TEST_SEQENCE_LEN; i++) {
+    uint8_t letter = int_sequence_get(sequence, TEST_SEQENCE_LEN, i);
+    GLine_Fill(&(lines[i]), VAR_IGNORE, letter, VAR_IGNORE);
+  }
+
+  /* build graph from first half and insert the rest into full leaves */
+  Graph_Free(&Graph);
+  Graph_Build(&Graph, lines, NULL, TEST_SEQENCE_LEN / 2);
+
+  for (i = TEST_SEQENCE_LEN / 2; i < TEST_SEQENCE_LEN; i++) {
+    GLine_Insert(&Graph, i, &(lines[i]));
+  }
+  _test_wavelet_tree(&Graph, sequence);
+}
+
+TEST(Compressor_wavelet_tree, compaction) {
+  int32_t i;
+
+  /* front insertion scatters the tree most, compact it now and then */
+  for (i = TEST_SEQENCE_LEN - 1; i >= 0; i--) {
+    uint8_t letter = int_sequence_get(sequence, TEST_SEQENCE_LEN, i);
+
+    GLine_Fill(&line, VAR_IGNORE, letter, 300 + i);
+    GLine_Insert(&Graph, 0, &line);
+
+    if (i % 100 == 0)
+      Graph_Compact(&Graph);
+  }
+  _test_wavelet_tree(&Graph, sequence);
+
+  for (i = 0; i < TEST_SEQENCE_LEN; i++) {
+    GLine_Get(&Graph, i, &line);
+    TEST_ASSERT_EQUAL_UINT32(300 + i, line.P_);
+  }
+}
+
+TEST(Compressor_wavelet_tree, deletion) {
+  int32_t i, pos, size;
+  uint8_t extra[2 * TEST_SEQENCE_LEN];
+
+  for (i = 0; i < TEST_SEQENCE_LEN; i++) {
+    uint8_t letter = int_sequence_get(sequence, TEST_SEQENCE_LEN, i);
+
+    GLine_Fill(&line, VAR_IGNORE, letter, VAR_IGNORE);
+    GLine_Insert(&Graph, i, &line);
+    extra[i] = false;
+  }
+
+  /* insert extra lines on random positions and delete them in random order */
+  for (size = TEST_SEQENCE_LEN; size < 2 * TEST_SEQENCE_LEN; size++) {
+    pos = rand() % (size + 1);
+    memmove(&(extra[pos + 1]), &(extra[pos]), size - pos);
+    extra[pos] = true;
+
+    GLine_Fill(&line, VAR_IGNORE, rand() % 9, VAR_IGNORE);
+    GLine_Insert(&Graph, pos, &line);
+  }
+
+  for (; size > TEST_SEQENCE_LEN; size--) {
+    do {
+      pos = rand() % size;
+    } while (!extra[pos]);
+    memmove(&(extra[pos]), &(extra[pos + 1]), size - pos - 1);
+
+    GLine_Delete(&Graph, pos);
+  }
+  _test_wavelet_tree(&Graph, sequence);
+}
+
 TEST_GROUP_RUNNER(Compressor_wavelet_tree) {
   RUN_TEST_CASE(Compressor_wavelet_tree, front_insertion);
   RUN_TEST_CASE(Compressor_wavelet_tree, rear_insertion);
   RUN_TEST_CASE(Compressor_wavelet_tree, symbol_change);
+  RUN_TEST_CASE(Compressor_wavelet_tree, bulk_build);
+  RUN_TEST_CASE(Compressor_wavelet_tree, compaction);
+  RUN_TEST_CASE(Compressor_wavelet_tree, deletion);
 }